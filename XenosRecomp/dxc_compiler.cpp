@@ -9,9 +9,15 @@ DxcCompiler::DxcCompiler()
 DxcCompiler::~DxcCompiler()
 {
     dxcCompiler->Release();
+
+    if (dxcValidator != nullptr)
+        dxcValidator->Release();
+
+    if (dxcUtils != nullptr)
+        dxcUtils->Release();
 }
 
-IDxcBlob* DxcCompiler::compile(const std::string& shaderSource, bool compilePixelShader, bool compileLibrary, bool compileSpirv)
+IDxcBlob* DxcCompiler::compile(const std::string& shaderSource, bool compilePixelShader, bool compileLibrary, bool compileSpirv, DxcProfile profile, std::optional<uint32_t> specConstants)
 {
     DxcBuffer source{};
     source.Ptr = shaderSource.c_str();
@@ -54,10 +60,28 @@ IDxcBlob* DxcCompiler::compile(const std::string& shaderSource, bool compilePixe
 
     args[argCount++] = L"-Qstrip_debug";
 
+    if (profile == DxcProfile::Iteration)
+    {
+        args[argCount++] = L"-Od";
+        args[argCount++] = L"-Vd";
+    }
+    else
+    {
+        args[argCount++] = L"-O3";
+    }
+
 #ifdef UNLEASHED_RECOMP
     args[argCount++] = L"-DUNLEASHED_RECOMP";
 #endif
 
+    std::wstring specConstantsDefine;
+    if (specConstants.has_value())
+    {
+        assert(!compileLibrary);
+        specConstantsDefine = L"-DSPEC_CONSTANTS_VALUE=" + std::to_wstring(*specConstants);
+        args[argCount++] = specConstantsDefine.c_str();
+    }
+
     IDxcResult* result = nullptr;
     HRESULT hr = dxcCompiler->Compile(&source, args, argCount, nullptr, IID_PPV_ARGS(&result));
 
@@ -98,3 +122,45 @@ IDxcBlob* DxcCompiler::compile(const std::string& shaderSource, bool compilePixe
 
     return object;
 }
+
+bool DxcCompiler::validate(std::vector<uint8_t>& dxil, std::string& errors)
+{
+    HRESULT hr;
+
+    if (dxcValidator == nullptr)
+    {
+        hr = DxcCreateInstance(CLSID_DxcValidator, IID_PPV_ARGS(&dxcValidator));
+        assert(SUCCEEDED(hr));
+
+        hr = DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&dxcUtils));
+        assert(SUCCEEDED(hr));
+    }
+
+    // The blob is pinned to the vector, so signing in place writes the hash directly into it.
+    IDxcBlobEncoding* blob = nullptr;
+    hr = dxcUtils->CreateBlobFromPinned(dxil.data(), uint32_t(dxil.size()), DXC_CP_ACP, &blob);
+    assert(SUCCEEDED(hr) && blob != nullptr);
+
+    IDxcOperationResult* result = nullptr;
+    hr = dxcValidator->Validate(blob, DxcValidatorFlags_InPlaceEdit, &result);
+    assert(SUCCEEDED(hr) && result != nullptr);
+
+    HRESULT status;
+    hr = result->GetStatus(&status);
+    assert(SUCCEEDED(hr));
+
+    if (FAILED(status))
+    {
+        IDxcBlobEncoding* errorBuffer = nullptr;
+        if (SUCCEEDED(result->GetErrorBuffer(&errorBuffer)) && errorBuffer != nullptr)
+        {
+            errors.append(reinterpret_cast<const char*>(errorBuffer->GetBufferPointer()), errorBuffer->GetBufferSize());
+            errorBuffer->Release();
+        }
+    }
+
+    result->Release();
+    blob->Release();
+
+    return SUCCEEDED(status);
+}
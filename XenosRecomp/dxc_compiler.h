@@ -1,11 +1,28 @@
 #pragma once
 
+enum class DxcProfile : uint32_t
+{
+    // Full optimization with inline validation, used for shipping caches.
+    Release,
+
+    // No optimization or validation for fast turnaround. Shaders are expected to be validated afterwards in a batch.
+    Iteration
+};
+
 struct DxcCompiler
 {
     IDxcCompiler3* dxcCompiler = nullptr;
+    IDxcValidator* dxcValidator = nullptr;
+    IDxcUtils* dxcUtils = nullptr;
 
     DxcCompiler();
     ~DxcCompiler();
 
-    IDxcBlob* compile(const std::string& shaderSource, bool compilePixelShader, bool compileLibrary, bool compileSpirv);
+    // Passing specialization constants freezes them to the given value, which removes the need for a library link step in DXIL,
+    // and allows dead branches to be removed offline in SPIR-V.
+    IDxcBlob* compile(const std::string& shaderSource, bool compilePixelShader, bool compileLibrary, bool compileSpirv, DxcProfile profile = DxcProfile::Release,
+        std::optional<uint32_t> specConstants = std::nullopt);
+
+    // Validates the DXIL container and signs it in place. Errors are appended to the string on failure.
+    bool validate(std::vector<uint8_t>& dxil, std::string& errors);
 };
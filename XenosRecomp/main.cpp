@@ -1,10 +1,16 @@
 #include "shader.h"
-#include "shader_recompiler.h"
-#include "dxc_compiler.h"
+#include "shader_translator.h"
+#include "shader_manifest.h"
+#include "shader_spirv.h"
 
 static std::unique_ptr<uint8_t[]> readAllBytes(const char* filePath, size_t& fileSize)
 {
     FILE* file = fopen(filePath, "rb");
+    if (file == nullptr)
+    {
+        fileSize = 0;
+        return nullptr;
+    }
     fseek(file, 0, SEEK_END);
     fileSize = ftell(file);
     fseek(file, 0, SEEK_SET);
@@ -21,198 +27,1407 @@ static void writeAllBytes(const char* filePath, const void* data, size_t dataSiz
     fclose(file);
 }
 
-struct RecompiledShader
+struct Options
 {
-    uint8_t* data = nullptr;
-    IDxcBlob* dxil = nullptr;
-    std::vector<uint8_t> spirv;
-    uint32_t specConstantsMask = 0;
+    bool watch = false;
+    bool validate = false;
+    const char* manifest = nullptr;
+    const char* spirvVal = nullptr;
+    DxcProfile profile = DxcProfile::Release;
+    std::vector<uint32_t> specMasks;
+    bool specPowerset = false;
+    bool spirvVariants = false;
+    bool directSpirv = false;
+    bool benchmark = false;
+
+    // Vertex and pixel shader hashes to link, sorted by vertex shader.
+    std::vector<std::pair<XXH64_hash_t, XXH64_hash_t>> linkPairs;
+
+    // Links every vertex shader against no interpolators at all, for depth and shadow passes.
+    bool positionOnly = false;
 };
 
-int main(int argc, char** argv)
+// Returns the masks to compile fully specialized variants for. Bits that the shader doesn't use are
+// masked out, as they have no effect on the result.
+static std::vector<uint32_t> getVariantMasks(uint32_t specConstantsMask, const Options& options)
 {
-#ifndef XENOS_RECOMP_INPUT
-    if (argc < 4)
-    {
-        printf("Usage: XenosRecomp [input path] [output path] [shader common header file path]");
-        return 0;
-    }
-#endif
+    std::vector<uint32_t> masks;
 
-    const char* input =
-#ifdef XENOS_RECOMP_INPUT 
-        XENOS_RECOMP_INPUT
+#ifdef XENOS_RECOMP_DXIL
+    bool enabled = true;
 #else
-        argv[1]
+    bool enabled = options.spirvVariants;
 #endif
-    ;
 
-    const char* output =
-#ifdef XENOS_RECOMP_OUTPUT 
-        XENOS_RECOMP_OUTPUT
-#else
-        argv[2]
+    if (enabled && specConstantsMask != 0)
+    {
+        if (options.specPowerset)
+        {
+            for (uint32_t mask = specConstantsMask; ; mask = (mask - 1) & specConstantsMask)
+            {
+                masks.push_back(mask);
+                if (mask == 0)
+                    break;
+            }
+        }
+        else
+        {
+            for (uint32_t mask : options.specMasks)
+                masks.push_back(mask & specConstantsMask);
+        }
+
+        std::sort(masks.begin(), masks.end());
+        masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+    }
+
+    return masks;
+}
+
+// Reads pairs of hexadecimal vertex and pixel shader hashes separated by whitespace, such as one pair per line.
+// Returns false if the file couldn't be read.
+static bool readLinkPairs(const char* filePath, std::vector<std::pair<XXH64_hash_t, XXH64_hash_t>>& pairs)
+{
+    size_t fileSize = 0;
+    auto fileData = readAllBytes(filePath, fileSize);
+    if (fileData == nullptr)
+    {
+        fmt::println("Failed to read the shader pairs from {}.", filePath);
+        return false;
+    }
+
+    std::string text(reinterpret_cast<const char*>(fileData.get()), fileSize);
+    const char* cursor = text.c_str();
+
+    while (true)
+    {
+        char* end;
+        XXH64_hash_t vertexShader = strtoull(cursor, &end, 16);
+        if (end == cursor)
+            break;
+
+        cursor = end;
+        XXH64_hash_t pixelShader = strtoull(cursor, &end, 16);
+        if (end == cursor)
+            break;
+
+        cursor = end;
+        pairs.emplace_back(vertexShader, pixelShader);
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    return true;
+}
+
+// Returns the interpolators to keep for the pixel shaders a vertex shader is paired with, leaving out pixel shaders
+// that read everything it exports. Pixel shaders missing from the input and hashes of other vertex shaders are ignored.
+// Returns nothing if one of them still needs to be recompiled, as its interpolators are unknown until then.
+// Position-only variants keep none.
+static std::optional<std::vector<uint32_t>> getLinkMasks(XXH64_hash_t hash, const RecompiledShader& shader,
+    const std::map<XXH64_hash_t, RecompiledShader>& shaders, const Options& options)
+{
+    std::vector<uint32_t> masks;
+    if (shader.isPixelShader)
+        return masks;
+
+    if (options.positionOnly && shader.metadata.interpolators != 0)
+        masks.push_back(0);
+
+    auto pair = std::lower_bound(options.linkPairs.begin(), options.linkPairs.end(), std::make_pair(hash, XXH64_hash_t(0)));
+    for (; pair != options.linkPairs.end() && pair->first == hash; ++pair)
+    {
+        auto findResult = shaders.find(pair->second);
+        if (findResult == shaders.end())
+            continue;
+
+        if (!findResult->second.isRecompiled())
+            return std::nullopt;
+
+        if (!findResult->second.isPixelShader)
+            continue;
+
+        uint32_t mask = shader.metadata.interpolators & findResult->second.metadata.interpolators;
+        if (mask != shader.metadata.interpolators)
+            masks.push_back(mask);
+    }
+
+    std::sort(masks.begin(), masks.end());
+    masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+
+    return masks;
+}
+
+// Resets the vertex shaders whose linked variants don't match their pairs anymore, such as when the pairs changed or
+// one of their pixel shaders is new, so that they get recompiled and linked again. They are reset after checking all
+// of them, as the pairs are checked against the shaders as they were scanned.
+static void resetStaleLinks(std::map<XXH64_hash_t, RecompiledShader>& shaders, const Options& options)
+{
+    std::vector<RecompiledShader*> unlinked;
+    for (auto& [hash, shader] : shaders)
+    {
+        if (!shader.isRecompiled())
+            continue;
+
+        auto linkMasks = getLinkMasks(hash, shader, shaders, options);
+        bool matches = linkMasks.has_value() && linkMasks->size() == shader.linkedVariants.size();
+
+        for (size_t i = 0; matches && i < linkMasks->size(); i++)
+            matches = (*linkMasks)[i] == shader.linkedVariants[i].interpolators;
+
+        if (!matches)
+            unlinked.push_back(&shader);
+    }
+
+    for (auto shader : unlinked)
+    {
+        uint32_t references = shader->references;
+        *shader = {};
+        shader->references = references;
+    }
+}
+
+// Hashes everything besides the containers that the compiled shaders depend on and that the manifest doesn't track
+// per shader. Link pairs, position-only variants, specialization constant variants and profiles are compared per shader.
+static XXH64_hash_t getManifestKey(const std::string_view& include, const Options& options)
+{
+    std::string key(include);
+    key += fmt::format("\nversion={} directSpirv={}", SHADER_RECOMPILER_VERSION, options.directSpirv);
+
+#ifdef XENOS_RECOMP_DXIL
+    key += " dxil";
 #endif
-        ;
-    
-    const char* includeInput =
-#ifdef XENOS_RECOMP_INCLUDE_INPUT
-        XENOS_RECOMP_INCLUDE_INPUT
-#else
-        argv[3]
+#ifdef UNLEASHED_RECOMP
+    key += " unleashed";
 #endif
-        ;
 
-    size_t includeSize = 0;
-    auto includeData = readAllBytes(includeInput, includeSize);
-    std::string_view include(reinterpret_cast<const char*>(includeData.get()), includeSize);
+    return XXH3_64bits(key.data(), key.size());
+}
 
-    if (std::filesystem::is_directory(input))
+static int64_t getLastWriteTime(const std::filesystem::path& filePath)
+{
+    std::error_code ec;
+    return std::filesystem::last_write_time(filePath, ec).time_since_epoch().count();
+}
+
+// Scans a file for shader containers and registers them in the shader map. If the size and modification time
+// match the previous scan, the file is skipped without being read, and its containers get loaded lazily only if
+// they need to be recompiled. Otherwise, the file data is returned if any shader ended up pointing into it.
+// Files known to have been written are always read, as a rewrite can keep both within the timestamp resolution.
+static std::unique_ptr<uint8_t[]> scanFile(const std::filesystem::path& filePath, ScannedFile& scannedFile, const ScannedFile* previousFile,
+    std::map<XXH64_hash_t, RecompiledShader>& shaders, bool wasWritten = false)
+{
+    std::error_code ec;
+    scannedFile.size = std::filesystem::file_size(filePath, ec);
+    scannedFile.lastWriteTime = getLastWriteTime(filePath);
+    scannedFile.containers.clear();
+
+    if (previousFile != nullptr && !wasWritten && previousFile->size == scannedFile.size && previousFile->lastWriteTime == scannedFile.lastWriteTime)
     {
-        std::vector<std::unique_ptr<uint8_t[]>> files;
-        std::map<XXH64_hash_t, RecompiledShader> shaders;
+        scannedFile.contentHash = previousFile->contentHash;
+        scannedFile.containers = previousFile->containers;
 
-        for (auto& file : std::filesystem::recursive_directory_iterator(input))
+        for (auto& container : scannedFile.containers)
+            ++shaders[container.hash].references;
+
+        return nullptr;
+    }
+
+    size_t fileSize = 0;
+    auto fileData = readAllBytes(filePath.string().c_str(), fileSize);
+    bool foundAny = false;
+
+    scannedFile.size = fileSize;
+    scannedFile.contentHash = XXH3_64bits(fileData.get(), fileSize);
+
+    if (previousFile != nullptr && previousFile->contentHash == scannedFile.contentHash)
+    {
+        // Only the modification time changed, the containers are still at the same place.
+        scannedFile.containers = previousFile->containers;
+    }
+    else
+    {
+        // Byte patterns that merely look like a container header get rejected by a full parse. Containers the
+        // recompiler can't translate are rejected here as well, so they never reach the shader map.
+        thread_local ShaderRecompiler validator;
+
+        for (size_t i = 0; fileSize > sizeof(ShaderContainer) && i < fileSize - sizeof(ShaderContainer) - 1;)
         {
-            if (std::filesystem::is_directory(file))
+            auto shaderContainer = reinterpret_cast<const ShaderContainer*>(fileData.get() + i);
+            size_t dataSize = shaderContainer->virtualSize + shaderContainer->physicalSize;
+
+            if ((shaderContainer->flags & 0xFFFFFF00) == 0x102A1100 &&
+                dataSize <= (fileSize - i) &&
+                shaderContainer->field1C == 0 &&
+                shaderContainer->field20 == 0 &&
+                validator.validate(fileData.get() + i, dataSize))
             {
-                continue;
+                auto& container = scannedFile.containers.emplace_back();
+                container.offset = i;
+                container.size = dataSize;
+                container.hash = XXH3_64bits(shaderContainer, dataSize);
+
+                i += dataSize;
             }
-            
-            size_t fileSize = 0;
-            auto fileData = readAllBytes(file.path().string().c_str(), fileSize);
-            bool foundAny = false;
+            else
+            {
+                i += sizeof(uint32_t);
+            }
+        }
+    }
+
+    for (auto& container : scannedFile.containers)
+    {
+        auto& shader = shaders[container.hash];
+        if (shader.data == nullptr && !shader.isRecompiled())
+        {
+            shader.data = fileData.get() + container.offset;
+            shader.size = container.size;
+            foundAny = true;
+        }
+
+        ++shader.references;
+    }
+
+    if (!foundAny)
+        fileData.reset();
+
+    return fileData;
+}
+
+static void releaseShaders(std::map<XXH64_hash_t, RecompiledShader>& shaders, const ScannedFile& scannedFile)
+{
+    for (auto& container : scannedFile.containers)
+    {
+        auto findResult = shaders.find(container.hash);
+        assert(findResult != shaders.end());
+        --findResult->second.references;
+    }
+}
 
-            for (size_t i = 0; fileSize > sizeof(ShaderContainer) && i < fileSize - sizeof(ShaderContainer) - 1;)
+// Loads the containers of files skipped during the scan that turned out to need recompilation, revalidating
+// their hashes. Files that changed without their size or modification time changing get rescanned.
+static void loadSkippedContainers(std::map<std::filesystem::path, ScannedFile>& files, std::map<XXH64_hash_t, RecompiledShader>& shaders,
+    std::vector<std::unique_ptr<uint8_t[]>>& fileDatas)
+{
+    for (auto& [filePath, scannedFile] : files)
+    {
+        bool needsLoad = false;
+        for (auto& container : scannedFile.containers)
+        {
+            auto& shader = shaders[container.hash];
+            if (shader.data == nullptr && !shader.isRecompiled())
             {
-                auto shaderContainer = reinterpret_cast<const ShaderContainer*>(fileData.get() + i);
-                size_t dataSize = shaderContainer->virtualSize + shaderContainer->physicalSize;
+                needsLoad = true;
+                break;
+            }
+        }
 
-                if ((shaderContainer->flags & 0xFFFFFF00) == 0x102A1100 &&
-                    dataSize <= (fileSize - i) &&
-                    shaderContainer->field1C == 0 &&
-                    shaderContainer->field20 == 0)
-                {
-                    XXH64_hash_t hash = XXH3_64bits(shaderContainer, dataSize);
-                    auto shader = shaders.try_emplace(hash);
-                    if (shader.second)
-                    {
-                        shader.first->second.data = fileData.get() + i;
-                        foundAny = true;
-                    }
+        if (!needsLoad)
+            continue;
 
-                    i += dataSize;
-                }
-                else
+        size_t fileSize = 0;
+        auto fileData = readAllBytes(filePath.string().c_str(), fileSize);
+        bool valid = fileData != nullptr;
+
+        for (size_t i = 0; valid && i < scannedFile.containers.size(); i++)
+        {
+            auto& container = scannedFile.containers[i];
+            valid = container.offset + container.size <= fileSize &&
+                XXH3_64bits(fileData.get() + container.offset, container.size) == container.hash;
+        }
+
+        if (valid)
+        {
+            for (auto& container : scannedFile.containers)
+            {
+                auto& shader = shaders[container.hash];
+                if (shader.data == nullptr && !shader.isRecompiled())
                 {
-                    i += sizeof(uint32_t);
+                    shader.data = fileData.get() + container.offset;
+                    shader.size = container.size;
                 }
             }
 
-            if (foundAny)
-                files.emplace_back(std::move(fileData));
+            fileDatas.emplace_back(std::move(fileData));
+        }
+        else
+        {
+            fmt::println("{} changed since the last scan, rescanning...", filePath.string());
+
+            releaseShaders(shaders, scannedFile);
+
+            fileData = scanFile(filePath, scannedFile, nullptr, shaders);
+            if (fileData != nullptr)
+                fileDatas.emplace_back(std::move(fileData));
+        }
+    }
+}
+
+// Drops shaders no longer referenced by any file, returns whether the entry set changed.
+static bool removeUnreferencedShaders(std::map<XXH64_hash_t, RecompiledShader>& shaders)
+{
+    bool anyRemoved = false;
+
+    for (auto it = shaders.begin(); it != shaders.end();)
+    {
+        if (it->second.references == 0)
+        {
+            it = shaders.erase(it);
+            anyRemoved = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return anyRemoved;
+}
+
+static std::vector<RecompiledShader*> getPendingShaders(std::map<XXH64_hash_t, RecompiledShader>& shaders)
+{
+    std::vector<RecompiledShader*> pending;
+    for (auto& [hash, shader] : shaders)
+    {
+        if (!shader.isRecompiled())
+        {
+            assert(shader.data != nullptr);
+            pending.push_back(&shader);
         }
+    }
+
+    return pending;
+}
+
+// Compiles the last translation with DXC as well and compares the stage interfaces, as directly translated shaders have
+// to link against the ones DXC compiles. On a mismatch, a warning is printed and the module compiled by DXC replaces the
+// direct one. Returns false only if DXC fails to compile the shader.
+static bool checkDirectSpirv(const RecompiledShader& shader, ShaderTranslator& translator, std::vector<uint32_t>& spirv,
+    std::optional<uint32_t> specConstants = std::nullopt)
+{
+    thread_local std::vector<uint32_t> dxcSpirv;
+    if (!translator.compileSpirvWithDxc(dxcSpirv, specConstants))
+        return false;
 
-        std::atomic<uint32_t> progress = 0;
+    SpirvInterface directInterface;
+    SpirvInterface dxcInterface;
+    if (getSpirvInterface(spirv.data(), spirv.size(), directInterface) && getSpirvInterface(dxcSpirv.data(), dxcSpirv.size(), dxcInterface) &&
+        directInterface == dxcInterface)
+    {
+        return true;
+    }
+
+    fmt::print(stderr, "{:X}: the directly translated SPIR-V interface differs from DXC, using DXC instead.\n",
+        XXH3_64bits(shader.data, shader.size));
+
+    spirv.swap(dxcSpirv);
+    translator.isSpirvDirect = false;
+    return true;
+}
+
+// Returns the number of shaders that failed to compile. Failed shaders are left without SPIR-V, so they stay pending.
+static uint32_t recompileShaders(const std::vector<RecompiledShader*>& pending, const std::string_view& include, const Options& options)
+{
+    std::atomic<uint32_t> progress = 0;
+    std::atomic<uint32_t> structuredCount = 0;
+    std::atomic<uint32_t> directSpirvCount = 0;
+    std::atomic<uint32_t> failures = 0;
+
+    std::for_each(std::execution::par_unseq, pending.begin(), pending.end(), [&](RecompiledShader* shaderPtr)
+        {
+            auto& shader = *shaderPtr;
+
+            thread_local ShaderTranslator translator;
+            translator.profile = options.profile;
+            translator.directSpirv = options.directSpirv;
+
+            auto fail = [&]()
+                {
+                    fmt::print(stderr, "{:X}: failed to recompile.\n", XXH3_64bits(shader.data, shader.size));
+                    shader.dxil.clear();
+                    shader.spirv.clear();
+                    shader.variants.clear();
+                    ++failures;
+                };
+
+            if (!translator.translate(shader.data, shader.size, include))
+                return fail();
+
+            auto& recompiler = translator.recompiler;
+            shader.isPixelShader = recompiler.isPixelShader;
+            shader.specConstantsMask = recompiler.specConstantsMask;
+            shader.metadata = recompiler.metadata;
+            shader.vertexInputs = recompiler.vertexInputs;
+            shader.profile = options.profile;
+
+            if (recompiler.structuredControlFlow)
+                ++structuredCount;
+            shader.variants.clear();
+
+#ifdef XENOS_RECOMP_DXIL
+            if (!translator.compileDxil(shader.dxil))
+                return fail();
+
+            assert((options.profile == DxcProfile::Iteration || *(reinterpret_cast<uint32_t *>(shader.dxil.data()) + 1) != 0) && "DXIL was not signed properly!");
+#endif
+
+            // Shaders the direct translation doesn't support still go through DXC.
+            thread_local std::vector<uint32_t> spirv;
+            if (!translator.compileSpirv(spirv))
+                return fail();
+
+            auto checkSpirv = [&](std::optional<uint32_t> specConstants)
+                {
+                    return !translator.isSpirvDirect || !options.validate || checkDirectSpirv(shader, translator, spirv, specConstants);
+                };
+
+            if (!checkSpirv(std::nullopt))
+                return fail();
+
+            shader.isSpirvDirect = translator.isSpirvDirect;
+            if (translator.isSpirvDirect)
+                ++directSpirvCount;
 
-        std::for_each(std::execution::par_unseq, shaders.begin(), shaders.end(), [&](auto& hashShaderPair)
+            bool result = smolv::Encode(spirv.data(), spirv.size() * sizeof(uint32_t), shader.spirv, smolv::kEncodeFlagStripDebugInfo);
+            assert(result);
+
+            for (uint32_t specConstants : getVariantMasks(shader.specConstantsMask, options))
             {
-                auto& shader = hashShaderPair.second;
+                auto& variant = shader.variants.emplace_back();
+                variant.specConstants = specConstants;
+
+#ifdef XENOS_RECOMP_DXIL
+                if (!translator.compileDxil(variant.dxil, specConstants))
+                    return fail();
+#endif
+
+                if (options.spirvVariants)
+                {
+                    if (!translator.compileSpirv(spirv, specConstants))
+                        return fail();
+
+                    if (!checkSpirv(specConstants))
+                        return fail();
+
+                    variant.isSpirvDirect = translator.isSpirvDirect;
 
-                thread_local ShaderRecompiler recompiler;
-                recompiler = {};
-                recompiler.recompile(shader.data, include);
+                    result = smolv::Encode(spirv.data(), spirv.size() * sizeof(uint32_t), variant.spirv, smolv::kEncodeFlagStripDebugInfo);
+                    assert(result);
+                }
+            }
+
+            size_t currentProgress = ++progress;
+            if ((currentProgress % 10) == 0 || (currentProgress == pending.size() - 1))
+                fmt::println("Recompiling shaders... {}%", currentProgress / float(pending.size()) * 100.0f);
+        });
+
+    if (!pending.empty())
+    {
+        fmt::println("{} shaders use structured control flow, {} fall back to the pc dispatcher.", structuredCount.load(), pending.size() - structuredCount);
+
+        if (options.directSpirv)
+            fmt::println("{} shaders were translated to SPIR-V directly, {} fall back to DXC.", directSpirvCount.load(), pending.size() - directSpirvCount);
+    }
+
+    return failures;
+}
+
+// Compiles the vertex shaders that were just recompiled once for every set of interpolators their paired pixel
+// shaders read, which requires the pixel shaders to be recompiled first. Position-only variants are linked here too.
+// Returns the number of shaders that failed to link. Shaders that failed to link are reset to be recompiled.
+static uint32_t linkShaders(std::map<XXH64_hash_t, RecompiledShader>& shaders, const std::string_view& include, const Options& options)
+{
+    std::vector<std::pair<RecompiledShader*, std::vector<uint32_t>>> pending;
+
+    for (auto& [hash, shader] : shaders)
+    {
+        if (shader.data == nullptr || !shader.isRecompiled())
+            continue;
+
+        shader.linkedVariants.clear();
+
+        // Shaders paired with ones that failed to recompile, which were reported already, get recompiled along with them.
+        auto linkMasks = getLinkMasks(hash, shader, shaders, options);
+        if (!linkMasks.has_value())
+        {
+            uint32_t references = shader.references;
+            shader = {};
+            shader.references = references;
+            continue;
+        }
+
+        if (!linkMasks->empty())
+            pending.emplace_back(&shader, std::move(*linkMasks));
+    }
+
+    std::atomic<uint32_t> linkedCount = 0;
+    std::atomic<uint32_t> failures = 0;
+
+    std::for_each(std::execution::par_unseq, pending.begin(), pending.end(), [&](auto& link)
+        {
+            auto& [shaderPtr, linkMasks] = link;
+            auto& shader = *shaderPtr;
+
+            thread_local ShaderTranslator translator;
+            translator.profile = options.profile;
+            translator.directSpirv = options.directSpirv;
+
+            auto fail = [&]()
+                {
+                    fmt::print(stderr, "{:X}: failed to link.\n", XXH3_64bits(shader.data, shader.size));
+                    shader.dxil.clear();
+                    shader.spirv.clear();
+                    shader.variants.clear();
+                    shader.linkedVariants.clear();
+                    ++failures;
+                };
 
-                shader.specConstantsMask = recompiler.specConstantsMask;
+            for (uint32_t interpolators : linkMasks)
+            {
+                if (!translator.translate(shader.data, shader.size, include, interpolators))
+                    return fail();
 
-                thread_local DxcCompiler dxcCompiler;
+                auto& linkedVariant = shader.linkedVariants.emplace_back();
+                linkedVariant.interpolators = interpolators;
 
 #ifdef XENOS_RECOMP_DXIL
-                shader.dxil = dxcCompiler.compile(recompiler.out, recompiler.isPixelShader, recompiler.specConstantsMask != 0, false);
-                assert(shader.dxil != nullptr);
-                assert(*(reinterpret_cast<uint32_t *>(shader.dxil->GetBufferPointer()) + 1) != 0 && "DXIL was not signed properly!");
+                if (!translator.compileDxil(linkedVariant.dxil))
+                    return fail();
 #endif
 
-                IDxcBlob* spirv = dxcCompiler.compile(recompiler.out, recompiler.isPixelShader, false, true);
-                assert(spirv != nullptr);
+                thread_local std::vector<uint32_t> spirv;
+                if (!translator.compileSpirv(spirv))
+                    return fail();
+
+                if (translator.isSpirvDirect && options.validate && !checkDirectSpirv(shader, translator, spirv))
+                    return fail();
+
+                linkedVariant.isSpirvDirect = translator.isSpirvDirect;
 
-                bool result = smolv::Encode(spirv->GetBufferPointer(), spirv->GetBufferSize(), shader.spirv, smolv::kEncodeFlagStripDebugInfo);
+                bool result = smolv::Encode(spirv.data(), spirv.size() * sizeof(uint32_t), linkedVariant.spirv, smolv::kEncodeFlagStripDebugInfo);
                 assert(result);
 
-                spirv->Release();
+                ++linkedCount;
+            }
+        });
+
+    if (!pending.empty())
+        fmt::println("Linked {} vertex shader variants for {} vertex shaders.", linkedCount.load(), pending.size());
 
-                size_t currentProgress = ++progress;
-                if ((currentProgress % 10) == 0 || (currentProgress == shaders.size() - 1))
-                    fmt::println("Recompiling shaders... {}%", currentProgress / float(shaders.size()) * 100.0f);
-            });
+    // The container data points into file buffers that are only kept alive for the recompilation.
+    for (auto& [hash, shader] : shaders)
+        shader.data = nullptr;
 
-        fmt::println("Creating shader cache...");
+    return failures;
+}
 
-        StringBuffer f;
-        f.println("#include \"shader_cache.h\"");
-        f.println("ShaderCacheEntry g_shaderCacheEntries[] = {{");
+// Measures how many shaders per second a single core recompiles to HLSL, without invoking DXC. The reused
+// translator is what the parallel path does, constructing a new one per shader is shown for comparison. The operand
+// emitter is picked at build time, so comparing it against the std::string one takes a build of each. The direct
+// SPIR-V translation is measured on top of the HLSL recompilation it depends on. Latencies are those of translating
+// a single shader on demand through the library, for the shaders that don't need DXC.
+static void benchmarkShaders(const std::vector<RecompiledShader*>& shaders, const std::string_view& include)
+{
+    if (shaders.empty())
+        return;
 
-        std::vector<uint8_t> dxil;
-        std::vector<uint8_t> spirv;
+    constexpr double BENCHMARK_SECONDS = 2.0;
 
-        for (auto& [hash, shader] : shaders)
+    auto measure = [&](auto&& recompile)
         {
-            f.println("\t{{ 0x{:X}, {}, {}, {}, {}, {} }},",
-                hash, dxil.size(), (shader.dxil != nullptr) ? shader.dxil->GetBufferSize() : 0, spirv.size(), shader.spirv.size(), shader.specConstantsMask);
+            size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed{};
 
-            if (shader.dxil != nullptr)
+            do
             {
-                dxil.insert(dxil.end(), reinterpret_cast<uint8_t *>(shader.dxil->GetBufferPointer()),
-                    reinterpret_cast<uint8_t *>(shader.dxil->GetBufferPointer()) + shader.dxil->GetBufferSize());
-            }
-            
-            spirv.insert(spirv.end(), shader.spirv.begin(), shader.spirv.end());
+                for (auto shader : shaders)
+                    recompile(*shader);
+
+                count += shaders.size();
+                elapsed = std::chrono::steady_clock::now() - start;
+            } while (elapsed.count() < BENCHMARK_SECONDS);
+
+            return count / elapsed.count();
+        };
+
+    ShaderTranslator translator;
+    std::vector<uint32_t> spirv;
+    double reused = measure([&](const RecompiledShader& shader)
+        {
+            translator.translate(shader.data, shader.size, include);
+        });
+
+    double constructed = measure([&](const RecompiledShader& shader)
+        {
+            ShaderRecompiler fresh;
+            fresh.recompile(shader.data, shader.size, include);
+        });
+
+    double directSpirv = measure([&](const RecompiledShader& shader)
+        {
+            translator.translate(shader.data, shader.size, include);
+            translator.recompiler.recompileSpirv(spirv);
+        });
+
+    // Every run is recorded, so the tail includes preemption and cache misses like on demand translation does. The
+    // runs go over all shaders in turn, rather than timing one shader back to back on a warm cache.
+    constexpr size_t LATENCY_RUNS = 5;
+
+    std::vector<double> hlslLatencies;
+    std::vector<double> spirvLatencies;
+    size_t spirvDirectCount = 0;
+
+    for (size_t i = 0; i < LATENCY_RUNS; i++)
+    {
+        for (auto shader : shaders)
+        {
+            auto start = std::chrono::steady_clock::now();
+            translator.translate(shader->data, shader->size, include);
+            auto translated = std::chrono::steady_clock::now();
+            bool isSpirvDirect = translator.recompiler.recompileSpirv(spirv);
+            auto end = std::chrono::steady_clock::now();
+
+            hlslLatencies.push_back(std::chrono::duration<double, std::micro>(translated - start).count());
+            if (isSpirvDirect)
+                spirvLatencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+            if (i == 0 && isSpirvDirect)
+                ++spirvDirectCount;
         }
+    }
+
+    auto printLatencies = [](const char* name, std::vector<double>& latencies)
+        {
+            if (latencies.empty())
+                return;
 
-        f.println("}};");
+            std::sort(latencies.begin(), latencies.end());
 
-        fmt::println("Compressing DXIL cache...");
+            auto percentile = [&](size_t percent) { return latencies[(latencies.size() - 1) * percent / 100]; };
+            fmt::println("  {}: {:.1f} us median, {:.1f} us p99, {:.1f} us max", name, percentile(50), percentile(99), latencies.back());
+        };
 
-        int level = ZSTD_maxCLevel();
+    fmt::println("Recompiled {} shaders to HLSL on a single core with the {} operand emitter:", shaders.size(), OPERAND_EMITTER_NAME);
+    fmt::println("  {:.0f} shaders/sec reusing the translator", reused);
+    fmt::println("  {:.0f} shaders/sec constructing a new recompiler per shader ({:.2f}x)", constructed, reused / constructed);
+    fmt::println("  {:.0f} shaders/sec also translating to SPIR-V directly, which supports {} of them", directSpirv, spirvDirectCount);
 
-#ifdef XENOS_RECOMP_DXIL
-        std::vector<uint8_t> dxilCompressed(ZSTD_compressBound(dxil.size()));
-        dxilCompressed.resize(ZSTD_compress(dxilCompressed.data(), dxilCompressed.size(), dxil.data(), dxil.size(), level));
+    fmt::println("Latency of translating a single shader over {} runs:", LATENCY_RUNS);
+    printLatencies("HLSL", hlslLatencies);
+    printLatencies("HLSL and direct SPIR-V", spirvLatencies);
+}
+
+// Validates recompiled shaders in parallel, signing the DXIL in place. SPIR-V is validated by invoking
+// spirv-val on the decoded modules if a path to it was provided. Shaders are passed with their hashes, as their
+// containers are gone by now. Returns the number of invalid shaders.
+static uint32_t validateShaders(const std::vector<std::pair<XXH64_hash_t, RecompiledShader*>>& shaders, const Options& options)
+{
+    std::atomic<uint32_t> progress = 0;
+    std::atomic<uint32_t> failures = 0;
 
-        f.print("const uint8_t g_compressedDxilCache[] = {{");
+    if (options.spirvVal == nullptr)
+        fmt::println("No spirv-val path was provided, skipping SPIR-V validation.");
 
-        for (auto data : dxilCompressed)
-            f.print("{},", data);
+    // Every module gets its own file, as identical modules can be validated concurrently by this or another run.
+    std::atomic<uint32_t> spirvIndex = 0;
+    auto spirvRunId = std::chrono::steady_clock::now().time_since_epoch().count();
 
-        f.println("}};");
-        f.println("const size_t g_dxilCacheCompressedSize = {};", dxilCompressed.size());
-        f.println("const size_t g_dxilCacheDecompressedSize = {};", dxil.size());
-#endif
+    std::for_each(std::execution::par_unseq, shaders.begin(), shaders.end(), [&](const auto& validated)
+        {
+            auto& [hash, shaderPtr] = validated;
+            auto& shader = *shaderPtr;
+            std::string errors;
+            bool valid = true;
 
-        fmt::println("Compressing SPIRV cache...");
+            // Shaders that failed to recompile were counted already.
+            if (!shader.isRecompiled())
+                return;
 
-        std::vector<uint8_t> spirvCompressed(ZSTD_compressBound(spirv.size()));
-        spirvCompressed.resize(ZSTD_compress(spirvCompressed.data(), spirvCompressed.size(), spirv.data(), spirv.size(), level));
+#ifdef XENOS_RECOMP_DXIL
+            thread_local DxcCompiler dxcCompiler;
+            valid = dxcCompiler.validate(shader.dxil, errors);
 
-        f.print("const uint8_t g_compressedSpirvCache[] = {{");
+            for (auto& variant : shader.variants)
+                valid &= dxcCompiler.validate(variant.dxil, errors);
 
-        for (auto data : spirvCompressed)
-            f.print("{},", data);
+            for (auto& linkedVariant : shader.linkedVariants)
+                valid &= dxcCompiler.validate(linkedVariant.dxil, errors);
+#endif
 
-        f.println("}};");
+            auto validateSpirv = [&](const std::vector<uint8_t>& smolvData)
+                {
+                    std::vector<uint8_t> spirv(smolv::GetDecodedBufferSize(smolvData.data(), smolvData.size()));
+                    bool result = smolv::Decode(smolvData.data(), smolvData.size(), spirv.data(), spirv.size());
+                    assert(result);
 
-        f.println("const size_t g_spirvCacheCompressedSize = {};", spirvCompressed.size());
-        f.println("const size_t g_spirvCacheDecompressedSize = {};", spirv.size());
-        f.println("const size_t g_shaderCacheEntryCount = {};", shaders.size());
+                    auto spirvPath = std::filesystem::temp_directory_path() / fmt::format("XenosRecomp_{:X}_{}.spv", spirvRunId, spirvIndex++);
+                    writeAllBytes(spirvPath.string().c_str(), spirv.data(), spirv.size());
 
-        writeAllBytes(output, f.out.data(), f.out.size());
-    }
-    else
-    {
-        ShaderRecompiler recompiler;
-        size_t fileSize;
-        recompiler.recompile(readAllBytes(input, fileSize).get(), include);
-        writeAllBytes(output, recompiler.out.data(), recompiler.out.size());
+                    std::string command = fmt::format("\"{}\" \"{}\"", options.spirvVal, spirvPath.string());
+#ifdef _WIN32
+                    // cmd /c strips the first and last quote of commands with more than two, so the whole command is quoted again.
+                    command = fmt::format("\"{}\"", command);
+#endif
+
+                    if (std::system(command.c_str()) != 0)
+                    {
+                        errors += "spirv-val failed.\n";
+                        valid = false;
+                    }
+
+                    std::error_code ec;
+                    std::filesystem::remove(spirvPath, ec);
+                };
+
+            if (options.spirvVal != nullptr)
+            {
+                validateSpirv(shader.spirv);
+
+                for (auto& variant : shader.variants)
+                {
+                    if (!variant.spirv.empty())
+                        validateSpirv(variant.spirv);
+                }
+
+                for (auto& linkedVariant : shader.linkedVariants)
+                    validateSpirv(linkedVariant.spirv);
+            }
+
+            if (!valid)
+            {
+                fmt::print(stderr, "{:X}: failed validation.\n{}", hash, errors);
+                ++failures;
+            }
+
+            size_t currentProgress = ++progress;
+            if ((currentProgress % 10) == 0 || (currentProgress == shaders.size() - 1))
+                fmt::println("Validating shaders... {}%", currentProgress / float(shaders.size()) * 100.0f);
+        });
+
+    return failures;
+}
+
+static void writeShaderCache(const char* output, const std::map<XXH64_hash_t, RecompiledShader>& shaders, const Options& options, int level)
+{
+    fmt::println("Creating shader cache...");
+
+    StringBuffer f;
+    f.println("#include \"shader_cache.h\"");
+    f.println("ShaderCacheEntry g_shaderCacheEntries[] = {{");
+
+    StringBuffer variants;
+    size_t variantCount = 0;
+
+    StringBuffer linkedVariants;
+    size_t linkedVariantCount = 0;
+
+    StringBuffer positionOnlyVariants;
+    size_t positionOnlyVariantCount = 0;
+
+    StringBuffer metadata;
+    StringBuffer vertexInputs;
+    size_t vertexInputCount = 0;
+
+    std::vector<uint8_t> dxil;
+    std::vector<uint8_t> spirv;
+
+    for (auto& [hash, shader] : shaders)
+    {
+        f.println("\t{{ 0x{:X}, {}, {}, {}, {}, {} }},",
+            hash, dxil.size(), shader.dxil.size(), spirv.size(), shader.spirv.size(), shader.specConstantsMask);
+
+        size_t entryDxilOffset = dxil.size();
+        size_t entrySpirvOffset = spirv.size();
+
+        dxil.insert(dxil.end(), shader.dxil.begin(), shader.dxil.end());
+        spirv.insert(spirv.end(), shader.spirv.begin(), shader.spirv.end());
+
+        auto& float4Constants = shader.metadata.float4Constants;
+        auto& textures = shader.metadata.textures;
+        metadata.println("\t{{ {{ 0x{:X}, 0x{:X}, 0x{:X}, 0x{:X} }}, 0x{:X}, {{ 0x{:X}, 0x{:X}, 0x{:X} }}, 0x{:X}, {}, {} }},",
+            float4Constants[0], float4Constants[1], float4Constants[2], float4Constants[3], shader.metadata.booleans,
+            textures[0], textures[1], textures[2], shader.metadata.interpolators, vertexInputCount, shader.vertexInputs.size());
+
+        for (auto& vertexInput : shader.vertexInputs)
+        {
+            vertexInputs.println("\t{{ {}, {}, {}, {} }},",
+                vertexInput.usage, vertexInput.usageIndex, vertexInput.location, vertexInput.isUint);
+        }
+
+        vertexInputCount += shader.vertexInputs.size();
+
+        for (auto& variant : shader.variants)
+        {
+            variants.println("\t{{ 0x{:X}, {}, {}, {}, {}, {} }},",
+                hash, variant.specConstants, dxil.size(), variant.dxil.size(), spirv.size(), variant.spirv.size());
+
+            dxil.insert(dxil.end(), variant.dxil.begin(), variant.dxil.end());
+            spirv.insert(spirv.end(), variant.spirv.begin(), variant.spirv.end());
+            ++variantCount;
+        }
+
+        // Pixel shaders reading the same interpolators share a linked variant.
+        size_t linkedDxilOffset = dxil.size();
+        size_t linkedSpirvOffset = spirv.size();
+
+        for (auto& linkedVariant : shader.linkedVariants)
+        {
+            dxil.insert(dxil.end(), linkedVariant.dxil.begin(), linkedVariant.dxil.end());
+            spirv.insert(spirv.end(), linkedVariant.spirv.begin(), linkedVariant.spirv.end());
+        }
+
+        auto findLinkedVariant = [&](uint32_t interpolators, size_t& dxilOffset, size_t& spirvOffset) -> const LinkedVariant*
+            {
+                dxilOffset = linkedDxilOffset;
+                spirvOffset = linkedSpirvOffset;
+
+                for (auto& linkedVariant : shader.linkedVariants)
+                {
+                    if (linkedVariant.interpolators == interpolators)
+                        return &linkedVariant;
+
+                    dxilOffset += linkedVariant.dxil.size();
+                    spirvOffset += linkedVariant.spirv.size();
+                }
+
+                return nullptr;
+            };
+
+        auto pair = std::lower_bound(options.linkPairs.begin(), options.linkPairs.end(), std::make_pair(hash, XXH64_hash_t(0)));
+        for (; pair != options.linkPairs.end() && pair->first == hash; ++pair)
+        {
+            auto findResult = shaders.find(pair->second);
+            if (findResult == shaders.end() || !findResult->second.isPixelShader)
+                continue;
+
+            uint32_t interpolators = shader.metadata.interpolators & findResult->second.metadata.interpolators;
+            size_t dxilOffset;
+            size_t spirvOffset;
+
+            auto linkedVariant = findLinkedVariant(interpolators, dxilOffset, spirvOffset);
+            if (linkedVariant != nullptr)
+            {
+                linkedVariants.println("\t{{ 0x{:X}, 0x{:X}, {}, {}, {}, {} }},",
+                    hash, pair->second, dxilOffset, linkedVariant->dxil.size(), spirvOffset, linkedVariant->spirv.size());
+
+                ++linkedVariantCount;
+            }
+        }
+
+        if (options.positionOnly && !shader.isPixelShader)
+        {
+            size_t dxilOffset;
+            size_t spirvOffset;
+
+            auto linkedVariant = findLinkedVariant(0, dxilOffset, spirvOffset);
+            if (linkedVariant != nullptr)
+            {
+                positionOnlyVariants.println("\t{{ 0x{:X}, {}, {}, {}, {} }},",
+                    hash, dxilOffset, linkedVariant->dxil.size(), spirvOffset, linkedVariant->spirv.size());
+            }
+            else
+            {
+                // Vertex shaders without interpolators are position-only already.
+                positionOnlyVariants.println("\t{{ 0x{:X}, {}, {}, {}, {} }},",
+                    hash, entryDxilOffset, shader.dxil.size(), entrySpirvOffset, shader.spirv.size());
+            }
+
+            ++positionOnlyVariantCount;
+        }
+    }
+
+    f.println("}};");
+
+    // Sorted by hash and then by mask. Arrays can't be empty, so a zero entry is emitted in that case.
+    f.println("ShaderCacheVariant g_shaderCacheVariants[] = {{");
+    f.print("{}", variants.out);
+
+    if (variantCount == 0)
+        f.println("\t{{ 0, 0, 0, 0, 0, 0 }},");
+
+    f.println("}};");
+    f.println("const size_t g_shaderCacheVariantCount = {};", variantCount);
+
+    // Sorted by vertex shader hash and then by pixel shader hash, pairs without anything to remove are left out.
+    f.println("ShaderCacheLinkedVariant g_shaderCacheLinkedVariants[] = {{");
+    f.print("{}", linkedVariants.out);
+
+    if (linkedVariantCount == 0)
+        f.println("\t{{ 0, 0, 0, 0, 0, 0 }},");
+
+    f.println("}};");
+    f.println("const size_t g_shaderCacheLinkedVariantCount = {};", linkedVariantCount);
+
+    // Sorted by hash, with an entry for every vertex shader when position-only variants are enabled.
+    f.println("ShaderCachePositionOnlyVariant g_shaderCachePositionOnlyVariants[] = {{");
+    f.print("{}", positionOnlyVariants.out);
+
+    if (positionOnlyVariantCount == 0)
+        f.println("\t{{ 0, 0, 0, 0, 0 }},");
+
+    f.println("}};");
+    f.println("const size_t g_shaderCachePositionOnlyVariantCount = {};", positionOnlyVariantCount);
+
+    // Parallel to the entries.
+    f.println("ShaderCacheMetadata g_shaderCacheMetadata[] = {{");
+    f.print("{}", metadata.out);
+    f.println("}};");
+
+    // Referenced by the metadata, pixel shaders have none.
+    f.println("ShaderCacheVertexInput g_shaderCacheVertexInputs[] = {{");
+    f.print("{}", vertexInputs.out);
+
+    if (vertexInputCount == 0)
+        f.println("\t{{ 0, 0, 0, 0 }},");
+
+    f.println("}};");
+
+    fmt::println("Compressing DXIL cache...");
+
+#ifdef XENOS_RECOMP_DXIL
+    std::vector<uint8_t> dxilCompressed(ZSTD_compressBound(dxil.size()));
+    dxilCompressed.resize(ZSTD_compress(dxilCompressed.data(), dxilCompressed.size(), dxil.data(), dxil.size(), level));
+
+    f.print("const uint8_t g_compressedDxilCache[] = {{");
+
+    for (auto data : dxilCompressed)
+        f.print("{},", data);
+
+    f.println("}};");
+    f.println("const size_t g_dxilCacheCompressedSize = {};", dxilCompressed.size());
+    f.println("const size_t g_dxilCacheDecompressedSize = {};", dxil.size());
+#endif
+
+    fmt::println("Compressing SPIRV cache...");
+
+    std::vector<uint8_t> spirvCompressed(ZSTD_compressBound(spirv.size()));
+    spirvCompressed.resize(ZSTD_compress(spirvCompressed.data(), spirvCompressed.size(), spirv.data(), spirv.size(), level));
+
+    f.print("const uint8_t g_compressedSpirvCache[] = {{");
+
+    for (auto data : spirvCompressed)
+        f.print("{},", data);
+
+    f.println("}};");
+
+    f.println("const size_t g_spirvCacheCompressedSize = {};", spirvCompressed.size());
+    f.println("const size_t g_spirvCacheDecompressedSize = {};", spirv.size());
+    f.println("const size_t g_shaderCacheEntryCount = {};", shaders.size());
+
+    writeAllBytes(output, f.out.data(), f.out.size());
+}
+
+#ifdef __linux__
+
+// Keeps the shader cache up to date by rescanning only the files inotify reports as changed. Shaders
+// that were already recompiled are kept in memory, and the output is rewritten only when the entry set changes.
+static void watchDirectory(const char* input, const char* output, const std::string_view& include, const Options& options,
+    XXH64_hash_t manifestKey, std::map<XXH64_hash_t, RecompiledShader>& shaders, std::map<std::filesystem::path, ScannedFile>& files)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+    {
+        fmt::println("Failed to initialize inotify.");
+        return;
+    }
+
+    constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+    std::unordered_map<int, std::filesystem::path> watchDescriptors;
+    std::set<std::filesystem::path> changedFiles;
+    std::set<std::filesystem::path> removedFiles;
+    bool validationFailed = false;
+
+    auto addWatch = [&](const std::filesystem::path& directoryPath, bool scanFiles)
+        {
+            int wd = inotify_add_watch(fd, directoryPath.c_str(), WATCH_MASK);
+            if (wd >= 0)
+                watchDescriptors[wd] = directoryPath;
+
+            std::error_code ec;
+            for (auto& file : std::filesystem::recursive_directory_iterator(directoryPath, ec))
+            {
+                if (std::filesystem::is_directory(file))
+                {
+                    wd = inotify_add_watch(fd, file.path().c_str(), WATCH_MASK);
+                    if (wd >= 0)
+                        watchDescriptors[wd] = file.path();
+                }
+                else if (scanFiles)
+                {
+                    changedFiles.insert(file.path());
+                }
+            }
+        };
+
+    addWatch(input, false);
+
+    fmt::println("Watching {} for changes...", input);
+
+    while (true)
+    {
+        // Block until the first event, then coalesce the ones that arrive shortly after,
+        // since copying an archive usually produces a burst of events.
+        pollfd pollFd{ fd, POLLIN, 0 };
+        int timeout = -1;
+
+        while (poll(&pollFd, 1, timeout) > 0)
+        {
+            alignas(inotify_event) char buffer[16384];
+            ssize_t size = read(fd, buffer, sizeof(buffer));
+            if (size <= 0)
+                break;
+
+            for (ssize_t i = 0; i < size;)
+            {
+                auto event = reinterpret_cast<const inotify_event*>(buffer + i);
+                i += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    watchDescriptors.erase(event->wd);
+                    continue;
+                }
+
+                auto findResult = watchDescriptors.find(event->wd);
+                if (findResult == watchDescriptors.end() || event->len == 0)
+                    continue;
+
+                std::filesystem::path path = findResult->second / event->name;
+
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        addWatch(path, true);
+                    }
+                    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    {
+                        std::string prefix = (path / "").string();
+                        for (auto& [filePath, scannedFile] : files)
+                        {
+                            if (filePath.string().compare(0, prefix.size(), prefix) == 0)
+                            {
+                                changedFiles.erase(filePath);
+                                removedFiles.insert(filePath);
+                            }
+                        }
+                    }
+                }
+                else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                {
+                    removedFiles.erase(path);
+                    changedFiles.insert(path);
+                }
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                {
+                    changedFiles.erase(path);
+                    removedFiles.insert(path);
+                }
+            }
+
+            timeout = 100;
+        }
+
+        if (changedFiles.empty() && removedFiles.empty())
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::unique_ptr<uint8_t[]>> fileDatas;
+
+        for (auto& filePath : removedFiles)
+        {
+            auto findResult = files.find(filePath);
+            if (findResult != files.end())
+            {
+                releaseShaders(shaders, findResult->second);
+                files.erase(findResult);
+            }
+        }
+
+        for (auto& filePath : changedFiles)
+        {
+            // Scan before releasing the previous containers, so the shaders that didn't change don't get dropped and recompiled.
+            ScannedFile scannedFile;
+            auto findResult = files.find(filePath);
+            auto fileData = scanFile(filePath, scannedFile, findResult != files.end() ? &findResult->second : nullptr, shaders, true);
+            if (fileData != nullptr)
+                fileDatas.emplace_back(std::move(fileData));
+
+            if (findResult != files.end())
+            {
+                releaseShaders(shaders, findResult->second);
+                findResult->second = std::move(scannedFile);
+            }
+            else
+            {
+                files.emplace(filePath, std::move(scannedFile));
+            }
+        }
+
+        bool entriesChanged = removeUnreferencedShaders(shaders);
+        resetStaleLinks(shaders, options);
+
+        // Shaders that failed to recompile last time are retried, which needs their containers again. So are vertex
+        // shaders that were reset to be linked again.
+        loadSkippedContainers(files, shaders, fileDatas);
+        auto pending = getPendingShaders(shaders);
+
+        fmt::println("{} file(s) changed, {} file(s) removed, {} new shader(s).", changedFiles.size(), removedFiles.size(), pending.size());
+
+        changedFiles.clear();
+        removedFiles.clear();
+
+        uint32_t failures = 0;
+        if (!pending.empty())
+        {
+            failures = recompileShaders(pending, include, options);
+            failures += linkShaders(shaders, include, options);
+            entriesChanged = true;
+        }
+
+        fileDatas.clear();
+
+        if (options.validate && entriesChanged)
+        {
+            // Invalid shaders stay in the map, so after a failure everything is validated again until it passes.
+            std::set<RecompiledShader*> recompiled(pending.begin(), pending.end());
+            std::vector<std::pair<XXH64_hash_t, RecompiledShader*>> validated;
+            for (auto& [hash, shader] : shaders)
+            {
+                if (validationFailed || recompiled.find(&shader) != recompiled.end())
+                    validated.emplace_back(hash, &shader);
+            }
+
+            failures += validateShaders(validated, options);
+        }
+
+        if (entriesChanged)
+        {
+            validationFailed = failures != 0;
+
+            if (validationFailed)
+                fmt::println("{} shaders failed to recompile or validate, keeping the previous shader cache.", failures);
+        }
+
+        if (entriesChanged && !validationFailed)
+        {
+            writeShaderCache(output, shaders, options, ZSTD_CLEVEL_DEFAULT);
+
+            if (options.manifest != nullptr)
+                ShaderManifest::save(options.manifest, manifestKey, files, shaders);
+
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            fmt::println("Regenerated shader cache with {} entries in {} ms.", shaders.size(), duration.count());
+        }
+        else if (!entriesChanged)
+        {
+            fmt::println("Shader cache entries did not change.");
+        }
+    }
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<const char*> positionalArgs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--watch") == 0)
+            options.watch = true;
+        else if (strcmp(argv[i], "--validate") == 0)
+            options.validate = true;
+        else if (strcmp(argv[i], "--manifest") == 0 && (i + 1) < argc)
+            options.manifest = argv[++i];
+        else if (strcmp(argv[i], "--spirv-val") == 0 && (i + 1) < argc)
+            options.spirvVal = argv[++i];
+        else if (strcmp(argv[i], "--spirv-variants") == 0)
+            options.spirvVariants = true;
+        else if (strcmp(argv[i], "--spec-powerset") == 0)
+            options.specPowerset = true;
+        else if (strcmp(argv[i], "--spec-masks") == 0 && (i + 1) < argc)
+        {
+            char* mask = argv[++i];
+            do
+            {
+                options.specMasks.push_back(strtoul(mask, &mask, 0));
+            } while (*mask++ == ',');
+        }
+        else if (strcmp(argv[i], "--direct-spirv") == 0)
+            options.directSpirv = true;
+        else if (strcmp(argv[i], "--benchmark") == 0)
+            options.benchmark = true;
+        else if (strcmp(argv[i], "--link-pairs") == 0 && (i + 1) < argc)
+        {
+            if (!readLinkPairs(argv[++i], options.linkPairs))
+                return 1;
+        }
+        else if (strcmp(argv[i], "--position-only") == 0)
+            options.positionOnly = true;
+        else if (strcmp(argv[i], "--profile") == 0 && (i + 1) < argc)
+        {
+            const char* profile = argv[++i];
+            if (strcmp(profile, "release") == 0)
+            {
+                options.profile = DxcProfile::Release;
+            }
+            else if (strcmp(profile, "iteration") == 0)
+            {
+                options.profile = DxcProfile::Iteration;
+            }
+            else
+            {
+                fmt::println("Unknown profile {}, expected release or iteration.", profile);
+                return 1;
+            }
+        }
+        else
+            positionalArgs.push_back(argv[i]);
+    }
+
+#ifndef XENOS_RECOMP_INPUT
+    if (positionalArgs.size() < 3)
+    {
+        printf("Usage: XenosRecomp [input path] [output path] [shader common header file path] [--watch] [--manifest path] [--profile release|iteration] [--validate] [--spirv-val path] [--spec-masks mask,...] [--spec-powerset] [--spirv-variants] [--direct-spirv] [--link-pairs path] [--position-only] [--benchmark]");
+        return 0;
+    }
+#endif
+
+    const char* input =
+#ifdef XENOS_RECOMP_INPUT
+        XENOS_RECOMP_INPUT
+#else
+        positionalArgs[0]
+#endif
+    ;
+
+    const char* output =
+#ifdef XENOS_RECOMP_OUTPUT
+        XENOS_RECOMP_OUTPUT
+#else
+        positionalArgs[1]
+#endif
+        ;
+
+    const char* includeInput =
+#ifdef XENOS_RECOMP_INCLUDE_INPUT
+        XENOS_RECOMP_INCLUDE_INPUT
+#else
+        positionalArgs[2]
+#endif
+        ;
+
+    size_t includeSize = 0;
+    auto includeData = readAllBytes(includeInput, includeSize);
+    std::string_view include(reinterpret_cast<const char*>(includeData.get()), includeSize);
+
+    if (std::filesystem::is_directory(input))
+    {
+        // Benchmarks measure every shader, so previous results are not loaded.
+        XXH64_hash_t manifestKey = getManifestKey(include, options);
+        ShaderManifest manifest;
+        if (options.manifest != nullptr && !options.benchmark && manifest.load(options.manifest, manifestKey, options.profile))
+            fmt::println("Loaded manifest with {} files and {} shaders.", manifest.files.size(), manifest.shaders.size());
+
+        // Shaders whose variants don't match the requested masks need to be recompiled.
+        for (auto& [hash, shader] : manifest.shaders)
+        {
+            std::vector<uint32_t> masks = getVariantMasks(shader.specConstantsMask, options);
+            bool matches = masks.size() == shader.variants.size();
+
+            for (size_t i = 0; matches && i < masks.size(); i++)
+                matches = masks[i] == shader.variants[i].specConstants && shader.variants[i].spirv.empty() != options.spirvVariants;
+
+            if (!matches)
+                shader = {};
+        }
+
+        std::vector<std::unique_ptr<uint8_t[]>> fileDatas;
+        std::map<std::filesystem::path, ScannedFile> files;
+        std::map<XXH64_hash_t, RecompiledShader> shaders = std::move(manifest.shaders);
+
+        for (auto& file : std::filesystem::recursive_directory_iterator(input))
+        {
+            if (std::filesystem::is_directory(file))
+            {
+                continue;
+            }
+
+            auto findResult = manifest.files.find(file.path());
+            auto& scannedFile = files[file.path()];
+
+            auto fileData = scanFile(file.path(), scannedFile, findResult != manifest.files.end() ? &findResult->second : nullptr, shaders);
+            if (fileData != nullptr)
+                fileDatas.emplace_back(std::move(fileData));
+        }
+
+        removeUnreferencedShaders(shaders);
+        resetStaleLinks(shaders, options);
+        loadSkippedContainers(files, shaders, fileDatas);
+        removeUnreferencedShaders(shaders);
+
+        auto pending = getPendingShaders(shaders);
+        fmt::println("Found {} shaders, {} need to be recompiled.", shaders.size(), pending.size());
+
+        if (options.benchmark)
+        {
+            benchmarkShaders(pending, include);
+            return 0;
+        }
+
+        uint32_t failures = recompileShaders(pending, include, options);
+        failures += linkShaders(shaders, include, options);
+        fileDatas.clear();
+
+        if (options.validate)
+        {
+            std::vector<std::pair<XXH64_hash_t, RecompiledShader*>> recompiled;
+            for (auto& [hash, shader] : shaders)
+                recompiled.emplace_back(hash, &shader);
+
+            failures += validateShaders(recompiled, options);
+        }
+
+        // Failed shaders would be stored as up to date otherwise, and skipped by runs that don't validate.
+        if (failures != 0)
+        {
+            fmt::println("{} shaders failed to recompile or validate.", failures);
+            return 1;
+        }
+
+        if (options.manifest != nullptr)
+            ShaderManifest::save(options.manifest, manifestKey, files, shaders);
+
+#ifdef __linux__
+        writeShaderCache(output, shaders, options, options.watch ? ZSTD_CLEVEL_DEFAULT : ZSTD_maxCLevel());
+
+        if (options.watch)
+            watchDirectory(input, output, include, options, manifestKey, shaders, files);
+#else
+        if (options.watch)
+            fmt::println("Watch mode is only supported on Linux.");
+
+        writeShaderCache(output, shaders, options, ZSTD_maxCLevel());
+#endif
+    }
+    else
+    {
+        ShaderTranslator translator;
+        size_t fileSize;
+        auto fileData = readAllBytes(input, fileSize);
+        if (!translator.translate(fileData.get(), fileSize, include))
+        {
+            fmt::println("{} is not a valid shader container.", input);
+            return 1;
+        }
+
+        writeAllBytes(output, translator.recompiler.out.data(), translator.recompiler.out.size());
     }
 
     return 0;
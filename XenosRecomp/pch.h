@@ -4,16 +4,35 @@
 #include <Windows.h>
 #endif
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 #include <dxcapi.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#endif
+
 #include <bit>
+#include <bitset>
 #include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <execution>
 #include <filesystem>
 #include <map>
+#include <optional>
+#include <set>
 #include <smolv.h>
 #include <fmt/core.h>
+#include <fmt/format.h>
 #include <string>
 #include <unordered_map>
 #include <xxhash.h>
@@ -31,9 +31,13 @@ struct PushConstants
 #define g_HalfPixelOffset          vk::RawBufferLoad<float2>(g_PushConstants.SharedConstants + 264)
 #define g_AlphaThreshold           vk::RawBufferLoad<float>(g_PushConstants.SharedConstants + 272)
 
+#ifdef SPEC_CONSTANTS_VALUE
+#define g_SpecConstants() (SPEC_CONSTANTS_VALUE)
+#else
 [[vk::constant_id(0)]] const uint g_SpecConstants = 0;
 
 #define g_SpecConstants() g_SpecConstants
+#endif
 
 #else
 
@@ -43,7 +47,11 @@ struct PushConstants
     float2 g_HalfPixelOffset : packoffset(c16.z); \
     float g_AlphaThreshold : packoffset(c17.x);
 
+#ifdef SPEC_CONSTANTS_VALUE
+#define g_SpecConstants() (SPEC_CONSTANTS_VALUE)
+#else
 uint g_SpecConstants();
+#endif
 
 #endif
 
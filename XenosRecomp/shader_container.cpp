@@ -0,0 +1,190 @@
+#include "shader_container.h"
+
+bool ParsedShaderContainer::parse(const uint8_t* data, size_t dataSize)
+{
+    isPixelShader = false;
+    for (auto& registerSetConstants : constants)
+        registerSetConstants.clear();
+
+    hasDefinitionTable = false;
+    float4Definitions.clear();
+    int4Definitions.clear();
+    code = nullptr;
+    codeSize = 0;
+    vertexElements.clear();
+    interpolators.clear();
+    svPosRegister = 0;
+    pixelShaderOutputs = 0;
+
+    auto contains = [&](uint64_t offset, uint64_t size)
+        {
+            return offset <= dataSize && size <= dataSize - offset;
+        };
+
+    if (!contains(0, sizeof(ShaderContainer)))
+        return false;
+
+    auto shaderContainer = reinterpret_cast<const ShaderContainer*>(data);
+    if ((shaderContainer->flags & 0xFFFFFF00) != 0x102A1100)
+        return false;
+
+    uint64_t virtualSize = shaderContainer->virtualSize;
+    if (!contains(0, virtualSize + shaderContainer->physicalSize))
+        return false;
+
+    isPixelShader = (shaderContainer->flags & 0x1) == 0;
+
+    uint64_t constantTableOffset = shaderContainer->constantTableOffset;
+    if (constantTableOffset == 0 || !contains(constantTableOffset, sizeof(ConstantTableContainer)))
+        return false;
+
+    // Offsets in the constant table are relative to the table itself, after the size of the container.
+    auto& constantTable = reinterpret_cast<const ConstantTableContainer*>(data + constantTableOffset)->constantTable;
+    uint64_t constantTableBase = constantTableOffset + offsetof(ConstantTableContainer, constantTable);
+    uint64_t constantInfoOffset = constantTableBase + constantTable.constantInfo;
+    uint32_t constantCount = constantTable.constants;
+
+    if (!contains(constantInfoOffset, uint64_t(constantCount) * sizeof(ConstantInfo)))
+        return false;
+
+    for (uint32_t i = 0; i < constantCount; i++)
+    {
+        auto constantInfo = reinterpret_cast<const ConstantInfo*>(data + constantInfoOffset + i * sizeof(ConstantInfo));
+
+        uint64_t nameOffset = constantTableBase + constantInfo->name;
+        if (nameOffset >= dataSize || memchr(data + nameOffset, '\0', dataSize - nameOffset) == nullptr)
+            return false;
+
+        uint32_t registerSet = uint32_t(constantInfo->registerSet.get());
+        if (registerSet >= std::size(constants))
+            return false;
+
+        auto& constant = constants[registerSet].emplace_back();
+        constant.name = reinterpret_cast<const char*>(data + nameOffset);
+        constant.registerIndex = constantInfo->registerIndex;
+        constant.registerCount = constantInfo->registerCount;
+    }
+
+    uint64_t definitionTableOffset = shaderContainer->definitionTableOffset;
+    if (definitionTableOffset != 0)
+    {
+        hasDefinitionTable = true;
+
+        // Float4, int4 and bool definitions follow each other, separated by null terminators. Bools are not used.
+        uint64_t offset = definitionTableOffset + offsetof(DefinitionTable, definitions);
+
+        auto isTerminator = [&]()
+            {
+                return contains(offset, sizeof(uint32_t)) && *reinterpret_cast<const be<uint32_t>*>(data + offset) == 0;
+            };
+
+        while (!isTerminator())
+        {
+            if (!contains(offset, sizeof(Float4Definition)))
+                return false;
+
+            auto definition = reinterpret_cast<const Float4Definition*>(data + offset);
+            uint64_t valueOffset = virtualSize + definition->physicalOffset;
+            if (!contains(valueOffset, (definition->count + 3) / 4 * 16ull))
+                return false;
+
+            auto& parsedDefinition = float4Definitions.emplace_back();
+            parsedDefinition.registerIndex = definition->registerIndex;
+            parsedDefinition.count = definition->count;
+            parsedDefinition.values = reinterpret_cast<const be<uint32_t>*>(data + valueOffset);
+
+            offset += sizeof(Float4Definition);
+        }
+
+        offset += sizeof(uint32_t);
+
+        while (!isTerminator())
+        {
+            if (!contains(offset, sizeof(Int4Definition)))
+                return false;
+
+            // Each definition is followed by its values and a padding word.
+            auto definition = reinterpret_cast<const Int4Definition*>(data + offset);
+            uint64_t definitionSize = sizeof(Int4Definition) + sizeof(uint32_t) + definition->count * 4ull;
+            if (!contains(offset, definitionSize))
+                return false;
+
+            auto& parsedDefinition = int4Definitions.emplace_back();
+            parsedDefinition.registerIndex = definition->registerIndex;
+            parsedDefinition.count = definition->count;
+            parsedDefinition.values = definition->values;
+
+            offset += definitionSize;
+        }
+    }
+
+    uint64_t shaderOffset = shaderContainer->shaderOffset;
+    uint64_t shaderHeaderSize = isPixelShader ? sizeof(PixelShader) : sizeof(VertexShader);
+    if (!contains(shaderOffset, shaderHeaderSize))
+        return false;
+
+    auto shader = reinterpret_cast<const Shader*>(data + shaderOffset);
+    uint64_t codeOffset = virtualSize + shader->physicalOffset;
+    if (!contains(codeOffset, shader->size))
+        return false;
+
+    code = reinterpret_cast<const be<uint32_t>*>(data + codeOffset);
+    codeSize = shader->size;
+    svPosRegister = (shader->fieldC >> 8) & 0xFF;
+
+    uint32_t interpolatorCount = (shader->interpolatorInfo >> 5) & 0x1F;
+    const be<uint32_t>* interpolatorValues = nullptr;
+
+    if (isPixelShader)
+    {
+        auto pixelShader = reinterpret_cast<const PixelShader*>(shader);
+        if (!contains(shaderOffset + shaderHeaderSize, interpolatorCount * 4ull))
+            return false;
+
+        pixelShaderOutputs = pixelShader->outputs.get();
+        interpolatorValues = pixelShader->interpolators;
+    }
+    else
+    {
+        auto vertexShader = reinterpret_cast<const VertexShader*>(shader);
+        uint64_t vertexElementOffset = vertexShader->field18;
+        uint32_t vertexElementCount = vertexShader->vertexElementCount;
+
+        if (!contains(shaderOffset + shaderHeaderSize, (vertexElementOffset + vertexElementCount + interpolatorCount) * 4))
+            return false;
+
+        for (uint32_t i = 0; i < vertexElementCount; i++)
+        {
+            union
+            {
+                VertexElement vertexElement;
+                uint32_t value;
+            };
+
+            value = vertexShader->vertexElementsAndInterpolators[vertexElementOffset + i];
+            if (vertexElement.usage > DeclUsage::Sample)
+                return false;
+
+            vertexElements.push_back(vertexElement);
+        }
+
+        interpolatorValues = vertexShader->vertexElementsAndInterpolators + vertexElementOffset + vertexElementCount;
+    }
+
+    for (uint32_t i = 0; i < interpolatorCount; i++)
+    {
+        union
+        {
+            Interpolator interpolator;
+            uint32_t value;
+        };
+
+        value = interpolatorValues[i];
+        if (interpolator.usage > DeclUsage::Sample)
+            return false;
+
+        interpolators.push_back(interpolator);
+    }
+
+    return true;
+}
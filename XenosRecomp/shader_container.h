@@ -0,0 +1,51 @@
+#pragma once
+
+#include "shader.h"
+
+// Constant table entry with its fields decoded. The name points into the container data.
+struct ParsedConstant
+{
+    const char* name = nullptr;
+    uint16_t registerIndex = 0;
+    uint16_t registerCount = 0;
+};
+
+// Literal constants defined by the shader. Float4 definitions count components, int4 definitions count registers.
+// Values point into the container data and stay big endian.
+struct ParsedDefinition
+{
+    uint16_t registerIndex = 0;
+    uint16_t count = 0;
+    const be<uint32_t>* values = nullptr;
+};
+
+// Shader container validated against its size in a single pass, with everything the recompiler reads decoded to
+// native endian. Nothing is copied besides the decoded fields, so the container data must outlive it.
+struct ParsedShaderContainer
+{
+    bool isPixelShader = false;
+
+    // Indexed by RegisterSet, in constant table order.
+    std::vector<ParsedConstant> constants[4];
+
+    bool hasDefinitionTable = false;
+    std::vector<ParsedDefinition> float4Definitions;
+    std::vector<ParsedDefinition> int4Definitions;
+
+    const be<uint32_t>* code = nullptr;
+    uint32_t codeSize = 0;
+
+    std::vector<VertexElement> vertexElements;
+    std::vector<Interpolator> interpolators;
+    uint32_t svPosRegister = 0;
+    uint32_t pixelShaderOutputs = 0;
+
+    const std::vector<ParsedConstant>& getConstants(RegisterSet registerSet) const
+    {
+        return constants[uint32_t(registerSet)];
+    }
+
+    // Returns false if the data is not a shader container, or if anything it references lies outside of it.
+    // The vectors keep their capacity between calls.
+    bool parse(const uint8_t* data, size_t dataSize);
+};
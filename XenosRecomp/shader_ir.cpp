@@ -0,0 +1,2863 @@
+#include "shader_ir.h"
+
+static void addRead(IrInstruction& instr, const IrOperand& operand)
+{
+    if (operand.isLiteral)
+        return;
+
+    if (operand.isConstant)
+    {
+        if (operand.addressing == IrAddressing::A0)
+            instr.stateReads |= IR_STATE_A0;
+        else if (operand.addressing == IrAddressing::AL)
+            instr.stateReads |= IR_STATE_AL;
+    }
+    else
+    {
+        assert(instr.readCount < std::size(instr.reads));
+        instr.reads[instr.readCount++] = { operand.reg, uint8_t(operand.componentMask()) };
+    }
+}
+
+static void addWrite(IrInstruction& instr, uint8_t reg, uint8_t mask)
+{
+    if (mask != 0)
+    {
+        assert(instr.writeCount < std::size(instr.writes));
+        instr.writes[instr.writeCount++] = { reg, mask };
+    }
+}
+
+static uint8_t getFetchWriteMask(uint32_t dstSwizzle)
+{
+    uint8_t mask = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        if (FetchDestinationSwizzle((dstSwizzle >> (i * 3)) & 0x7) <= FetchDestinationSwizzle::One)
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+static void computeAluAccesses(IrInstruction& instr)
+{
+    auto& alu = instr.alu;
+
+    instr.readCount = 0;
+    instr.writeCount = 0;
+    instr.stateReads = 0;
+    instr.stateWrites = 0;
+
+    if (instr.isPredicated)
+        instr.stateReads |= IR_STATE_P0;
+
+    if (alu.vectorOpcode == AluVectorOpcode::Cube)
+    {
+        if (!alu.vectorSources[0].isConstant)
+            instr.reads[instr.readCount++] = { alu.vectorSources[0].reg, 0b1111 };
+    }
+    else
+    {
+        for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+            addRead(instr, alu.vectorSources[i]);
+    }
+
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+        addRead(instr, alu.scalarSources[i]);
+
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::AddsPrev:
+    case AluScalarOpcode::MulsPrev:
+    case AluScalarOpcode::MulsPrev2:
+    case AluScalarOpcode::SubsPrev:
+        instr.stateReads |= IR_STATE_PS;
+        break;
+    case AluScalarOpcode::RetainPrev:
+        if (alu.scalarWriteMask != 0)
+            instr.stateReads |= IR_STATE_PS;
+        break;
+    }
+
+    if (alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::SetpGePush)
+        instr.stateWrites |= IR_STATE_P0;
+    else if (alu.vectorOpcode >= AluVectorOpcode::MaxA)
+        instr.stateWrites |= IR_STATE_A0;
+
+    if (alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+    {
+        instr.stateWrites |= IR_STATE_PS;
+
+        if (alu.scalarOpcode >= AluScalarOpcode::SetpEq && alu.scalarOpcode <= AluScalarOpcode::SetpRstr)
+            instr.stateWrites |= IR_STATE_P0;
+        else if (alu.scalarOpcode == AluScalarOpcode::MaxAs || alu.scalarOpcode == AluScalarOpcode::MaxAsf)
+            instr.stateWrites |= IR_STATE_A0;
+    }
+
+    if (!alu.exportData)
+    {
+        addWrite(instr, alu.vectorDest, alu.vectorWriteMask);
+        addWrite(instr, alu.scalarDest, alu.scalarWriteMask);
+    }
+}
+
+static void decodeAlu(IrInstruction& instr, const AluInstruction& alu)
+{
+    auto& ir = instr.alu;
+
+    ir.vectorOpcode = alu.vectorOpcode;
+    ir.scalarOpcode = alu.scalarOpcode;
+    ir.vectorSaturate = alu.vectorSaturate;
+    ir.scalarSaturate = alu.scalarSaturate;
+    ir.vectorDest = alu.vectorDest;
+    ir.scalarDest = alu.scalarDest;
+    ir.exportData = alu.exportData;
+
+    instr.isPredicated = alu.isPredicated;
+    instr.predicateCondition = alu.predicateCondition;
+
+    IrAddressing constAddressing = IrAddressing::Absolute;
+    if (alu.const0Relative)
+        constAddressing = alu.constAddressRegisterRelative ? IrAddressing::A0 : IrAddressing::AL;
+
+    auto decodeOperand = [&](IrOperand& operand, uint32_t reg, bool select, bool negate)
+        {
+            operand.isConstant = !select;
+            operand.negate = negate;
+
+            if (select)
+            {
+                operand.abs = (reg & 0x80) != 0;
+                operand.reg = reg & 0x3F;
+            }
+            else
+            {
+                operand.abs = alu.absConstants;
+                operand.reg = reg;
+                operand.addressing = constAddressing;
+            }
+        };
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Frc:
+    case AluVectorOpcode::Trunc:
+    case AluVectorOpcode::Floor:
+    case AluVectorOpcode::Cube:
+    case AluVectorOpcode::Max4:
+        ir.vectorSourceCount = 1;
+        break;
+    case AluVectorOpcode::Mad:
+    case AluVectorOpcode::CndEq:
+    case AluVectorOpcode::CndGe:
+    case AluVectorOpcode::CndGt:
+    case AluVectorOpcode::Dp2Add:
+        ir.vectorSourceCount = 3;
+        break;
+    default:
+        ir.vectorSourceCount = 2;
+        break;
+    }
+
+    const uint32_t vectorRegisters[] = { alu.src1Register, alu.src2Register, alu.src3Register };
+    const uint32_t vectorSwizzles[] = { alu.src1Swizzle, alu.src2Swizzle, alu.src3Swizzle };
+    const bool vectorSelects[] = { bool(alu.src1Select), bool(alu.src2Select), bool(alu.src3Select) };
+    const bool vectorNegates[] = { bool(alu.src1Negate), bool(alu.src2Negate), bool(alu.src3Negate) };
+
+    for (uint32_t i = 0; i < ir.vectorSourceCount; i++)
+    {
+        auto& operand = ir.vectorSources[i];
+        decodeOperand(operand, vectorRegisters[i], vectorSelects[i], vectorNegates[i]);
+
+        uint32_t mask;
+        switch (alu.vectorOpcode)
+        {
+        case AluVectorOpcode::Dp2Add:
+            mask = (i == 2) ? 0b1 : 0b11;
+            break;
+
+        case AluVectorOpcode::Dp3:
+            mask = 0b111;
+            break;
+
+        case AluVectorOpcode::Dp4:
+        case AluVectorOpcode::Max4:
+            mask = 0b1111;
+            break;
+
+        default:
+            mask = alu.vectorWriteMask != 0 ? alu.vectorWriteMask : 0b1;
+            break;
+        }
+
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            if ((mask >> j) & 0x1)
+                operand.components[operand.componentCount++] = ((vectorSwizzles[i] >> (j * 2)) + j) & 0x3;
+        }
+    }
+
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::Adds:
+    case AluScalarOpcode::Muls:
+    case AluScalarOpcode::Maxs:
+    case AluScalarOpcode::MaxAs:
+    case AluScalarOpcode::MaxAsf:
+    case AluScalarOpcode::Mins:
+    case AluScalarOpcode::Subs:
+        ir.scalarSourceCount = 2;
+        break;
+
+    case AluScalarOpcode::SetpClr:
+    case AluScalarOpcode::RetainPrev:
+    case AluScalarOpcode::Mulsc0:
+    case AluScalarOpcode::Mulsc1:
+    case AluScalarOpcode::Addsc0:
+    case AluScalarOpcode::Addsc1:
+    case AluScalarOpcode::Subsc0:
+    case AluScalarOpcode::Subsc1:
+        ir.scalarSourceCount = 0;
+        break;
+
+    default:
+        ir.scalarSourceCount = 1;
+        break;
+    }
+
+    // Both scalar sources come from the third operand, using the last two swizzle components.
+    for (uint32_t i = 0; i < ir.scalarSourceCount; i++)
+    {
+        auto& operand = ir.scalarSources[i];
+        decodeOperand(operand, alu.src3Register, alu.src3Select, alu.src3Negate);
+        operand.components[operand.componentCount++] = (i == 0) ? (((alu.src3Swizzle >> 6) + 3) & 0x3) : (alu.src3Swizzle & 0x3);
+    }
+
+    // Constant variants take a constant and a temporary register, the latter being encoded in the opcode and swizzle.
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::Mulsc0:
+    case AluScalarOpcode::Mulsc1:
+    case AluScalarOpcode::Addsc0:
+    case AluScalarOpcode::Addsc1:
+    case AluScalarOpcode::Subsc0:
+    case AluScalarOpcode::Subsc1:
+    {
+        ir.scalarSourceCount = 2;
+
+        auto& constant = ir.scalarSources[0];
+        constant.isConstant = true;
+        constant.reg = alu.src3Register;
+        constant.negate = alu.src3Negate;
+        constant.abs = alu.absConstants;
+        constant.addressing = constAddressing;
+        constant.components[constant.componentCount++] = ((alu.src3Swizzle >> 6) + 3) & 0x3;
+
+        auto& temp = ir.scalarSources[1];
+        temp.reg = (uint32_t(alu.scalarOpcode) & 1) | (alu.src3Select << 1) | (alu.src3Swizzle & 0x3C);
+        temp.negate = alu.src3Negate;
+        temp.abs = alu.absConstants;
+        temp.components[temp.componentCount++] = alu.src3Swizzle & 0x3;
+        break;
+    }
+    }
+
+    ir.vectorWriteMask = alu.vectorWriteMask;
+    ir.scalarWriteMask = alu.scalarWriteMask;
+
+    if (alu.exportData)
+    {
+        ir.vectorWriteMask &= ~alu.scalarWriteMask;
+        ir.scalarWriteMask &= ~alu.vectorWriteMask;
+        ir.exportZeroMask = alu.scalarDestRelative ? (0b1111 & ~(alu.vectorWriteMask | alu.scalarWriteMask)) : 0;
+        ir.exportOneMask = alu.vectorWriteMask & alu.scalarWriteMask;
+    }
+
+    computeAluAccesses(instr);
+}
+
+static void decodeFetch(IrInstruction& instr, const uint32_t* code)
+{
+    union
+    {
+        VertexFetchInstruction vertexFetch;
+        TextureFetchInstruction textureFetch;
+        uint32_t instructionCode[3];
+    };
+
+    memcpy(instructionCode, code, sizeof(instructionCode));
+
+    if (vertexFetch.opcode == FetchOpcode::VertexFetch)
+    {
+        instr.kind = IrInstructionKind::VertexFetch;
+        instr.isPredicated = vertexFetch.isPredicated;
+        instr.predicateCondition = vertexFetch.predicateCondition;
+        instr.vertexFetch.dstRegister = vertexFetch.dstRegister;
+        instr.vertexFetch.dstSwizzle = vertexFetch.dstSwizzle;
+
+        // Vertex fetches are lowered to vertex inputs, so the index register is never read.
+        addWrite(instr, vertexFetch.dstRegister, getFetchWriteMask(vertexFetch.dstSwizzle));
+    }
+    else
+    {
+        auto& ir = instr.textureFetch;
+
+        instr.kind = IrInstructionKind::TextureFetch;
+        instr.isPredicated = textureFetch.isPredicated;
+        instr.predicateCondition = textureFetch.predCondition;
+        ir.opcode = textureFetch.opcode;
+        ir.srcRegister = textureFetch.srcRegister;
+        ir.srcSwizzle = textureFetch.srcSwizzle;
+        ir.dstRegister = textureFetch.dstRegister;
+        ir.dstSwizzle = textureFetch.dstSwizzle;
+        ir.constIndex = textureFetch.constIndex;
+        ir.dimension = textureFetch.dimension;
+        ir.offsetX = textureFetch.offsetX;
+        ir.offsetY = textureFetch.offsetY;
+
+        if (ir.isSupported())
+        {
+            uint8_t srcMask = 0;
+            for (uint32_t i = 0; i < ir.componentCount(); i++)
+                srcMask |= 1 << ir.srcComponent(i);
+
+            instr.reads[instr.readCount++] = { ir.srcRegister, srcMask };
+            addWrite(instr, ir.dstRegister, getFetchWriteMask(ir.dstSwizzle));
+        }
+    }
+
+    if (instr.isPredicated)
+        instr.stateReads |= IR_STATE_P0;
+}
+
+// Byte swaps the microcode to native endian, four words at a time where SIMD is available.
+static void byteSwapWords(uint32_t* dst, const be<uint32_t>* src, size_t count)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 4 <= count; i += 4)
+    {
+        // Swap the bytes of every 16-bit half, then the halves of every word.
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+        value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+        value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+    }
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    for (; i + 4 <= count; i += 4)
+        vst1q_u8(reinterpret_cast<uint8_t*>(dst + i), vrev32q_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(src + i))));
+#endif
+
+    for (; i < count; i++)
+        dst[i] = src[i];
+}
+
+void IrShader::decode(const be<uint32_t>* code, uint32_t size)
+{
+    words.resize(size / 4);
+    byteSwapWords(words.data(), code, words.size());
+
+    nodes.clear();
+    instructions.clear();
+    blocks.clear();
+    nodeBlocks.clear();
+    definedLiterals.reset();
+    definedLoopConstants.reset();
+
+    union
+    {
+        ControlFlowInstruction controlFlow[2];
+        uint32_t controlFlowCode[4];
+    };
+
+    // Instructions are placed right after the control flow, so the lowest execute address marks its end.
+    // Executes reaching past the end of the code are cut short.
+    uint32_t instructionLimit = size / 12;
+
+    for (uint32_t instrAddress = 0; instrAddress + 12 <= size; instrAddress += 12)
+    {
+        const uint32_t* controlFlowWords = words.data() + instrAddress / 4;
+
+        controlFlowCode[0] = controlFlowWords[0];
+        controlFlowCode[1] = controlFlowWords[1] & 0xFFFF;
+        controlFlowCode[2] = (controlFlowWords[1] >> 16) | (controlFlowWords[2] << 16);
+        controlFlowCode[3] = controlFlowWords[2] >> 16;
+
+        for (auto& cfInstr : controlFlow)
+        {
+            auto& node = nodes.emplace_back();
+            node.opcode = cfInstr.opcode;
+
+            uint32_t address = 0;
+            uint32_t count = 0;
+            uint32_t sequence = 0;
+
+            switch (cfInstr.opcode)
+            {
+            case ControlFlowOpcode::Exec:
+            case ControlFlowOpcode::ExecEnd:
+                address = cfInstr.exec.address;
+                count = cfInstr.exec.count;
+                sequence = cfInstr.exec.sequence;
+                node.isEnd = (cfInstr.opcode == ControlFlowOpcode::ExecEnd);
+                break;
+
+            case ControlFlowOpcode::CondExec:
+            case ControlFlowOpcode::CondExecEnd:
+            case ControlFlowOpcode::CondExecPredClean:
+            case ControlFlowOpcode::CondExecPredCleanEnd:
+                address = cfInstr.condExec.address;
+                count = cfInstr.condExec.count;
+                sequence = cfInstr.condExec.sequence;
+                node.boolAddress = cfInstr.condExec.boolAddress;
+                node.condition = cfInstr.condExec.condition;
+                node.isEnd = (cfInstr.opcode == ControlFlowOpcode::CondExecEnd);
+                break;
+
+            case ControlFlowOpcode::CondExecPred:
+            case ControlFlowOpcode::CondExecPredEnd:
+                address = cfInstr.condExecPred.address;
+                count = cfInstr.condExecPred.count;
+                sequence = cfInstr.condExecPred.sequence;
+                node.isPredicated = true;
+                node.condition = cfInstr.condExecPred.condition;
+                node.isEnd = (cfInstr.opcode == ControlFlowOpcode::CondExecPredEnd);
+                break;
+
+            case ControlFlowOpcode::LoopStart:
+                node.address = cfInstr.loopStart.address;
+                node.loopId = cfInstr.loopStart.loopId;
+                break;
+
+            case ControlFlowOpcode::LoopEnd:
+                node.address = cfInstr.loopEnd.address;
+                node.loopId = cfInstr.loopEnd.loopId;
+                break;
+
+            case ControlFlowOpcode::CondJmp:
+                node.address = cfInstr.condJmp.address;
+                node.isUnconditional = cfInstr.condJmp.isUnconditional;
+                node.isPredicated = cfInstr.condJmp.isPredicated;
+                node.boolAddress = cfInstr.condJmp.boolAddress;
+                node.condition = cfInstr.condJmp.condition;
+                node.direction = cfInstr.condJmp.direction;
+                break;
+            }
+
+            if (address != 0)
+                size = std::min<uint32_t>(size, address * 12);
+
+            count = std::min<uint32_t>(count, instructionLimit - std::min(address, instructionLimit));
+
+            node.firstInstruction = uint32_t(instructions.size());
+            node.instructionCount = count;
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                auto& instr = instructions.emplace_back();
+                instr.address = address + i;
+
+                const uint32_t* instructionWords = words.data() + (address + i) * 3;
+
+                if ((sequence & 0x1) != 0)
+                {
+                    decodeFetch(instr, instructionWords);
+                }
+                else
+                {
+                    instr.kind = IrInstructionKind::Alu;
+
+                    AluInstruction alu;
+                    memcpy(&alu, instructionWords, sizeof(alu));
+                    decodeAlu(instr, alu);
+                }
+
+                sequence >>= 2;
+            }
+        }
+    }
+
+    // Split into basic blocks. Leaders are jump targets, and the nodes following a jump, a loop or an end.
+    std::vector<bool> leaders(nodes.size() + 1);
+    leaders[0] = true;
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        auto& node = nodes[i];
+        switch (node.opcode)
+        {
+        case ControlFlowOpcode::CondJmp:
+        case ControlFlowOpcode::LoopStart:
+        case ControlFlowOpcode::LoopEnd:
+            if (node.address < nodes.size())
+                leaders[node.address] = true;
+
+            leaders[i + 1] = true;
+            break;
+
+        default:
+            if (node.isEnd)
+                leaders[i + 1] = true;
+            break;
+        }
+    }
+
+    nodeBlocks.resize(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (leaders[i])
+        {
+            auto& block = blocks.emplace_back();
+            block.firstNode = uint32_t(i);
+        }
+
+        ++blocks.back().nodeCount;
+        nodeBlocks[i] = uint32_t(blocks.size() - 1);
+    }
+
+    for (auto& block : blocks)
+    {
+        auto& lastNode = nodes[block.firstNode + block.nodeCount - 1];
+        uint32_t nextNode = block.firstNode + block.nodeCount;
+
+        auto addSuccessor = [&](uint32_t node)
+            {
+                if (node < nodes.size())
+                    block.successors[block.successorCount++] = nodeBlocks[node];
+            };
+
+        if (lastNode.isEnd)
+            continue;
+
+        bool isUnconditionalJump = lastNode.opcode == ControlFlowOpcode::CondJmp && lastNode.isUnconditional;
+        if (!isUnconditionalJump)
+            addSuccessor(nextNode);
+
+        if (lastNode.opcode == ControlFlowOpcode::CondJmp || lastNode.opcode == ControlFlowOpcode::LoopStart || lastNode.opcode == ControlFlowOpcode::LoopEnd)
+            addSuccessor(lastNode.address);
+    }
+}
+
+enum class ConstantKind : uint8_t
+{
+    Undefined, // Not reached by any path yet
+    Constant,
+    Unknown
+};
+
+struct ConstantValue
+{
+    ConstantKind kind = ConstantKind::Undefined;
+    uint32_t value = 0;
+
+    void meet(const ConstantValue& other)
+    {
+        if (kind == ConstantKind::Undefined)
+            *this = other;
+        else if (other.kind != ConstantKind::Undefined && (other.kind != kind || other.value != value))
+            *this = { ConstantKind::Unknown, 0 };
+    }
+
+    bool operator==(const ConstantValue& other) const
+    {
+        return kind == other.kind && value == other.value;
+    }
+};
+
+struct ConstantState
+{
+    ConstantValue registers[64][4];
+    ConstantValue ps;
+
+    void meet(const ConstantState& other)
+    {
+        for (size_t i = 0; i < std::size(registers); i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+                registers[i][j].meet(other.registers[i][j]);
+        }
+
+        ps.meet(other.ps);
+    }
+
+    bool operator==(const ConstantState& other) const
+    {
+        for (size_t i = 0; i < std::size(registers); i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+            {
+                if (!(registers[i][j] == other.registers[i][j]))
+                    return false;
+            }
+        }
+
+        return ps == other.ps;
+    }
+};
+
+static constexpr uint32_t LITERAL_ZERO = 0x00000000;
+static constexpr uint32_t LITERAL_ONE = 0x3F800000;
+
+static float toFloat(uint32_t value)
+{
+    float result;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+static uint32_t fromFloat(float value)
+{
+    uint32_t result;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+static uint32_t saturateLiteral(uint32_t value)
+{
+    float floatValue = toFloat(value);
+    if (!(floatValue > 0.0f))
+        return LITERAL_ZERO;
+
+    return floatValue < 1.0f ? value : LITERAL_ONE;
+}
+
+static ConstantValue getConstantLane(const IrShader& shader, const ConstantState& state, const IrOperand& operand, uint32_t index)
+{
+    if (operand.isLiteral)
+        return { ConstantKind::Constant, operand.literals[index] };
+
+    ConstantValue lane;
+    if (operand.isConstant)
+    {
+        if (operand.addressing != IrAddressing::Absolute || !shader.definedLiterals.test(operand.reg))
+            return { ConstantKind::Unknown, 0 };
+
+        lane = { ConstantKind::Constant, shader.literals[operand.reg][operand.components[index]] };
+    }
+    else
+    {
+        lane = state.registers[operand.reg][operand.components[index]];
+    }
+
+    if (lane.kind == ConstantKind::Constant)
+    {
+        if (operand.abs)
+            lane.value &= ~0x80000000;
+
+        if (operand.negate)
+            lane.value ^= 0x80000000;
+    }
+
+    return lane;
+}
+
+static bool hasUndefinedLane(const IrShader& shader, const ConstantState& state, const IrOperand& operand)
+{
+    for (uint32_t i = 0; i < operand.componentCount; i++)
+    {
+        if (getConstantLane(shader, state, operand, i).kind == ConstantKind::Undefined)
+            return true;
+    }
+
+    return false;
+}
+
+static void substituteLiteral(const IrShader& shader, const ConstantState& state, IrOperand& operand)
+{
+    if (operand.isLiteral || operand.componentCount == 0)
+        return;
+
+    uint32_t literals[4];
+    for (uint32_t i = 0; i < operand.componentCount; i++)
+    {
+        auto lane = getConstantLane(shader, state, operand, i);
+        if (lane.kind != ConstantKind::Constant)
+            return;
+
+        literals[i] = lane.value;
+    }
+
+    operand.isLiteral = true;
+    memcpy(operand.literals, literals, operand.componentCount * sizeof(uint32_t));
+}
+
+static bool isLiteralValue(const IrOperand& operand, float value)
+{
+    if (!operand.isLiteral)
+        return false;
+
+    for (uint32_t i = 0; i < operand.componentCount; i++)
+    {
+        if (toFloat(operand.literals[i]) != value)
+            return false;
+    }
+
+    return true;
+}
+
+static IrOperand makeLiteral(uint32_t componentCount, const uint32_t* literals)
+{
+    IrOperand operand;
+    operand.isLiteral = true;
+    operand.componentCount = componentCount;
+    memcpy(operand.literals, literals, componentCount * sizeof(uint32_t));
+    return operand;
+}
+
+// Moves are encoded the way the microcode does it, as the maximum of a value with itself.
+static void setVectorMove(IrAlu& alu, IrOperand operand)
+{
+    alu.vectorOpcode = AluVectorOpcode::Max;
+    alu.vectorSources[0] = operand;
+    alu.vectorSources[1] = operand;
+    alu.vectorSourceCount = 2;
+}
+
+static void setScalarMove(IrAlu& alu, IrOperand operand)
+{
+    alu.scalarOpcode = AluScalarOpcode::Maxs;
+    alu.scalarSources[0] = operand;
+    alu.scalarSources[1] = operand;
+    alu.scalarSourceCount = 2;
+}
+
+static bool isVectorMove(const IrAlu& alu)
+{
+    return alu.vectorOpcode == AluVectorOpcode::Max && alu.vectorSources[0] == alu.vectorSources[1];
+}
+
+static bool isScalarMove(const IrAlu& alu)
+{
+    return alu.scalarOpcode == AluScalarOpcode::Maxs && alu.scalarSources[0] == alu.scalarSources[1];
+}
+
+// Multiplications by zero fold to zero regardless of the other operand, like the Xenos multiply does. Results that
+// are not finite are left for the GPU to compute.
+static std::optional<float> evaluateVector(AluVectorOpcode opcode, const float* sources)
+{
+    float result;
+
+    switch (opcode)
+    {
+    case AluVectorOpcode::Add:
+        result = sources[0] + sources[1];
+        break;
+    case AluVectorOpcode::Mul:
+        result = (sources[0] == 0.0f || sources[1] == 0.0f) ? 0.0f : sources[0] * sources[1];
+        break;
+    case AluVectorOpcode::Max:
+        result = std::max(sources[0], sources[1]);
+        break;
+    case AluVectorOpcode::Min:
+        result = std::min(sources[0], sources[1]);
+        break;
+    case AluVectorOpcode::Seq:
+        result = sources[0] == sources[1] ? 1.0f : 0.0f;
+        break;
+    case AluVectorOpcode::Sgt:
+        result = sources[0] > sources[1] ? 1.0f : 0.0f;
+        break;
+    case AluVectorOpcode::Sge:
+        result = sources[0] >= sources[1] ? 1.0f : 0.0f;
+        break;
+    case AluVectorOpcode::Sne:
+        result = sources[0] != sources[1] ? 1.0f : 0.0f;
+        break;
+    case AluVectorOpcode::Frc:
+        result = sources[0] - std::floor(sources[0]);
+        break;
+    case AluVectorOpcode::Trunc:
+        result = std::trunc(sources[0]);
+        break;
+    case AluVectorOpcode::Floor:
+        result = std::floor(sources[0]);
+        break;
+    case AluVectorOpcode::Mad:
+        result = ((sources[0] == 0.0f || sources[1] == 0.0f) ? 0.0f : sources[0] * sources[1]) + sources[2];
+        break;
+    case AluVectorOpcode::CndEq:
+        result = sources[0] == 0.0f ? sources[1] : sources[2];
+        break;
+    case AluVectorOpcode::CndGe:
+        result = sources[0] >= 0.0f ? sources[1] : sources[2];
+        break;
+    case AluVectorOpcode::CndGt:
+        result = sources[0] > 0.0f ? sources[1] : sources[2];
+        break;
+    default:
+        return std::nullopt;
+    }
+
+    if (!std::isfinite(result))
+        return std::nullopt;
+
+    return result;
+}
+
+static std::optional<float> evaluateScalar(AluScalarOpcode opcode, const float* sources)
+{
+    float result;
+
+    switch (opcode)
+    {
+    case AluScalarOpcode::Adds:
+    case AluScalarOpcode::Addsc0:
+    case AluScalarOpcode::Addsc1:
+        result = sources[0] + sources[1];
+        break;
+    case AluScalarOpcode::Muls:
+    case AluScalarOpcode::Mulsc0:
+    case AluScalarOpcode::Mulsc1:
+        result = (sources[0] == 0.0f || sources[1] == 0.0f) ? 0.0f : sources[0] * sources[1];
+        break;
+    case AluScalarOpcode::Subs:
+    case AluScalarOpcode::Subsc0:
+    case AluScalarOpcode::Subsc1:
+        result = sources[0] - sources[1];
+        break;
+    case AluScalarOpcode::Maxs:
+        result = std::max(sources[0], sources[1]);
+        break;
+    case AluScalarOpcode::Mins:
+        result = std::min(sources[0], sources[1]);
+        break;
+    case AluScalarOpcode::Seqs:
+        result = sources[0] == 0.0f ? 1.0f : 0.0f;
+        break;
+    case AluScalarOpcode::Sgts:
+        result = sources[0] > 0.0f ? 1.0f : 0.0f;
+        break;
+    case AluScalarOpcode::Sges:
+        result = sources[0] >= 0.0f ? 1.0f : 0.0f;
+        break;
+    case AluScalarOpcode::Snes:
+        result = sources[0] != 0.0f ? 1.0f : 0.0f;
+        break;
+    case AluScalarOpcode::Frcs:
+        result = sources[0] - std::floor(sources[0]);
+        break;
+    case AluScalarOpcode::Truncs:
+        result = std::trunc(sources[0]);
+        break;
+    case AluScalarOpcode::Floors:
+        result = std::floor(sources[0]);
+        break;
+    default:
+        return std::nullopt;
+    }
+
+    if (!std::isfinite(result))
+        return std::nullopt;
+
+    return result;
+}
+
+static void foldVector(IrAlu& alu)
+{
+    auto& sources = alu.vectorSources;
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Mad:
+        if (isLiteralValue(sources[0], 0.0f) || isLiteralValue(sources[1], 0.0f))
+        {
+            setVectorMove(alu, sources[2]);
+        }
+        else if (isLiteralValue(sources[2], 0.0f))
+        {
+            alu.vectorOpcode = AluVectorOpcode::Mul;
+            alu.vectorSourceCount = 2;
+        }
+        else if (isLiteralValue(sources[0], 1.0f))
+        {
+            alu.vectorOpcode = AluVectorOpcode::Add;
+            sources[0] = sources[2];
+            alu.vectorSourceCount = 2;
+        }
+        else if (isLiteralValue(sources[1], 1.0f))
+        {
+            alu.vectorOpcode = AluVectorOpcode::Add;
+            sources[1] = sources[2];
+            alu.vectorSourceCount = 2;
+        }
+        break;
+
+    case AluVectorOpcode::CndEq:
+    case AluVectorOpcode::CndGe:
+    case AluVectorOpcode::CndGt:
+    {
+        if (!sources[0].isLiteral)
+            break;
+
+        uint32_t selectMask = 0;
+        for (uint32_t i = 0; i < sources[0].componentCount; i++)
+        {
+            float condition = toFloat(sources[0].literals[i]);
+            bool select;
+
+            if (alu.vectorOpcode == AluVectorOpcode::CndEq)
+                select = condition == 0.0f;
+            else if (alu.vectorOpcode == AluVectorOpcode::CndGe)
+                select = condition >= 0.0f;
+            else
+                select = condition > 0.0f;
+
+            if (select)
+                selectMask |= 1 << i;
+        }
+
+        if (selectMask == (1u << sources[0].componentCount) - 1)
+            setVectorMove(alu, sources[1]);
+        else if (selectMask == 0)
+            setVectorMove(alu, sources[2]);
+
+        break;
+    }
+    }
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Mul:
+        if (isLiteralValue(sources[0], 0.0f))
+            setVectorMove(alu, sources[0]);
+        else if (isLiteralValue(sources[1], 0.0f))
+            setVectorMove(alu, sources[1]);
+        else if (isLiteralValue(sources[0], 1.0f))
+            setVectorMove(alu, sources[1]);
+        else if (isLiteralValue(sources[1], 1.0f))
+            setVectorMove(alu, sources[0]);
+        break;
+
+    case AluVectorOpcode::Add:
+        if (isLiteralValue(sources[0], 0.0f))
+            setVectorMove(alu, sources[1]);
+        else if (isLiteralValue(sources[1], 0.0f))
+            setVectorMove(alu, sources[0]);
+        break;
+    }
+
+    bool isLiteral = alu.vectorSourceCount != 0;
+    for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+        isLiteral &= sources[i].isLiteral;
+
+    if (!isLiteral)
+        return;
+
+    uint32_t componentCount = sources[0].componentCount;
+    uint32_t literals[4];
+
+    for (uint32_t i = 0; i < componentCount; i++)
+    {
+        float lanes[3];
+        for (uint32_t j = 0; j < alu.vectorSourceCount; j++)
+            lanes[j] = toFloat(sources[j].literals[i]);
+
+        auto result = evaluateVector(alu.vectorOpcode, lanes);
+        if (!result.has_value())
+            return;
+
+        literals[i] = fromFloat(*result);
+    }
+
+    if (alu.vectorSaturate)
+    {
+        for (uint32_t i = 0; i < componentCount; i++)
+            literals[i] = saturateLiteral(literals[i]);
+
+        alu.vectorSaturate = false;
+    }
+
+    setVectorMove(alu, makeLiteral(componentCount, literals));
+}
+
+static void foldScalar(IrAlu& alu)
+{
+    auto& sources = alu.scalarSources;
+
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::Muls:
+    case AluScalarOpcode::Mulsc0:
+    case AluScalarOpcode::Mulsc1:
+        if (isLiteralValue(sources[0], 0.0f))
+            setScalarMove(alu, sources[0]);
+        else if (isLiteralValue(sources[1], 0.0f))
+            setScalarMove(alu, sources[1]);
+        else if (isLiteralValue(sources[0], 1.0f))
+            setScalarMove(alu, sources[1]);
+        else if (isLiteralValue(sources[1], 1.0f))
+            setScalarMove(alu, sources[0]);
+        break;
+
+    case AluScalarOpcode::Adds:
+    case AluScalarOpcode::Addsc0:
+    case AluScalarOpcode::Addsc1:
+        if (isLiteralValue(sources[0], 0.0f))
+            setScalarMove(alu, sources[1]);
+        else if (isLiteralValue(sources[1], 0.0f))
+            setScalarMove(alu, sources[0]);
+        break;
+
+    case AluScalarOpcode::Subs:
+    case AluScalarOpcode::Subsc0:
+    case AluScalarOpcode::Subsc1:
+        if (isLiteralValue(sources[1], 0.0f))
+            setScalarMove(alu, sources[0]);
+        break;
+    }
+
+    if (alu.scalarSourceCount == 0)
+        return;
+
+    float lanes[2];
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+    {
+        if (!sources[i].isLiteral)
+            return;
+
+        lanes[i] = toFloat(sources[i].literals[0]);
+    }
+
+    auto result = evaluateScalar(alu.scalarOpcode, lanes);
+    if (!result.has_value())
+        return;
+
+    uint32_t literal = fromFloat(*result);
+    if (alu.scalarSaturate)
+    {
+        literal = saturateLiteral(literal);
+        alu.scalarSaturate = false;
+    }
+
+    setScalarMove(alu, makeLiteral(1, &literal));
+}
+
+static bool isSameAlu(const IrAlu& left, const IrAlu& right)
+{
+    if (left.vectorOpcode != right.vectorOpcode || left.scalarOpcode != right.scalarOpcode ||
+        left.vectorSourceCount != right.vectorSourceCount || left.scalarSourceCount != right.scalarSourceCount ||
+        left.vectorSaturate != right.vectorSaturate || left.scalarSaturate != right.scalarSaturate)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < left.vectorSourceCount; i++)
+    {
+        if (!(left.vectorSources[i] == right.vectorSources[i]))
+            return false;
+    }
+
+    for (uint32_t i = 0; i < left.scalarSourceCount; i++)
+    {
+        if (!(left.scalarSources[i] == right.scalarSources[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// Substitutes known values into the operands and folds the instruction, then updates the state with what it writes.
+static void propagateConstants(const IrShader& shader, IrInstruction& instr, ConstantState& state)
+{
+    if (instr.isDead)
+        return;
+
+    auto write = [&](ConstantValue& destination, const ConstantValue& value)
+        {
+            if (instr.isPredicated)
+                destination.meet(value);
+            else
+                destination = value;
+        };
+
+    auto writeFetch = [&](uint8_t dstRegister, uint16_t dstSwizzle)
+        {
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                switch (FetchDestinationSwizzle((dstSwizzle >> (i * 3)) & 0x7))
+                {
+                case FetchDestinationSwizzle::Zero:
+                    write(state.registers[dstRegister][i], { ConstantKind::Constant, LITERAL_ZERO });
+                    break;
+                case FetchDestinationSwizzle::One:
+                    write(state.registers[dstRegister][i], { ConstantKind::Constant, LITERAL_ONE });
+                    break;
+                case FetchDestinationSwizzle::Keep:
+                    break;
+                default:
+                    write(state.registers[dstRegister][i], { ConstantKind::Unknown, 0 });
+                    break;
+                }
+            }
+        };
+
+    switch (instr.kind)
+    {
+    case IrInstructionKind::VertexFetch:
+        writeFetch(instr.vertexFetch.dstRegister, instr.vertexFetch.dstSwizzle);
+        return;
+
+    case IrInstructionKind::TextureFetch:
+        if (instr.textureFetch.isSupported())
+            writeFetch(instr.textureFetch.dstRegister, instr.textureFetch.dstSwizzle);
+        return;
+    }
+
+    auto& alu = instr.alu;
+
+    // Cube reads the register directly.
+    if (alu.vectorOpcode != AluVectorOpcode::Cube)
+    {
+        for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+            substituteLiteral(shader, state, alu.vectorSources[i]);
+
+        foldVector(alu);
+    }
+
+    if (alu.vectorWriteMask != 0 && !alu.exportData)
+    {
+        bool isMove = isVectorMove(alu);
+
+        bool hasUndefined = false;
+        for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+            hasUndefined |= hasUndefinedLane(shader, state, alu.vectorSources[i]);
+
+        ConstantValue lanes[4];
+        uint32_t index = 0;
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if ((alu.vectorWriteMask >> i) & 0x1)
+            {
+                if (isMove)
+                {
+                    lanes[i] = getConstantLane(shader, state, alu.vectorSources[0], index);
+                    if (alu.vectorSaturate && lanes[i].kind == ConstantKind::Constant)
+                        lanes[i].value = saturateLiteral(lanes[i].value);
+                }
+                else
+                {
+                    lanes[i] = { hasUndefined ? ConstantKind::Undefined : ConstantKind::Unknown, 0 };
+                }
+
+                ++index;
+            }
+        }
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if ((alu.vectorWriteMask >> i) & 0x1)
+                write(state.registers[alu.vectorDest][i], lanes[i]);
+        }
+    }
+
+    // The scalar operation is emitted after the vector write, so its sources see the new value.
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+        substituteLiteral(shader, state, alu.scalarSources[i]);
+
+    foldScalar(alu);
+
+    if (alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+    {
+        ConstantValue ps;
+
+        if (isScalarMove(alu))
+        {
+            ps = getConstantLane(shader, state, alu.scalarSources[0], 0);
+            if (alu.scalarSaturate && ps.kind == ConstantKind::Constant)
+                ps.value = saturateLiteral(ps.value);
+        }
+        else
+        {
+            bool hasUndefined = false;
+            for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+                hasUndefined |= hasUndefinedLane(shader, state, alu.scalarSources[i]);
+
+            switch (alu.scalarOpcode)
+            {
+            case AluScalarOpcode::AddsPrev:
+            case AluScalarOpcode::MulsPrev:
+            case AluScalarOpcode::MulsPrev2:
+            case AluScalarOpcode::SubsPrev:
+                hasUndefined |= state.ps.kind == ConstantKind::Undefined;
+                break;
+            }
+
+            ps = { hasUndefined ? ConstantKind::Undefined : ConstantKind::Unknown, 0 };
+        }
+
+        write(state.ps, ps);
+    }
+
+    if (!alu.exportData)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if ((alu.scalarWriteMask >> i) & 0x1)
+                write(state.registers[alu.scalarDest][i], state.ps);
+        }
+    }
+
+    computeAluAccesses(instr);
+}
+
+static std::vector<std::vector<uint32_t>> getPredecessors(const std::vector<IrBlock>& blocks)
+{
+    std::vector<std::vector<uint32_t>> predecessors(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        for (uint32_t j = 0; j < blocks[i].successorCount; j++)
+            predecessors[blocks[i].successors[j]].push_back(uint32_t(i));
+    }
+
+    return predecessors;
+}
+
+struct LiveSet
+{
+    uint8_t registers[64]{};
+    uint8_t state = 0;
+
+    void merge(const LiveSet& other)
+    {
+        for (size_t i = 0; i < std::size(registers); i++)
+            registers[i] |= other.registers[i];
+
+        state |= other.state;
+    }
+
+    bool operator==(const LiveSet& other) const
+    {
+        return memcmp(registers, other.registers, sizeof(registers)) == 0 && state == other.state;
+    }
+};
+
+static void transfer(LiveSet& live, const IrInstruction& instr)
+{
+    if (instr.isDead)
+        return;
+
+    // Predicated writes might not happen, so they do not end the lifetime of the previous value.
+    if (!instr.isPredicated)
+    {
+        for (uint32_t i = 0; i < instr.writeCount; i++)
+            live.registers[instr.writes[i].reg] &= ~instr.writes[i].mask;
+
+        live.state &= ~instr.stateWrites;
+    }
+
+    for (uint32_t i = 0; i < instr.readCount; i++)
+        live.registers[instr.reads[i].reg] |= instr.reads[i].mask;
+
+    live.state |= instr.stateReads;
+}
+
+static bool eliminateFetch(IrInstruction& instr, uint8_t dstRegister, uint16_t& dstSwizzle, const LiveSet& live)
+{
+    uint16_t swizzle = dstSwizzle;
+    bool hasComponent = false;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        auto component = FetchDestinationSwizzle((swizzle >> (i * 3)) & 0x7);
+        if (component == FetchDestinationSwizzle::Keep)
+            continue;
+
+        if ((live.registers[dstRegister] & (1 << i)) == 0)
+            swizzle |= 0x7 << (i * 3);
+        else if (component <= FetchDestinationSwizzle::W)
+            hasComponent = true;
+    }
+
+    if (swizzle == dstSwizzle)
+        return false;
+
+    if (getFetchWriteMask(swizzle) == 0)
+    {
+        instr.isDead = true;
+        return true;
+    }
+
+    // The emitter needs at least one fetched component to form the assignment.
+    if (!hasComponent)
+        return false;
+
+    dstSwizzle = swizzle;
+    instr.writes[0].mask = getFetchWriteMask(swizzle);
+    return true;
+}
+
+static bool eliminateAlu(IrInstruction& instr, const LiveSet& live)
+{
+    auto& alu = instr.alu;
+
+    if (alu.exportData)
+        return false;
+
+    bool eliminated = false;
+
+    uint8_t scalarWriteMask = alu.scalarWriteMask & live.registers[alu.scalarDest];
+    if (scalarWriteMask != alu.scalarWriteMask)
+    {
+        alu.scalarWriteMask = scalarWriteMask;
+        eliminated = true;
+    }
+
+    // Scalar operations only matter through ps unless they set the predicate, the address register or kill the pixel.
+    bool isPureScalar = !(alu.scalarOpcode >= AluScalarOpcode::SetpEq && alu.scalarOpcode <= AluScalarOpcode::KillsOne) &&
+        alu.scalarOpcode != AluScalarOpcode::MaxAs && alu.scalarOpcode != AluScalarOpcode::MaxAsf && alu.scalarOpcode != AluScalarOpcode::RetainPrev;
+
+    if (isPureScalar && scalarWriteMask == 0 && (live.state & IR_STATE_PS) == 0)
+    {
+        alu.scalarOpcode = AluScalarOpcode::RetainPrev;
+        alu.scalarSourceCount = 0;
+        eliminated = true;
+    }
+
+    // The scalar write is emitted after the vector one, and the scalar operation reads its sources after the vector write.
+    uint8_t vectorLiveMask = live.registers[alu.vectorDest];
+    if (alu.scalarDest == alu.vectorDest)
+        vectorLiveMask &= ~alu.scalarWriteMask;
+
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+    {
+        auto& operand = alu.scalarSources[i];
+        if (!operand.isConstant && operand.reg == alu.vectorDest)
+            vectorLiveMask |= operand.componentMask();
+    }
+
+    // Cube writes the face data used by cube map fetches, so it always stays. Predicate, address register and Dst
+    // operations print their sources with the full mask, which only allows removing the whole write.
+    bool hasSideEffects = false;
+    bool canReducePartially = true;
+    bool isPerComponent = false;
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Dp4:
+    case AluVectorOpcode::Dp3:
+    case AluVectorOpcode::Dp2Add:
+    case AluVectorOpcode::Max4:
+        break;
+
+    case AluVectorOpcode::Dst:
+        canReducePartially = false;
+        break;
+
+    case AluVectorOpcode::KillEq:
+    case AluVectorOpcode::KillGt:
+    case AluVectorOpcode::KillGe:
+    case AluVectorOpcode::KillNe:
+        hasSideEffects = true;
+        break;
+
+    case AluVectorOpcode::Cube:
+    case AluVectorOpcode::SetpEqPush:
+    case AluVectorOpcode::SetpNePush:
+    case AluVectorOpcode::SetpGtPush:
+    case AluVectorOpcode::SetpGePush:
+    case AluVectorOpcode::MaxA:
+        hasSideEffects = true;
+        canReducePartially = false;
+        break;
+
+    default:
+        isPerComponent = true;
+        break;
+    }
+
+    uint8_t vectorWriteMask = alu.vectorWriteMask & vectorLiveMask;
+    if (alu.vectorOpcode == AluVectorOpcode::Cube || (vectorWriteMask != 0 && !canReducePartially))
+        vectorWriteMask = alu.vectorWriteMask;
+
+    if (vectorWriteMask != alu.vectorWriteMask)
+    {
+        if (vectorWriteMask == 0)
+        {
+            if (!hasSideEffects)
+                alu.vectorSourceCount = 0;
+        }
+        else if (isPerComponent)
+        {
+            for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+            {
+                auto& operand = alu.vectorSources[i];
+                uint32_t componentCount = 0;
+                uint32_t index = 0;
+
+                for (uint32_t j = 0; j < 4; j++)
+                {
+                    if ((alu.vectorWriteMask >> j) & 0x1)
+                    {
+                        if ((vectorWriteMask >> j) & 0x1)
+                        {
+                            operand.components[componentCount] = operand.components[index];
+                            operand.literals[componentCount] = operand.literals[index];
+                            ++componentCount;
+                        }
+
+                        ++index;
+                    }
+                }
+
+                operand.componentCount = componentCount;
+            }
+        }
+
+        alu.vectorWriteMask = vectorWriteMask;
+        eliminated = true;
+    }
+
+    if (eliminated)
+    {
+        computeAluAccesses(instr);
+
+        if (alu.vectorWriteMask == 0 && !hasSideEffects && alu.scalarOpcode == AluScalarOpcode::RetainPrev && alu.scalarWriteMask == 0)
+            instr.isDead = true;
+    }
+
+    return eliminated;
+}
+
+static bool eliminate(IrInstruction& instr, const LiveSet& live)
+{
+    if (instr.isDead)
+        return false;
+
+    switch (instr.kind)
+    {
+    case IrInstructionKind::Alu:
+        return eliminateAlu(instr, live);
+
+    case IrInstructionKind::VertexFetch:
+        return eliminateFetch(instr, instr.vertexFetch.dstRegister, instr.vertexFetch.dstSwizzle, live);
+
+    case IrInstructionKind::TextureFetch:
+    {
+        if (!instr.textureFetch.isSupported())
+            return false;
+
+    #ifdef UNLEASHED_RECOMP
+        // Computes the pixel coordinate used by alpha to coverage.
+        if (instr.textureFetch.constIndex == 0 && instr.textureFetch.dimension == TextureDimension::Texture2D)
+            return false;
+    #endif
+
+        return eliminateFetch(instr, instr.textureFetch.dstRegister, instr.textureFetch.dstSwizzle, live);
+    }
+    }
+
+    return false;
+}
+
+enum class RangeKind : uint8_t
+{
+    Undefined, // Not reached by any path yet
+    Bounded,   // Finite and within [min, max]
+    Unbounded  // Possibly infinite or NaN
+};
+
+struct RangeValue
+{
+    RangeKind kind = RangeKind::Undefined;
+    float min = 0.0f;
+    float max = 0.0f;
+
+    void meet(const RangeValue& other)
+    {
+        if (kind == RangeKind::Undefined)
+        {
+            *this = other;
+        }
+        else if (other.kind == RangeKind::Unbounded)
+        {
+            *this = other;
+        }
+        else if (kind == RangeKind::Bounded && other.kind == RangeKind::Bounded)
+        {
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+        }
+    }
+
+    bool operator==(const RangeValue& other) const
+    {
+        return kind == other.kind && min == other.min && max == other.max;
+    }
+};
+
+struct RangeState
+{
+    RangeValue registers[64][4];
+    RangeValue ps;
+    RangeValue a0;
+
+    void meet(const RangeState& other)
+    {
+        for (size_t i = 0; i < std::size(registers); i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+                registers[i][j].meet(other.registers[i][j]);
+        }
+
+        ps.meet(other.ps);
+        a0.meet(other.a0);
+    }
+
+    // Lanes still changing after many visits would otherwise grow by one loop iteration at a time.
+    void widen(const RangeState& previous)
+    {
+        auto widenValue = [](RangeValue& value, const RangeValue& previousValue)
+            {
+                if (!(value == previousValue))
+                    value = { RangeKind::Unbounded };
+            };
+
+        for (size_t i = 0; i < std::size(registers); i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+                widenValue(registers[i][j], previous.registers[i][j]);
+        }
+
+        widenValue(ps, previous.ps);
+        widenValue(a0, previous.a0);
+    }
+
+    bool operator==(const RangeState& other) const
+    {
+        for (size_t i = 0; i < std::size(registers); i++)
+        {
+            for (size_t j = 0; j < 4; j++)
+            {
+                if (!(registers[i][j] == other.registers[i][j]))
+                    return false;
+            }
+        }
+
+        return ps == other.ps && a0 == other.a0;
+    }
+};
+
+static constexpr uint32_t RANGE_WIDENING_LIMIT = 8;
+
+static RangeValue makeRange(float min, float max)
+{
+    if (!std::isfinite(min) || !std::isfinite(max))
+        return { RangeKind::Unbounded };
+
+    return { RangeKind::Bounded, min, max };
+}
+
+static RangeValue getRangeLane(const IrShader& shader, const RangeState& state, const IrOperand& operand, uint32_t index)
+{
+    if (operand.isLiteral)
+        return makeRange(toFloat(operand.literals[index]), toFloat(operand.literals[index]));
+
+    RangeValue lane;
+    if (operand.isConstant)
+    {
+        if (operand.addressing != IrAddressing::Absolute || !shader.definedLiterals.test(operand.reg))
+            return { RangeKind::Unbounded };
+
+        float value = toFloat(shader.literals[operand.reg][operand.components[index]]);
+        lane = makeRange(value, value);
+    }
+    else
+    {
+        lane = state.registers[operand.reg][operand.components[index]];
+    }
+
+    if (lane.kind == RangeKind::Bounded)
+    {
+        if (operand.abs)
+        {
+            if (lane.max <= 0.0f)
+                lane = { RangeKind::Bounded, -lane.max, -lane.min };
+            else if (lane.min < 0.0f)
+                lane = { RangeKind::Bounded, 0.0f, std::max(-lane.min, lane.max) };
+        }
+
+        if (operand.negate)
+            lane = { RangeKind::Bounded, -lane.max, -lane.min };
+    }
+
+    return lane;
+}
+
+// Union of every lane the operand reads.
+static RangeValue getRange(const IrShader& shader, const RangeState& state, const IrOperand& operand)
+{
+    RangeValue range;
+    for (uint32_t i = 0; i < operand.componentCount; i++)
+        range.meet(getRangeLane(shader, state, operand, i));
+
+    return range;
+}
+
+// Applies an operation on bounded ranges, propagating undefined and unbounded inputs.
+template<typename Function>
+static RangeValue combineRanges(const RangeValue& left, const RangeValue& right, Function&& function)
+{
+    if (left.kind == RangeKind::Undefined || right.kind == RangeKind::Undefined)
+        return {};
+
+    if (left.kind == RangeKind::Unbounded || right.kind == RangeKind::Unbounded)
+        return { RangeKind::Unbounded };
+
+    return function(left, right);
+}
+
+// Applies a non-decreasing function to both ends of a bounded range.
+template<typename Function>
+static RangeValue mapRange(const RangeValue& range, Function&& function)
+{
+    return combineRanges(range, range, [&](const RangeValue& value, const RangeValue&) { return makeRange(function(value.min), function(value.max)); });
+}
+
+static RangeValue addRanges(const RangeValue& left, const RangeValue& right)
+{
+    return combineRanges(left, right, [](const RangeValue& a, const RangeValue& b) { return makeRange(a.min + b.min, a.max + b.max); });
+}
+
+static RangeValue mulRanges(const RangeValue& left, const RangeValue& right)
+{
+    return combineRanges(left, right, [](const RangeValue& a, const RangeValue& b)
+        {
+            float products[] = { a.min * b.min, a.min * b.max, a.max * b.min, a.max * b.max };
+            return makeRange(*std::min_element(std::begin(products), std::end(products)), *std::max_element(std::begin(products), std::end(products)));
+        });
+}
+
+static RangeValue squareRange(const RangeValue& range)
+{
+    return combineRanges(range, range, [](const RangeValue& value, const RangeValue&)
+        {
+            float minSquare = value.min * value.min;
+            float maxSquare = value.max * value.max;
+
+            if (value.min >= 0.0f)
+                return makeRange(minSquare, maxSquare);
+
+            if (value.max <= 0.0f)
+                return makeRange(maxSquare, minSquare);
+
+            return makeRange(0.0f, std::max(minSquare, maxSquare));
+        });
+}
+
+static RangeValue unionRanges(RangeValue left, const RangeValue& right)
+{
+    if (left.kind == RangeKind::Undefined || right.kind == RangeKind::Undefined)
+        return {};
+
+    left.meet(right);
+    return left;
+}
+
+// Saturation turns NaN into zero, so the result is bounded even for unbounded inputs.
+static RangeValue saturateRange(const RangeValue& range)
+{
+    if (range.kind == RangeKind::Undefined)
+        return range;
+
+    if (range.kind == RangeKind::Unbounded)
+        return { RangeKind::Bounded, 0.0f, 1.0f };
+
+    return { RangeKind::Bounded, std::clamp(range.min, 0.0f, 1.0f), std::clamp(range.max, 0.0f, 1.0f) };
+}
+
+static RangeValue constantRange(const RangeValue& source, float min, float max)
+{
+    if (source.kind == RangeKind::Undefined)
+        return source;
+
+    return { RangeKind::Bounded, min, max };
+}
+
+static RangeValue dotRange(const IrShader& shader, const RangeState& state, const IrOperand& left, const IrOperand& right)
+{
+    RangeValue leftRange = getRange(shader, state, left);
+    RangeValue product = left == right ? squareRange(leftRange) : mulRanges(leftRange, getRange(shader, state, right));
+    return mapRange(product, [&](float value) { return value * left.componentCount; });
+}
+
+// Reciprocals, reciprocal square roots and logarithms are clamped to [-FLT_MAX, FLT_MAX] when emitted, as FLT_MIN is
+// defined as -FLT_MAX in shader_common.h. The clamp is redundant when the input is at least the smallest normal float,
+// which keeps every result finite with some margin. Denormal inputs get flushed to zero by the GPU, turning the results
+// into infinities, which is exactly what the clamp is for.
+static bool isClampRedundant(AluScalarOpcode opcode, const RangeValue& source)
+{
+    if (source.kind != RangeKind::Bounded || source.min < FLT_MIN)
+        return false;
+
+    switch (opcode)
+    {
+    case AluScalarOpcode::Rcpc:
+    case AluScalarOpcode::Rcpf:
+    case AluScalarOpcode::Rcp:
+    case AluScalarOpcode::Rsqc:
+    case AluScalarOpcode::Rsqf:
+    case AluScalarOpcode::Rsq:
+    case AluScalarOpcode::Logc:
+    case AluScalarOpcode::Log:
+        return true;
+    }
+
+    return false;
+}
+
+static float clampResult(double value)
+{
+    return float(std::clamp(value, double(-FLT_MAX), double(FLT_MAX)));
+}
+
+static RangeValue evaluateVectorRange(const IrShader& shader, const RangeState& state, const IrAlu& alu)
+{
+    RangeValue sources[3] = { { RangeKind::Unbounded }, { RangeKind::Unbounded }, { RangeKind::Unbounded } };
+    for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+        sources[i] = getRange(shader, state, alu.vectorSources[i]);
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Add:
+        return addRanges(sources[0], sources[1]);
+
+    case AluVectorOpcode::Mul:
+        return alu.vectorSources[0] == alu.vectorSources[1] ? squareRange(sources[0]) : mulRanges(sources[0], sources[1]);
+
+    case AluVectorOpcode::Max:
+    case AluVectorOpcode::MaxA:
+        return combineRanges(sources[0], sources[1], [](const RangeValue& a, const RangeValue& b) { return makeRange(std::max(a.min, b.min), std::max(a.max, b.max)); });
+
+    case AluVectorOpcode::Min:
+        return combineRanges(sources[0], sources[1], [](const RangeValue& a, const RangeValue& b) { return makeRange(std::min(a.min, b.min), std::min(a.max, b.max)); });
+
+    case AluVectorOpcode::Seq:
+    case AluVectorOpcode::Sgt:
+    case AluVectorOpcode::Sge:
+    case AluVectorOpcode::Sne:
+    case AluVectorOpcode::KillEq:
+    case AluVectorOpcode::KillGt:
+    case AluVectorOpcode::KillGe:
+    case AluVectorOpcode::KillNe:
+        return constantRange(unionRanges(sources[0], sources[1]), 0.0f, 1.0f);
+
+    case AluVectorOpcode::Frc:
+        return combineRanges(sources[0], sources[0], [](const RangeValue&, const RangeValue&) { return makeRange(0.0f, 1.0f); });
+
+    case AluVectorOpcode::Trunc:
+        return mapRange(sources[0], [](float value) { return std::trunc(value); });
+
+    case AluVectorOpcode::Floor:
+        return mapRange(sources[0], [](float value) { return std::floor(value); });
+
+    case AluVectorOpcode::Mad:
+        return addRanges(alu.vectorSources[0] == alu.vectorSources[1] ? squareRange(sources[0]) : mulRanges(sources[0], sources[1]), sources[2]);
+
+    case AluVectorOpcode::CndEq:
+    case AluVectorOpcode::CndGe:
+    case AluVectorOpcode::CndGt:
+        if (sources[0].kind == RangeKind::Undefined)
+            return {};
+
+        return unionRanges(sources[1], sources[2]);
+
+    case AluVectorOpcode::Dp4:
+    case AluVectorOpcode::Dp3:
+        return dotRange(shader, state, alu.vectorSources[0], alu.vectorSources[1]);
+
+    case AluVectorOpcode::Dp2Add:
+        return addRanges(dotRange(shader, state, alu.vectorSources[0], alu.vectorSources[1]), sources[2]);
+
+    case AluVectorOpcode::Max4:
+        return sources[0];
+
+    case AluVectorOpcode::SetpEqPush:
+    case AluVectorOpcode::SetpNePush:
+    case AluVectorOpcode::SetpGtPush:
+    case AluVectorOpcode::SetpGePush:
+        return unionRanges(addRanges(sources[0], makeRange(1.0f, 1.0f)), makeRange(0.0f, 0.0f));
+
+    case AluVectorOpcode::Dst:
+        return unionRanges(unionRanges(mulRanges(sources[0], sources[1]), unionRanges(sources[0], sources[1])), makeRange(1.0f, 1.0f));
+    }
+
+    return { RangeKind::Unbounded };
+}
+
+static RangeValue evaluateScalarRange(const IrShader& shader, const RangeState& state, const IrAlu& alu)
+{
+    RangeValue sources[2] = { { RangeKind::Unbounded }, { RangeKind::Unbounded } };
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+        sources[i] = getRange(shader, state, alu.scalarSources[i]);
+
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::Adds:
+    case AluScalarOpcode::Addsc0:
+    case AluScalarOpcode::Addsc1:
+        return addRanges(sources[0], sources[1]);
+
+    case AluScalarOpcode::AddsPrev:
+        return addRanges(sources[0], state.ps);
+
+    case AluScalarOpcode::Muls:
+    case AluScalarOpcode::Mulsc0:
+    case AluScalarOpcode::Mulsc1:
+        return alu.scalarSources[0] == alu.scalarSources[1] ? squareRange(sources[0]) : mulRanges(sources[0], sources[1]);
+
+    case AluScalarOpcode::MulsPrev:
+    case AluScalarOpcode::MulsPrev2:
+        return mulRanges(sources[0], state.ps);
+
+    case AluScalarOpcode::Subs:
+    case AluScalarOpcode::Subsc0:
+    case AluScalarOpcode::Subsc1:
+        return combineRanges(sources[0], sources[1], [](const RangeValue& a, const RangeValue& b) { return makeRange(a.min - b.max, a.max - b.min); });
+
+    case AluScalarOpcode::SubsPrev:
+        return combineRanges(sources[0], state.ps, [](const RangeValue& a, const RangeValue& b) { return makeRange(a.min - b.max, a.max - b.min); });
+
+    case AluScalarOpcode::Maxs:
+    case AluScalarOpcode::MaxAs:
+    case AluScalarOpcode::MaxAsf:
+        return combineRanges(sources[0], sources[1], [](const RangeValue& a, const RangeValue& b) { return makeRange(std::max(a.min, b.min), std::max(a.max, b.max)); });
+
+    case AluScalarOpcode::Mins:
+        return combineRanges(sources[0], sources[1], [](const RangeValue& a, const RangeValue& b) { return makeRange(std::min(a.min, b.min), std::min(a.max, b.max)); });
+
+    case AluScalarOpcode::Seqs:
+    case AluScalarOpcode::Sgts:
+    case AluScalarOpcode::Sges:
+    case AluScalarOpcode::Snes:
+    case AluScalarOpcode::KillsEq:
+    case AluScalarOpcode::KillsGt:
+    case AluScalarOpcode::KillsGe:
+    case AluScalarOpcode::KillsNe:
+    case AluScalarOpcode::KillsOne:
+    case AluScalarOpcode::SetpEq:
+    case AluScalarOpcode::SetpNe:
+    case AluScalarOpcode::SetpGt:
+    case AluScalarOpcode::SetpGe:
+        return constantRange(sources[0], 0.0f, 1.0f);
+
+    case AluScalarOpcode::Frcs:
+        return combineRanges(sources[0], sources[0], [](const RangeValue&, const RangeValue&) { return makeRange(0.0f, 1.0f); });
+
+    case AluScalarOpcode::Truncs:
+        return mapRange(sources[0], [](float value) { return std::trunc(value); });
+
+    case AluScalarOpcode::Floors:
+        return mapRange(sources[0], [](float value) { return std::floor(value); });
+
+    case AluScalarOpcode::Exp:
+        return mapRange(sources[0], [](float value) { return std::exp2(value); });
+
+    // Denormal inputs are flushed to zero, so only normal inputs give finite results.
+    case AluScalarOpcode::Logc:
+    case AluScalarOpcode::Log:
+        if (sources[0].kind == RangeKind::Bounded && sources[0].min >= FLT_MIN)
+            return makeRange(clampResult(std::log2(double(sources[0].min))), clampResult(std::log2(double(sources[0].max))));
+
+        return constantRange(sources[0], -FLT_MAX, FLT_MAX);
+
+    case AluScalarOpcode::Rcpc:
+    case AluScalarOpcode::Rcpf:
+    case AluScalarOpcode::Rcp:
+        if (sources[0].kind == RangeKind::Bounded && sources[0].min >= FLT_MIN)
+            return makeRange(clampResult(1.0 / sources[0].max), clampResult(1.0 / sources[0].min));
+
+        return constantRange(sources[0], -FLT_MAX, FLT_MAX);
+
+    case AluScalarOpcode::Rsqc:
+    case AluScalarOpcode::Rsqf:
+    case AluScalarOpcode::Rsq:
+        if (sources[0].kind == RangeKind::Bounded && sources[0].min >= FLT_MIN)
+            return makeRange(clampResult(1.0 / std::sqrt(double(sources[0].max))), clampResult(1.0 / std::sqrt(double(sources[0].min))));
+
+        return constantRange(sources[0], -FLT_MAX, FLT_MAX);
+
+    case AluScalarOpcode::SetpInv:
+        return unionRanges(sources[0], makeRange(1.0f, 1.0f));
+
+    case AluScalarOpcode::SetpPop:
+        return unionRanges(addRanges(sources[0], makeRange(-1.0f, -1.0f)), makeRange(0.0f, 0.0f));
+
+    case AluScalarOpcode::SetpClr:
+        return makeRange(FLT_MAX, FLT_MAX);
+
+    case AluScalarOpcode::SetpRstr:
+        return unionRanges(sources[0], makeRange(0.0f, 0.0f));
+
+    case AluScalarOpcode::Sqrt:
+        if (sources[0].kind == RangeKind::Bounded && sources[0].min < 0.0f)
+            return { RangeKind::Unbounded };
+
+        return mapRange(sources[0], [](float value) { return std::sqrt(value); });
+
+    case AluScalarOpcode::Sin:
+    case AluScalarOpcode::Cos:
+        return combineRanges(sources[0], sources[0], [](const RangeValue&, const RangeValue&) { return makeRange(-1.0f, 1.0f); });
+    }
+
+    return { RangeKind::Unbounded };
+}
+
+// a0 is loaded as the rounded or floored source clamped to [-256, 255], which also takes care of NaN.
+static RangeValue addressRange(const RangeValue& source, bool round)
+{
+    if (source.kind != RangeKind::Bounded)
+        return constantRange(source, -256.0f, 255.0f);
+
+    float offset = round ? 0.5f : 0.0f;
+    return { RangeKind::Bounded, std::clamp(std::floor(source.min + offset), -256.0f, 255.0f), std::clamp(std::floor(source.max + offset), -256.0f, 255.0f) };
+}
+
+static void setIndexRange(IrOperand& operand, const RangeValue& range)
+{
+    operand.isIndexBounded = range.kind == RangeKind::Bounded;
+    operand.minIndex = operand.isIndexBounded ? int16_t(range.min) : 0;
+    operand.maxIndex = operand.isIndexBounded ? int16_t(range.max) : 0;
+}
+
+// Mirrors the emitted HLSL rather than the Xenos ALU, as the ranges decide which of its clamps can be left out.
+static void propagateRanges(const IrShader& shader, IrInstruction& instr, RangeState& state)
+{
+    if (instr.isDead)
+        return;
+
+    auto write = [&](RangeValue& destination, const RangeValue& value)
+        {
+            if (instr.isPredicated)
+                destination.meet(value);
+            else
+                destination = value;
+        };
+
+    auto writeFetch = [&](uint8_t dstRegister, uint16_t dstSwizzle)
+        {
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                switch (FetchDestinationSwizzle((dstSwizzle >> (i * 3)) & 0x7))
+                {
+                case FetchDestinationSwizzle::Zero:
+                    write(state.registers[dstRegister][i], makeRange(0.0f, 0.0f));
+                    break;
+                case FetchDestinationSwizzle::One:
+                    write(state.registers[dstRegister][i], makeRange(1.0f, 1.0f));
+                    break;
+                case FetchDestinationSwizzle::Keep:
+                    break;
+                default:
+                    write(state.registers[dstRegister][i], { RangeKind::Unbounded });
+                    break;
+                }
+            }
+        };
+
+    switch (instr.kind)
+    {
+    case IrInstructionKind::VertexFetch:
+        writeFetch(instr.vertexFetch.dstRegister, instr.vertexFetch.dstSwizzle);
+        return;
+
+    case IrInstructionKind::TextureFetch:
+        if (instr.textureFetch.isSupported())
+            writeFetch(instr.textureFetch.dstRegister, instr.textureFetch.dstSwizzle);
+        return;
+    }
+
+    auto& alu = instr.alu;
+
+    auto markIndices = [&](IrOperand* operands, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (operands[i].isConstant && operands[i].addressing == IrAddressing::A0)
+                    setIndexRange(operands[i], state.a0);
+            }
+        };
+
+    // a0 is loaded before the vector operation is emitted, and after the scalar one.
+    if (alu.vectorOpcode == AluVectorOpcode::MaxA)
+        write(state.a0, addressRange(getRange(shader, state, alu.vectorSources[0]), true));
+
+    markIndices(alu.vectorSources, alu.vectorSourceCount);
+
+    RangeValue vectorRange;
+    if (alu.vectorOpcode == AluVectorOpcode::Cube)
+        vectorRange = { RangeKind::Unbounded };
+    else
+        vectorRange = evaluateVectorRange(shader, state, alu);
+
+    if (alu.vectorSaturate)
+        vectorRange = saturateRange(vectorRange);
+
+    if (!alu.exportData)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if ((alu.vectorWriteMask >> i) & 0x1)
+                write(state.registers[alu.vectorDest][i], vectorRange);
+        }
+    }
+
+    // The scalar operation is emitted after the vector write, so its sources see the new value.
+    markIndices(alu.scalarSources, alu.scalarSourceCount);
+
+    if (alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+    {
+        RangeValue source = alu.scalarSourceCount != 0 ? getRange(shader, state, alu.scalarSources[0]) : RangeValue{ RangeKind::Unbounded };
+        alu.omitScalarClamp = isClampRedundant(alu.scalarOpcode, source);
+
+        RangeValue ps = evaluateScalarRange(shader, state, alu);
+        if (alu.scalarSaturate)
+            ps = saturateRange(ps);
+
+        if (alu.scalarOpcode == AluScalarOpcode::MaxAs || alu.scalarOpcode == AluScalarOpcode::MaxAsf)
+            write(state.a0, addressRange(source, alu.scalarOpcode == AluScalarOpcode::MaxAs));
+
+        write(state.ps, ps);
+    }
+
+    if (!alu.exportData)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            if ((alu.scalarWriteMask >> i) & 0x1)
+                write(state.registers[alu.scalarDest][i], state.ps);
+        }
+    }
+}
+
+struct StructureEscape
+{
+    uint32_t flag = 0;
+    uint32_t target = 0;
+};
+
+struct StructureLoop
+{
+    uint32_t header = UINT32_MAX;
+    uint32_t continueTarget = UINT32_MAX;
+    uint32_t breakTarget = UINT32_MAX;
+    uint32_t end = 0;
+    size_t firstStatement = 0;
+    std::vector<uint32_t> flags;
+    std::vector<StructureEscape> exits;
+
+    // Live instructions in the body, with nested loops multiplied by their trip count.
+    uint32_t cost = 0;
+};
+
+// Counted loops get unrolled if their trip count times the cost of their body stays within this limit.
+static constexpr uint32_t LOOP_UNROLL_LIMIT = 256;
+
+// Recovers structured statements by treating the control flow as nested intervals of nodes. Forward jumps open if
+// blocks, backward jumps close loops headed by their target, and jumps to the ends of loops become breaks and
+// continues. Other forward jumps set a flag and break out of the loops they leave. Anything else (eg. jumps into
+// a loop) is rejected. Unreachable nodes are skipped, as they would otherwise break the nesting.
+struct StructureBuilder
+{
+    IrShader& shader;
+    std::vector<StructureLoop> loops;
+    std::vector<bool> reachable;
+
+    void add(IrStatementKind kind, uint32_t node = 0, bool taken = false, uint32_t flag = 0)
+    {
+        auto& statement = shader.statements.emplace_back();
+        statement.kind = kind;
+        statement.node = node;
+        statement.flag = flag;
+        statement.taken = taken;
+    }
+
+    bool isJump(uint32_t node, uint32_t target) const
+    {
+        return reachable[node] && shader.nodes[node].opcode == ControlFlowOpcode::CondJmp && shader.nodes[node].address == target;
+    }
+
+    bool build()
+    {
+        std::vector<bool> reachableBlocks(shader.blocks.size());
+        std::vector<uint32_t> stack;
+
+        if (!shader.blocks.empty())
+        {
+            reachableBlocks[0] = true;
+            stack.push_back(0);
+        }
+
+        while (!stack.empty())
+        {
+            auto& block = shader.blocks[stack.back()];
+            stack.pop_back();
+
+            for (uint32_t i = 0; i < block.successorCount; i++)
+            {
+                if (!reachableBlocks[block.successors[i]])
+                {
+                    reachableBlocks[block.successors[i]] = true;
+                    stack.push_back(block.successors[i]);
+                }
+            }
+        }
+
+        reachable.resize(shader.nodes.size());
+        for (size_t i = 0; i < shader.nodes.size(); i++)
+            reachable[i] = reachableBlocks[shader.nodeBlocks[i]];
+
+        auto& loop = loops.emplace_back();
+        loop.end = uint32_t(shader.nodes.size());
+
+        std::vector<StructureEscape> escapes;
+        if (!buildRegion(0, loop.end, {}, escapes))
+            return false;
+
+        declareFlags();
+        return true;
+    }
+
+    // Flags are declared at the start of the loop body containing their target, so they reset every iteration.
+    void declareFlags()
+    {
+        auto& loop = loops.back();
+        std::vector<IrStatement> declarations(loop.flags.size());
+        for (size_t i = 0; i < loop.flags.size(); i++)
+        {
+            declarations[i].kind = IrStatementKind::DeclareFlag;
+            declarations[i].flag = loop.flags[i];
+        }
+
+        shader.statements.insert(shader.statements.begin() + loop.firstStatement, declarations.begin(), declarations.end());
+        loops.pop_back();
+    }
+
+    bool buildLoop(uint32_t begin, uint32_t end, uint32_t header, uint32_t continueTarget, uint32_t breakTarget, uint32_t tripCount,
+        std::vector<StructureEscape>& exits, uint32_t& cost)
+    {
+        auto& loop = loops.emplace_back();
+        loop.header = header;
+        loop.continueTarget = continueTarget;
+        loop.breakTarget = breakTarget;
+        loop.end = end;
+        loop.firstStatement = shader.statements.size();
+
+        std::vector<StructureEscape> escapes;
+        if (!buildRegion(begin, end, {}, escapes))
+            return false;
+
+        assert(escapes.empty());
+        exits = std::move(loops.back().exits);
+        cost = uint32_t(std::min<uint64_t>(uint64_t(loops.back().cost) * tripCount, UINT32_MAX));
+        declareFlags();
+
+        loops.back().cost = uint32_t(std::min<uint64_t>(uint64_t(loops.back().cost) + cost, UINT32_MAX));
+        return true;
+    }
+
+    // Jumps that left a loop either continue in the enclosing loop body, or break out of it as well.
+    void addLoopExits(const std::vector<StructureEscape>& exits, std::vector<StructureEscape>& pending)
+    {
+        for (auto& exit : exits)
+        {
+            auto& loop = loops.back();
+            if (exit.target > loop.end)
+            {
+                add(IrStatementKind::IfFlag, 0, false, exit.flag);
+                add(IrStatementKind::Break);
+                add(IrStatementKind::EndIf);
+
+                loop.exits.push_back(exit);
+            }
+            else
+            {
+                pending.push_back(exit);
+            }
+        }
+    }
+
+    bool buildRegion(uint32_t begin, uint32_t end, std::vector<StructureEscape> pending, std::vector<StructureEscape>& escapes)
+    {
+        uint32_t pc = begin;
+
+        while (true)
+        {
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const StructureEscape& escape) { return escape.target == pc; }), pending.end());
+
+            if (pc == end)
+            {
+                escapes.insert(escapes.end(), pending.begin(), pending.end());
+                return true;
+            }
+
+            // Nodes skipped by jumps that left a nested region are guarded by their flags, outermost target first.
+            if (!pending.empty())
+            {
+                auto outermost = std::max_element(pending.begin(), pending.end(),
+                    [](const StructureEscape& lhs, const StructureEscape& rhs) { return lhs.target < rhs.target; });
+
+                StructureEscape escape = *outermost;
+                pending.erase(outermost);
+
+                uint32_t guardEnd = std::min(escape.target, end);
+                std::vector<StructureEscape> nested;
+
+                add(IrStatementKind::IfNotFlag, 0, false, escape.flag);
+                if (!buildRegion(pc, guardEnd, std::move(pending), nested))
+                    return false;
+                add(IrStatementKind::EndIf);
+
+                if (escape.target > end)
+                    escapes.push_back(escape);
+
+                pending = std::move(nested);
+                pc = guardEnd;
+                continue;
+            }
+
+            // Loops are headed by the target of their last backward jump. The loop itself is excluded, as the other
+            // backward jumps to its header are continues.
+            auto& loop = loops.back();
+            uint32_t latch = UINT32_MAX;
+            uint32_t headerJumpCount = 0;
+
+            if (pc != loop.header)
+            {
+                for (uint32_t i = pc; i < end; i++)
+                {
+                    if (isJump(i, pc))
+                    {
+                        latch = i;
+                        ++headerJumpCount;
+                    }
+                }
+            }
+
+            if (latch != UINT32_MAX)
+            {
+                std::vector<StructureEscape> exits;
+                uint32_t cost;
+
+                if (!shader.nodes[latch].isUnconditional && headerJumpCount == 1)
+                {
+                    add(IrStatementKind::DoWhile);
+                    if (!buildLoop(pc, latch, pc, latch, latch + 1, 1, exits, cost))
+                        return false;
+                    add(IrStatementKind::EndDoWhile, latch, true);
+                }
+                else
+                {
+                    add(IrStatementKind::WhileTrue);
+                    if (!buildLoop(pc, latch, pc, pc, latch + 1, 1, exits, cost))
+                        return false;
+
+                    if (!shader.nodes[latch].isUnconditional)
+                    {
+                        add(IrStatementKind::If, latch, false);
+                        add(IrStatementKind::Break);
+                        add(IrStatementKind::EndIf);
+                    }
+
+                    add(IrStatementKind::EndWhile);
+                }
+
+                addLoopExits(exits, pending);
+                pc = latch + 1;
+                continue;
+            }
+
+            auto& node = shader.nodes[pc];
+
+            if (!reachable[pc])
+            {
+                ++pc;
+                continue;
+            }
+
+            switch (node.opcode)
+            {
+            case ControlFlowOpcode::LoopStart:
+            {
+                uint32_t loopEnd = node.address - 1;
+                if (node.address == 0 || loopEnd <= pc || loopEnd >= end || shader.nodes[loopEnd].opcode != ControlFlowOpcode::LoopEnd || shader.nodes[loopEnd].address != pc + 1)
+                    return false;
+
+                bool isConstant = shader.definedLoopConstants.test(node.loopId);
+                uint32_t tripCount = isConstant ? shader.loopConstants[node.loopId] & 0xFF : 1;
+
+                std::vector<StructureEscape> exits;
+                uint32_t cost;
+                size_t statement = shader.statements.size();
+
+                add(IrStatementKind::Loop, pc);
+                if (!buildLoop(pc + 1, loopEnd, UINT32_MAX, loopEnd, loopEnd + 1, tripCount, exits, cost))
+                    return false;
+                add(IrStatementKind::EndLoop, loopEnd);
+
+                shader.statements[statement].unroll = isConstant && cost <= LOOP_UNROLL_LIMIT;
+
+                addLoopExits(exits, pending);
+
+                pc = loopEnd + 1;
+                break;
+            }
+
+            case ControlFlowOpcode::LoopEnd:
+                return false;
+
+            case ControlFlowOpcode::CondJmp:
+            {
+                uint32_t target = node.address;
+
+                if (!node.isUnconditional && target > pc && target <= end)
+                {
+                    // The then block of an if/else ends with an unconditional jump over the else block.
+                    uint32_t elseJump = target - 1;
+                    auto& elseNode = shader.nodes[elseJump];
+                    bool hasElse = elseJump > pc && elseNode.opcode == ControlFlowOpcode::CondJmp && elseNode.isUnconditional &&
+                        elseNode.address > target && elseNode.address <= end;
+
+                    std::vector<StructureEscape> nested;
+
+                    add(IrStatementKind::If, pc, false);
+                    if (!buildRegion(pc + 1, hasElse ? elseJump : target, {}, nested))
+                        return false;
+
+                    if (hasElse)
+                    {
+                        uint32_t merge = elseNode.address;
+                        for (auto& escape : nested)
+                        {
+                            // Jumping from the then block into the else block does not nest.
+                            if (escape.target > elseJump && escape.target < merge)
+                                return false;
+                        }
+
+                        nested.erase(std::remove_if(nested.begin(), nested.end(), [&](const StructureEscape& escape) { return escape.target == elseJump; }), nested.end());
+
+                        add(IrStatementKind::Else);
+                        if (!buildRegion(target, merge, {}, nested))
+                            return false;
+
+                        target = merge;
+                    }
+
+                    add(IrStatementKind::EndIf);
+
+                    pending = std::move(nested);
+                    pc = target;
+                    break;
+                }
+
+                if (target == loop.breakTarget || target == loop.continueTarget)
+                {
+                    auto kind = target == loop.breakTarget ? IrStatementKind::Break : IrStatementKind::Continue;
+                    if (node.isUnconditional)
+                    {
+                        add(kind);
+                    }
+                    else
+                    {
+                        add(IrStatementKind::If, pc, true);
+                        add(kind);
+                        add(IrStatementKind::EndIf);
+                    }
+
+                    ++pc;
+                    break;
+                }
+
+                // Backward jumps are only valid as loops and continues.
+                if (target <= pc)
+                    return false;
+
+                // While loops are entered by jumping to their condition at the end.
+                if (node.isUnconditional && target < end && isJump(target, pc + 1) && !shader.nodes[target].isUnconditional)
+                {
+                    std::vector<StructureEscape> exits;
+                    uint32_t cost;
+
+                    add(IrStatementKind::While, target, true);
+                    if (!buildLoop(pc + 1, target, UINT32_MAX, target, target + 1, 1, exits, cost))
+                        return false;
+                    add(IrStatementKind::EndWhile);
+
+                    addLoopExits(exits, pending);
+
+                    pc = target + 1;
+                    break;
+                }
+
+                // Any other forward jump skips the following nodes using a flag, which is declared in the loop
+                // containing the target.
+                size_t depth = loops.size() - 1;
+                while (target > loops[depth].end)
+                {
+                    if (depth == 0)
+                        return false;
+
+                    --depth;
+                }
+
+                uint32_t flag = shader.flagCount++;
+                loops[depth].flags.push_back(flag);
+
+                add(IrStatementKind::SetFlag, pc, true, flag);
+
+                if (depth != loops.size() - 1)
+                {
+                    add(IrStatementKind::IfFlag, 0, false, flag);
+                    add(IrStatementKind::Break);
+                    add(IrStatementKind::EndIf);
+
+                    loops.back().exits.push_back({ flag, target });
+                }
+                else
+                {
+                    pending.push_back({ flag, target });
+                }
+
+                ++pc;
+                break;
+            }
+
+            default:
+                if (node.instructionCount != 0 || node.isEnd)
+                {
+                    for (uint32_t i = 0; i < node.instructionCount; i++)
+                        loops.back().cost += !shader.instructions[node.firstInstruction + i].isDead;
+
+                    add(IrStatementKind::Node, pc);
+                    if (node.isEnd && loops.size() > 1)
+                        shader.endsInsideLoop = true;
+                }
+
+                ++pc;
+                break;
+            }
+        }
+    }
+};
+
+void IrShader::removeExports(uint64_t exportMask)
+{
+    for (auto& instr : instructions)
+    {
+        auto& alu = instr.alu;
+        if (instr.kind != IrInstructionKind::Alu || !alu.exportData || alu.vectorDest >= 64 || ((exportMask >> alu.vectorDest) & 0x1) == 0)
+            continue;
+
+        alu.exportData = false;
+        alu.vectorWriteMask = 0;
+        alu.scalarWriteMask = 0;
+        alu.exportZeroMask = 0;
+        alu.exportOneMask = 0;
+
+        // The scalar operation still sets ps, which liveness removes if nothing reads it.
+        bool hasSideEffects = (alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::KillNe) ||
+            alu.vectorOpcode >= AluVectorOpcode::MaxA;
+
+        if (!hasSideEffects)
+        {
+            alu.vectorSourceCount = 0;
+            instr.isDead = alu.scalarOpcode == AluScalarOpcode::RetainPrev;
+        }
+
+        computeAluAccesses(instr);
+    }
+}
+
+void IrShader::analyze()
+{
+    auto predecessors = getPredecessors(blocks);
+
+    // Forward propagation of known register values, starting from unknown registers at the entry. Blocks are
+    // simulated on copies until the state at their ends stops changing, after which the instructions get rewritten.
+    // Removing dead writes narrows write masks and can expose new folds, so both passes alternate until neither
+    // changes anything.
+    std::vector<ConstantState> constantsOut(blocks.size());
+
+    auto getConstantsIn = [&](size_t index)
+        {
+            ConstantState state;
+            if (index == 0)
+            {
+                for (auto& lanes : state.registers)
+                {
+                    for (auto& lane : lanes)
+                        lane.kind = ConstantKind::Unknown;
+                }
+
+                state.ps.kind = ConstantKind::Unknown;
+            }
+
+            for (uint32_t predecessor : predecessors[index])
+                state.meet(constantsOut[predecessor]);
+
+            return state;
+        };
+
+    auto forEachForwardInstruction = [&](const IrBlock& block, auto&& function)
+        {
+            for (uint32_t i = 0; i < block.nodeCount; i++)
+            {
+                auto& node = nodes[block.firstNode + i];
+                for (uint32_t j = 0; j < node.instructionCount; j++)
+                    function(instructions[node.firstInstruction + j]);
+            }
+        };
+
+    // Backward liveness over the blocks, after which dead writes are removed. Removing writes can make the
+    // instructions computing their sources dead too, so this repeats until nothing changes.
+    std::vector<LiveSet> liveIn(blocks.size());
+
+    auto getLiveOut = [&](const IrBlock& block)
+        {
+            LiveSet live;
+            for (uint32_t i = 0; i < block.successorCount; i++)
+                live.merge(liveIn[block.successors[i]]);
+
+            return live;
+        };
+
+    auto forEachInstruction = [&](const IrBlock& block, auto&& function)
+        {
+            for (uint32_t i = block.nodeCount; i > 0; i--)
+            {
+                auto& node = nodes[block.firstNode + i - 1];
+                for (uint32_t j = node.instructionCount; j > 0; j--)
+                    function(instructions[node.firstInstruction + j - 1]);
+            }
+        };
+
+    bool simplified = true;
+    while (simplified)
+    {
+        simplified = false;
+
+        std::fill(constantsOut.begin(), constantsOut.end(), ConstantState());
+
+        bool propagated = true;
+        while (propagated)
+        {
+            propagated = false;
+
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                ConstantState state = getConstantsIn(i);
+                forEachForwardInstruction(blocks[i], [&](const IrInstruction& instr)
+                    {
+                        IrInstruction copy = instr;
+                        propagateConstants(*this, copy, state);
+                    });
+
+                if (!(state == constantsOut[i]))
+                {
+                    constantsOut[i] = state;
+                    propagated = true;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            ConstantState state = getConstantsIn(i);
+            forEachForwardInstruction(blocks[i], [&](IrInstruction& instr)
+                {
+                    IrAlu alu = instr.alu;
+                    propagateConstants(*this, instr, state);
+                    simplified |= instr.kind == IrInstructionKind::Alu && !isSameAlu(alu, instr.alu);
+                });
+        }
+
+        bool eliminated = true;
+        while (eliminated)
+        {
+            std::fill(liveIn.begin(), liveIn.end(), LiveSet());
+
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+
+                for (size_t i = blocks.size(); i > 0; i--)
+                {
+                    auto& block = blocks[i - 1];
+                    LiveSet live = getLiveOut(block);
+                    forEachInstruction(block, [&](IrInstruction& instr) { transfer(live, instr); });
+
+                    if (!(live == liveIn[i - 1]))
+                    {
+                        liveIn[i - 1] = live;
+                        changed = true;
+                    }
+                }
+            }
+
+            eliminated = false;
+
+            for (auto& block : blocks)
+            {
+                LiveSet live = getLiveOut(block);
+                forEachInstruction(block, [&](IrInstruction& instr)
+                    {
+                        if (eliminate(instr, live))
+                        {
+                            eliminated = true;
+                            simplified = true;
+                        }
+
+                        transfer(live, instr);
+                    });
+            }
+        }
+    }
+
+    // Forward interval analysis of the values left after simplification, with the same block iteration as constant
+    // propagation. Lanes that keep changing are widened to unbounded so that loops terminate.
+    std::vector<RangeState> rangesOut(blocks.size());
+    std::vector<uint32_t> rangeUpdates(blocks.size());
+
+    auto getRangesIn = [&](size_t index)
+        {
+            RangeState state;
+            if (index == 0)
+            {
+                for (auto& lanes : state.registers)
+                {
+                    for (auto& lane : lanes)
+                        lane.kind = RangeKind::Unbounded;
+                }
+
+                state.ps.kind = RangeKind::Unbounded;
+                state.a0 = makeRange(0.0f, 0.0f);
+            }
+
+            for (uint32_t predecessor : predecessors[index])
+                state.meet(rangesOut[predecessor]);
+
+            return state;
+        };
+
+    bool ranged = true;
+    while (ranged)
+    {
+        ranged = false;
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            RangeState state = getRangesIn(i);
+            forEachForwardInstruction(blocks[i], [&](const IrInstruction& instr)
+                {
+                    IrInstruction copy = instr;
+                    propagateRanges(*this, copy, state);
+                });
+
+            if (!(state == rangesOut[i]))
+            {
+                if (++rangeUpdates[i] > RANGE_WIDENING_LIMIT)
+                    state.widen(rangesOut[i]);
+
+                rangesOut[i] = state;
+                ranged = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        RangeState state = getRangesIn(i);
+        forEachForwardInstruction(blocks[i], [&](IrInstruction& instr) { propagateRanges(*this, instr, state); });
+    }
+
+    usedConstants.reset();
+    usedRegisters = 0;
+    usedState = 0;
+
+    for (auto& instr : instructions)
+    {
+        if (instr.isDead)
+            continue;
+
+        if (instr.kind == IrInstructionKind::Alu)
+        {
+            auto markConstant = [&](const IrOperand& operand)
+                {
+                    if (operand.isConstant && !operand.isLiteral)
+                        usedConstants.set(operand.reg);
+                };
+
+            for (uint32_t i = 0; i < instr.alu.vectorSourceCount; i++)
+                markConstant(instr.alu.vectorSources[i]);
+
+            for (uint32_t i = 0; i < instr.alu.scalarSourceCount; i++)
+                markConstant(instr.alu.scalarSources[i]);
+        }
+
+        for (uint32_t i = 0; i < instr.readCount; i++)
+            usedRegisters |= 1ull << instr.reads[i].reg;
+
+        for (uint32_t i = 0; i < instr.writeCount; i++)
+            usedRegisters |= 1ull << instr.writes[i].reg;
+
+        usedState |= instr.stateReads | instr.stateWrites;
+    }
+
+    for (auto& node : nodes)
+    {
+        if (node.opcode == ControlFlowOpcode::LoopStart || node.opcode == ControlFlowOpcode::LoopEnd)
+            usedState |= IR_STATE_AL;
+        else if (node.opcode == ControlFlowOpcode::CondJmp && node.isPredicated)
+            usedState |= IR_STATE_P0;
+    }
+
+    // Forward must-analysis of export writes. Blocks start out fully written so that the intersection over
+    // predecessors is only narrowed by paths that were actually visited.
+    struct ExportSet
+    {
+        uint8_t masks[64];
+    };
+
+    ExportSet full;
+    memset(full.masks, 0xF, sizeof(full.masks));
+
+    std::vector<ExportSet> exportsOut(blocks.size(), full);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            ExportSet exports{};
+            if (i != 0)
+            {
+                exports = full;
+                for (uint32_t predecessor : predecessors[i])
+                {
+                    for (size_t j = 0; j < std::size(exports.masks); j++)
+                        exports.masks[j] &= exportsOut[predecessor].masks[j];
+                }
+            }
+
+            auto& block = blocks[i];
+            for (uint32_t j = 0; j < block.nodeCount; j++)
+            {
+                auto& node = nodes[block.firstNode + j];
+                for (uint32_t k = 0; k < node.instructionCount; k++)
+                {
+                    auto& instr = instructions[node.firstInstruction + k];
+                    if (instr.kind == IrInstructionKind::Alu && instr.alu.exportData && !instr.isPredicated)
+                    {
+                        auto& alu = instr.alu;
+                        exports.masks[alu.vectorDest] |= alu.vectorWriteMask | alu.scalarWriteMask | alu.exportZeroMask | alu.exportOneMask;
+                    }
+                }
+            }
+
+            if (memcmp(&exports, &exportsOut[i], sizeof(ExportSet)) != 0)
+            {
+                exportsOut[i] = exports;
+                changed = true;
+            }
+        }
+    }
+
+    bool hasExit = false;
+    memset(writtenExports, 0xF, sizeof(writtenExports));
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        auto& block = blocks[i];
+        if (block.successorCount == 0)
+        {
+            for (size_t j = 0; j < std::size(writtenExports); j++)
+                writtenExports[j] &= exportsOut[i].masks[j];
+
+            hasExit = true;
+        }
+    }
+
+    if (!hasExit)
+        memset(writtenExports, 0, sizeof(writtenExports));
+
+    statements.clear();
+    flagCount = 0;
+    endsInsideLoop = false;
+
+    StructureBuilder builder{ *this };
+    isStructured = builder.build();
+
+    // aL is only bounded inside counted loops with literal bounds that contain no other counted loop, as nested loops
+    // share the register. The loop bodies are found through the structured statements, but the pc dispatcher steps aL
+    // the same way, so the ranges hold for either lowering.
+    if (isStructured)
+    {
+        std::vector<bool> hasNestedLoop(statements.size());
+        std::vector<size_t> loopStack;
+
+        for (size_t i = 0; i < statements.size(); i++)
+        {
+            if (statements[i].kind == IrStatementKind::Loop)
+            {
+                if (!loopStack.empty())
+                    hasNestedLoop[loopStack.back()] = true;
+
+                loopStack.push_back(i);
+            }
+            else if (statements[i].kind == IrStatementKind::EndLoop)
+            {
+                loopStack.pop_back();
+            }
+        }
+
+        for (size_t i = 0; i < statements.size(); i++)
+        {
+            auto& statement = statements[i];
+            if (statement.kind == IrStatementKind::Loop)
+            {
+                loopStack.push_back(i);
+            }
+            else if (statement.kind == IrStatementKind::EndLoop)
+            {
+                loopStack.pop_back();
+            }
+            else if (statement.kind == IrStatementKind::Node && !loopStack.empty() && !hasNestedLoop[loopStack.back()])
+            {
+                uint32_t loopId = nodes[statements[loopStack.back()].node].loopId;
+                uint32_t count = loopConstants[loopId] & 0xFF;
+                if (!definedLoopConstants.test(loopId) || count == 0)
+                    continue;
+
+                float start = float((loopConstants[loopId] >> 8) & 0xFF);
+                float last = start + float(int8_t(loopConstants[loopId] >> 16)) * (count - 1);
+                RangeValue range = makeRange(std::min(start, last), std::max(start, last));
+
+                auto& node = nodes[statement.node];
+                for (uint32_t j = 0; j < node.instructionCount; j++)
+                {
+                    auto& instr = instructions[node.firstInstruction + j];
+                    if (instr.isDead || instr.kind != IrInstructionKind::Alu)
+                        continue;
+
+                    for (uint32_t k = 0; k < instr.alu.vectorSourceCount; k++)
+                    {
+                        if (instr.alu.vectorSources[k].isConstant && instr.alu.vectorSources[k].addressing == IrAddressing::AL)
+                            setIndexRange(instr.alu.vectorSources[k], range);
+                    }
+
+                    for (uint32_t k = 0; k < instr.alu.scalarSourceCount; k++)
+                    {
+                        if (instr.alu.scalarSources[k].isConstant && instr.alu.scalarSources[k].addressing == IrAddressing::AL)
+                            setIndexRange(instr.alu.scalarSources[k], range);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "shader_code.h"
+
+enum class IrAddressing : uint8_t
+{
+    Absolute,
+    A0,
+    AL
+};
+
+struct IrOperand
+{
+    uint8_t reg = 0;
+    bool isConstant = false;
+    bool negate = false;
+    bool abs = false;
+    IrAddressing addressing = IrAddressing::Absolute;
+
+    // Source component of every lane that gets read, in order. Swizzles are resolved at decode time.
+    uint8_t componentCount = 0;
+    uint8_t components[4]{};
+
+    // Set by constant propagation, which replaces the operand with the value of every lane. Negation and absolute
+    // value are already applied.
+    bool isLiteral = false;
+    uint32_t literals[4]{};
+
+    // Set by range analysis for relative addressing when the a0 or aL offset is known to stay within these bounds.
+    bool isIndexBounded = false;
+    int16_t minIndex = 0;
+    int16_t maxIndex = 0;
+
+    bool operator==(const IrOperand& other) const
+    {
+        if (isLiteral != other.isLiteral || componentCount != other.componentCount)
+            return false;
+
+        if (isLiteral)
+            return memcmp(literals, other.literals, componentCount * sizeof(uint32_t)) == 0;
+
+        return reg == other.reg && isConstant == other.isConstant && negate == other.negate && abs == other.abs &&
+            addressing == other.addressing && memcmp(components, other.components, componentCount) == 0;
+    }
+
+    uint32_t componentMask() const
+    {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < componentCount; i++)
+            mask |= 1 << components[i];
+
+        return mask;
+    }
+};
+
+struct IrAlu
+{
+    AluVectorOpcode vectorOpcode{};
+    AluScalarOpcode scalarOpcode{};
+    IrOperand vectorSources[3];
+    uint32_t vectorSourceCount = 0;
+    IrOperand scalarSources[2];
+    uint32_t scalarSourceCount = 0;
+    uint8_t vectorDest = 0;
+    uint8_t scalarDest = 0;
+
+    // Components overwritten by the export constants below are already removed from these.
+    uint8_t vectorWriteMask = 0;
+    uint8_t scalarWriteMask = 0;
+
+    bool vectorSaturate = false;
+    bool scalarSaturate = false;
+    bool exportData = false;
+    uint8_t exportZeroMask = 0;
+    uint8_t exportOneMask = 0;
+
+    // Set by range analysis when a reciprocal, reciprocal square root or logarithm is known to stay within
+    // [-FLT_MAX, FLT_MAX] without being clamped.
+    bool omitScalarClamp = false;
+};
+
+struct IrVertexFetch
+{
+    uint8_t dstRegister = 0;
+    uint16_t dstSwizzle = 0;
+};
+
+struct IrTextureFetch
+{
+    FetchOpcode opcode{};
+    uint8_t srcRegister = 0;
+    uint8_t srcSwizzle = 0;
+    uint8_t dstRegister = 0;
+    uint16_t dstSwizzle = 0;
+    uint8_t constIndex = 0;
+    TextureDimension dimension{};
+    int8_t offsetX = 0;
+    int8_t offsetY = 0;
+
+    uint32_t componentCount() const
+    {
+        switch (dimension)
+        {
+        case TextureDimension::Texture1D:
+            return 1;
+        case TextureDimension::Texture2D:
+            return 2;
+        default:
+            return 3;
+        }
+    }
+
+    uint32_t srcComponent(uint32_t index) const
+    {
+        return (srcSwizzle >> (index * 2)) & 0x3;
+    }
+
+    bool isSupported() const
+    {
+        return opcode == FetchOpcode::TextureFetch || opcode == FetchOpcode::GetTextureWeights;
+    }
+};
+
+enum class IrInstructionKind : uint8_t
+{
+    Alu,
+    VertexFetch,
+    TextureFetch
+};
+
+enum IrState : uint8_t
+{
+    IR_STATE_P0 = 1 << 0,
+    IR_STATE_PS = 1 << 1,
+    IR_STATE_A0 = 1 << 2,
+    IR_STATE_AL = 1 << 3
+};
+
+struct IrRegisterMask
+{
+    uint8_t reg = 0;
+    uint8_t mask = 0;
+};
+
+struct IrInstruction
+{
+    IrInstructionKind kind{};
+    uint32_t address = 0;
+    bool isPredicated = false;
+    bool predicateCondition = false;
+
+    IrAlu alu;
+    IrVertexFetch vertexFetch;
+    IrTextureFetch textureFetch;
+
+    // Temporary registers and state read before being written by this instruction, and the ones it writes.
+    // Reads of state written by the instruction itself (eg. ps in a scalar write) are not included.
+    IrRegisterMask reads[6];
+    uint32_t readCount = 0;
+    IrRegisterMask writes[2];
+    uint32_t writeCount = 0;
+    uint8_t stateReads = 0;
+    uint8_t stateWrites = 0;
+
+    // Set by dead code elimination when nothing the instruction writes is ever read.
+    bool isDead = false;
+};
+
+struct IrControlFlow
+{
+    ControlFlowOpcode opcode = ControlFlowOpcode::Nop;
+
+    // Executes
+    uint32_t firstInstruction = 0;
+    uint32_t instructionCount = 0;
+    bool isEnd = false;
+
+    // Jumps, loops and conditional executes
+    uint32_t address = 0;
+    uint32_t loopId = 0;
+    uint32_t boolAddress = 0;
+    bool isUnconditional = false;
+    bool isPredicated = false;
+    bool condition = false;
+    bool direction = false;
+};
+
+struct IrBlock
+{
+    uint32_t firstNode = 0;
+    uint32_t nodeCount = 0;
+    uint32_t successors[2]{};
+    uint32_t successorCount = 0;
+};
+
+enum class IrStatementKind : uint8_t
+{
+    Node,        // Instructions of an execute
+    If,          // Opens a block entered when the jump of the node is taken, or not taken
+    Else,
+    EndIf,
+    Loop,        // Counted loop of a loop start
+    EndLoop,
+    DoWhile,
+    EndDoWhile,  // Repeats while the jump of the node is taken
+    While,       // Repeats while the jump of the node is taken, checked before every iteration
+    WhileTrue,
+    EndWhile,
+    Break,
+    Continue,
+    DeclareFlag,
+    SetFlag,     // Stores whether the jump of the node is taken
+    IfFlag,
+    IfNotFlag
+};
+
+struct IrStatement
+{
+    IrStatementKind kind{};
+    uint32_t node = 0;
+    uint32_t flag = 0;
+    bool taken = false;
+
+    // Counted loops with a known trip count that are cheap enough to unroll.
+    bool unroll = false;
+};
+
+// Decoded microcode of a shader. Control flow instructions are kept one node per pc, as jump targets address them
+// directly, and are grouped into basic blocks. Executes reference the ALU/fetch instructions they run.
+struct IrShader
+{
+    // Microcode swapped to native endian once, which decoding reads from.
+    std::vector<uint32_t> words;
+
+    std::vector<IrControlFlow> nodes;
+    std::vector<IrInstruction> instructions;
+    std::vector<IrBlock> blocks;
+    std::vector<uint32_t> nodeBlocks;
+
+    // Values of the float constants defined by the shader, set after decoding.
+    uint32_t literals[256][4]{};
+    std::bitset<256> definedLiterals;
+
+    // Values of the loop constants defined by the shader, set after decoding. The lowest byte is the trip count,
+    // followed by the initial aL and the signed aL step.
+    uint32_t loopConstants[32]{};
+    std::bitset<32> definedLoopConstants;
+
+    // Filled by analyze().
+    std::bitset<256> usedConstants;
+    uint64_t usedRegisters = 0;
+    uint8_t usedState = 0;
+    uint8_t writtenExports[64]{};
+
+    // Nested statements recovered from the control flow, only valid if isStructured is set. Jumps leaving their
+    // region without being a break or a continue set a flag guarding the nodes they skip.
+    std::vector<IrStatement> statements;
+    uint32_t flagCount = 0;
+    bool isStructured = false;
+    bool endsInsideLoop = false;
+
+    // Size is in bytes, nothing past it gets read.
+    void decode(const be<uint32_t>* code, uint32_t size);
+
+    // Turns writes to the given export registers into no-ops, leaving analyze() to remove the instructions that only
+    // computed their values.
+    void removeExports(uint64_t exportMask);
+
+    // Propagates and folds literal constants, removes dead instructions and dead components of partial writes, then
+    // computes which constants, temporary registers and state are referenced, and which export components are written
+    // on every path to the end of the shader. Value ranges decide which clamps on indexing and transcendental results
+    // are redundant. Finally recovers structured statements from the control flow.
+    void analyze();
+};
@@ -0,0 +1,275 @@
+#include "shader_manifest.h"
+
+static constexpr uint32_t SHADER_MANIFEST_SIGNATURE = 0x4D535258; // XRSM
+static constexpr uint32_t SHADER_MANIFEST_VERSION = 12;
+
+struct ManifestWriter
+{
+    std::vector<uint8_t> data;
+
+    template<typename T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        data.insert(data.end(), reinterpret_cast<const uint8_t*>(&value), reinterpret_cast<const uint8_t*>(&value) + sizeof(T));
+    }
+
+    void write(const void* bytes, size_t size)
+    {
+        write(uint64_t(size));
+        data.insert(data.end(), reinterpret_cast<const uint8_t*>(bytes), reinterpret_cast<const uint8_t*>(bytes) + size);
+    }
+};
+
+struct ManifestReader
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+
+    template<typename T>
+    bool read(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (size - offset < sizeof(T))
+            return false;
+
+        memcpy(&value, data + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    // Whether the remaining data can hold the given number of records, so corrupt counts get rejected before resizing.
+    bool canHold(uint64_t count, size_t minimumRecordSize) const
+    {
+        return count <= (size - offset) / minimumRecordSize;
+    }
+
+    bool read(const uint8_t*& bytes, size_t& bytesSize)
+    {
+        uint64_t value;
+        if (!read(value) || size - offset < value)
+            return false;
+
+        bytes = data + offset;
+        bytesSize = value;
+        offset += value;
+        return true;
+    }
+};
+
+// Blobs are prefixed with their size.
+static constexpr size_t MINIMUM_VARIANT_SIZE = sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(bool);
+
+static bool readManifest(ManifestReader& reader, XXH64_hash_t key, DxcProfile profile, std::map<std::filesystem::path, ScannedFile>& files,
+    std::map<XXH64_hash_t, RecompiledShader>& shaders)
+{
+    uint32_t signature, version, fileCount, shaderCount;
+    XXH64_hash_t manifestKey;
+    if (!reader.read(signature) || signature != SHADER_MANIFEST_SIGNATURE ||
+        !reader.read(version) || version != SHADER_MANIFEST_VERSION ||
+        !reader.read(manifestKey) || manifestKey != key ||
+        !reader.read(fileCount) || !reader.read(shaderCount))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < fileCount; i++)
+    {
+        const uint8_t* path;
+        size_t pathSize;
+        ScannedFile scannedFile;
+        uint32_t containerCount;
+
+        if (!reader.read(path, pathSize) || !reader.read(scannedFile.size) || !reader.read(scannedFile.lastWriteTime) ||
+            !reader.read(scannedFile.contentHash) || !reader.read(containerCount) ||
+            !reader.canHold(containerCount, sizeof(ShaderContainerLocation)))
+        {
+            return false;
+        }
+
+        scannedFile.containers.resize(containerCount);
+        for (auto& container : scannedFile.containers)
+        {
+            if (!reader.read(container))
+                return false;
+        }
+
+        files.emplace(std::filesystem::u8path(std::string(reinterpret_cast<const char*>(path), pathSize)), std::move(scannedFile));
+    }
+
+    for (uint32_t i = 0; i < shaderCount; i++)
+    {
+        XXH64_hash_t hash;
+        RecompiledShader shader;
+        const uint8_t* dxil;
+        size_t dxilSize;
+        const uint8_t* spirv;
+        size_t spirvSize;
+        const uint8_t* vertexInputs;
+        size_t vertexInputsSize;
+
+        if (!reader.read(hash) || !reader.read(shader.isPixelShader) || !reader.read(shader.specConstantsMask) || !reader.read(shader.metadata) || !reader.read(shader.profile) ||
+            !reader.read(dxil, dxilSize) || !reader.read(spirv, spirvSize) || !reader.read(shader.isSpirvDirect) || !reader.read(vertexInputs, vertexInputsSize) ||
+            (vertexInputsSize % sizeof(ShaderVertexInput)) != 0)
+        {
+            return false;
+        }
+
+        shader.vertexInputs.resize(vertexInputsSize / sizeof(ShaderVertexInput));
+        memcpy(shader.vertexInputs.data(), vertexInputs, vertexInputsSize);
+
+        uint32_t variantCount;
+        if (!reader.read(variantCount) || !reader.canHold(variantCount, MINIMUM_VARIANT_SIZE))
+            return false;
+
+        shader.variants.resize(variantCount);
+        for (auto& variant : shader.variants)
+        {
+            const uint8_t* variantDxil;
+            size_t variantDxilSize;
+            const uint8_t* variantSpirv;
+            size_t variantSpirvSize;
+
+            if (!reader.read(variant.specConstants) || !reader.read(variantDxil, variantDxilSize) || !reader.read(variantSpirv, variantSpirvSize) ||
+                !reader.read(variant.isSpirvDirect))
+            {
+                return false;
+            }
+
+            variant.dxil.assign(variantDxil, variantDxil + variantDxilSize);
+            variant.spirv.assign(variantSpirv, variantSpirv + variantSpirvSize);
+        }
+
+        uint32_t linkedVariantCount;
+        if (!reader.read(linkedVariantCount) || !reader.canHold(linkedVariantCount, MINIMUM_VARIANT_SIZE))
+            return false;
+
+        shader.linkedVariants.resize(linkedVariantCount);
+        for (auto& linkedVariant : shader.linkedVariants)
+        {
+            const uint8_t* linkedDxil;
+            size_t linkedDxilSize;
+            const uint8_t* linkedSpirv;
+            size_t linkedSpirvSize;
+
+            if (!reader.read(linkedVariant.interpolators) || !reader.read(linkedDxil, linkedDxilSize) || !reader.read(linkedSpirv, linkedSpirvSize) ||
+                !reader.read(linkedVariant.isSpirvDirect))
+            {
+                return false;
+            }
+
+            linkedVariant.dxil.assign(linkedDxil, linkedDxil + linkedDxilSize);
+            linkedVariant.spirv.assign(linkedSpirv, linkedSpirv + linkedSpirvSize);
+        }
+
+        if (shader.profile != profile)
+            continue;
+
+        shader.dxil.assign(dxil, dxil + dxilSize);
+        shader.spirv.assign(spirv, spirv + spirvSize);
+        shaders.emplace(hash, std::move(shader));
+    }
+
+    return true;
+}
+
+bool ShaderManifest::load(const char* filePath, XXH64_hash_t key, DxcProfile profile)
+{
+    FILE* file = fopen(filePath, "rb");
+    if (file == nullptr)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    std::vector<uint8_t> fileData(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    fread(fileData.data(), 1, fileData.size(), file);
+    fclose(file);
+
+    ManifestReader reader;
+    reader.data = fileData.data();
+    reader.size = fileData.size();
+
+    // Callers use the maps either way, so a partially read manifest is discarded entirely.
+    if (!readManifest(reader, key, profile, files, shaders))
+    {
+        files.clear();
+        shaders.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderManifest::save(const char* filePath, XXH64_hash_t key, const std::map<std::filesystem::path, ScannedFile>& files,
+    const std::map<XXH64_hash_t, RecompiledShader>& shaders)
+{
+    ManifestWriter writer;
+    writer.write(SHADER_MANIFEST_SIGNATURE);
+    writer.write(SHADER_MANIFEST_VERSION);
+    writer.write(key);
+    writer.write(uint32_t(files.size()));
+
+    size_t shaderCountOffset = writer.data.size();
+    writer.write(uint32_t(0));
+
+    for (auto& [path, scannedFile] : files)
+    {
+        std::string pathString = path.u8string();
+        writer.write(pathString.data(), pathString.size());
+        writer.write(scannedFile.size);
+        writer.write(scannedFile.lastWriteTime);
+        writer.write(scannedFile.contentHash);
+        writer.write(uint32_t(scannedFile.containers.size()));
+
+        for (auto& container : scannedFile.containers)
+            writer.write(container);
+    }
+
+    uint32_t shaderCount = 0;
+    for (auto& [hash, shader] : shaders)
+    {
+        if (!shader.isRecompiled())
+            continue;
+
+        writer.write(hash);
+        writer.write(shader.isPixelShader);
+        writer.write(shader.specConstantsMask);
+        writer.write(shader.metadata);
+        writer.write(shader.profile);
+        writer.write(shader.dxil.data(), shader.dxil.size());
+        writer.write(shader.spirv.data(), shader.spirv.size());
+        writer.write(shader.isSpirvDirect);
+        writer.write(shader.vertexInputs.data(), shader.vertexInputs.size() * sizeof(ShaderVertexInput));
+        writer.write(uint32_t(shader.variants.size()));
+
+        for (auto& variant : shader.variants)
+        {
+            writer.write(variant.specConstants);
+            writer.write(variant.dxil.data(), variant.dxil.size());
+            writer.write(variant.spirv.data(), variant.spirv.size());
+            writer.write(variant.isSpirvDirect);
+        }
+
+        writer.write(uint32_t(shader.linkedVariants.size()));
+
+        for (auto& linkedVariant : shader.linkedVariants)
+        {
+            writer.write(linkedVariant.interpolators);
+            writer.write(linkedVariant.dxil.data(), linkedVariant.dxil.size());
+            writer.write(linkedVariant.spirv.data(), linkedVariant.spirv.size());
+            writer.write(linkedVariant.isSpirvDirect);
+        }
+
+        ++shaderCount;
+    }
+
+    memcpy(writer.data.data() + shaderCountOffset, &shaderCount, sizeof(shaderCount));
+
+    FILE* file = fopen(filePath, "wb");
+    if (file != nullptr)
+    {
+        fwrite(writer.data.data(), 1, writer.data.size(), file);
+        fclose(file);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "dxc_compiler.h"
+#include "shader_recompiler.h"
+
+// A shader compiled with its specialization constants frozen to a specific mask.
+struct ShaderVariant
+{
+    uint32_t specConstants = 0;
+    std::vector<uint8_t> dxil;
+    std::vector<uint8_t> spirv;
+    bool isSpirvDirect = false;
+};
+
+// A vertex shader linked against pixel shaders reading the same interpolators, without the exports they don't read.
+struct LinkedVariant
+{
+    uint32_t interpolators = 0;
+    std::vector<uint8_t> dxil;
+    std::vector<uint8_t> spirv;
+    bool isSpirvDirect = false;
+};
+
+struct RecompiledShader
+{
+    uint8_t* data = nullptr;
+    uint64_t size = 0;
+    bool isPixelShader = false;
+    std::vector<uint8_t> dxil;
+    std::vector<uint8_t> spirv;
+    // Whether the SPIR-V was translated directly from the IR instead of being compiled by DXC.
+    bool isSpirvDirect = false;
+    uint32_t specConstantsMask = 0;
+    ShaderMetadata metadata;
+    std::vector<ShaderVertexInput> vertexInputs;
+    uint32_t references = 0;
+    DxcProfile profile = DxcProfile::Release;
+    std::vector<ShaderVariant> variants;
+    std::vector<LinkedVariant> linkedVariants;
+
+    // SPIR-V is always generated, so an empty SPIR-V blob means the shader still needs to be recompiled.
+    bool isRecompiled() const
+    {
+        return !spirv.empty();
+    }
+};
+
+struct ShaderContainerLocation
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    XXH64_hash_t hash = 0;
+};
+
+struct ScannedFile
+{
+    uint64_t size = 0;
+    int64_t lastWriteTime = 0;
+    XXH64_hash_t contentHash = 0;
+    std::vector<ShaderContainerLocation> containers;
+};
+
+// The manifest persists the scan results of every input file alongside the recompiled shaders,
+// allowing unchanged files to be skipped without being read on subsequent runs.
+struct ShaderManifest
+{
+    std::map<std::filesystem::path, ScannedFile> files;
+    std::map<XXH64_hash_t, RecompiledShader> shaders;
+
+    // The key identifies everything the shaders were compiled with besides their containers and profile. Manifests
+    // saved with a different key are discarded, and shaders recompiled with a different profile cause them to be recompiled.
+    bool load(const char* filePath, XXH64_hash_t key, DxcProfile profile);
+    static void save(const char* filePath, XXH64_hash_t key, const std::map<std::filesystem::path, ScannedFile>& files,
+        const std::map<XXH64_hash_t, RecompiledShader>& shaders);
+};
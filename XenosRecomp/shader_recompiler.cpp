@@ -67,57 +67,6 @@ static constexpr const char* USAGE_SEMANTICS[] =
     "SAMPLE"
 };
 
-struct DeclUsageLocation
-{
-    DeclUsage usage;
-    uint32_t usageIndex;
-    uint32_t location;
-};
-
-// NOTE: These are specialized Vulkan locations for Unleashed Recompiled. Change as necessary. Likely not going to work with other games.
-static constexpr DeclUsageLocation USAGE_LOCATIONS[] =
-{
-    { DeclUsage::Position, 0, 0 },
-    { DeclUsage::Normal, 0, 1 },
-    { DeclUsage::Tangent, 0, 2 },
-    { DeclUsage::Binormal, 0, 3 },
-    { DeclUsage::TexCoord, 0, 4 },
-    { DeclUsage::TexCoord, 1, 5 },
-    { DeclUsage::TexCoord, 2, 6 },
-    { DeclUsage::TexCoord, 3, 7 },
-    { DeclUsage::Color, 0, 8 },
-    { DeclUsage::BlendIndices, 0, 9 },
-    { DeclUsage::BlendWeight, 0, 10 },
-    { DeclUsage::Color, 1, 11 },
-    { DeclUsage::TexCoord, 4, 12 },
-    { DeclUsage::TexCoord, 5, 13 },
-    { DeclUsage::TexCoord, 6, 14 },
-    { DeclUsage::TexCoord, 7, 15 },
-    { DeclUsage::Position, 1, 15 },
-};
-
-static constexpr std::pair<DeclUsage, size_t> INTERPOLATORS[] =
-{
-    { DeclUsage::TexCoord, 0 },
-    { DeclUsage::TexCoord, 1 },
-    { DeclUsage::TexCoord, 2 },
-    { DeclUsage::TexCoord, 3 },
-    { DeclUsage::TexCoord, 4 },
-    { DeclUsage::TexCoord, 5 },
-    { DeclUsage::TexCoord, 6 },
-    { DeclUsage::TexCoord, 7 },
-    { DeclUsage::TexCoord, 8 },
-    { DeclUsage::TexCoord, 9 },
-    { DeclUsage::TexCoord, 10 },
-    { DeclUsage::TexCoord, 11 },
-    { DeclUsage::TexCoord, 12 },
-    { DeclUsage::TexCoord, 13 },
-    { DeclUsage::TexCoord, 14 },
-    { DeclUsage::TexCoord, 15 },
-    { DeclUsage::Color, 0 },
-    { DeclUsage::Color, 1 }
-};
-
 static constexpr std::string_view TEXTURE_DIMENSIONS[] = 
 {
     "2D",
@@ -125,11 +74,240 @@ static constexpr std::string_view TEXTURE_DIMENSIONS[] =
     "Cube" 
 };
 
+static void formatLiteral(OperandString& result, uint32_t value)
+{
+    float floatValue;
+    memcpy(&floatValue, &value, sizeof(floatValue));
+
+    if (!std::isfinite(floatValue))
+    {
+        result.print("asfloat(0x{:X})", value);
+        return;
+    }
+
+    size_t begin = result.buffer.size();
+    result.print("{}", floatValue);
+
+    if (std::string_view(result).substr(begin).find_first_of(".e") == std::string_view::npos)
+        result += ".0";
+}
+
 static FetchDestinationSwizzle getDestSwizzle(uint32_t dstSwizzle, uint32_t index)
 {
     return FetchDestinationSwizzle((dstSwizzle >> (index * 3)) & 0x7);
 }
 
+// Relative constant accesses whose bounded offset keeps them inside the array can skip the range check.
+static bool isIndexInRange(const IrOperand& operand, const ParsedConstant* constantInfo)
+{
+    if (operand.addressing == IrAddressing::Absolute || !operand.isIndexBounded)
+        return false;
+
+    int32_t offset = operand.reg - constantInfo->registerIndex;
+    int32_t count = constantInfo->registerCount;
+    return offset >= 0 && offset < count && offset + operand.minIndex >= 0 && offset + operand.maxIndex < count;
+}
+
+// Predicated runs of up to this many instructions get lowered to selects instead of a branch, if all of them can be.
+static constexpr uint32_t PREDICATED_SELECT_LIMIT = 4;
+
+// ALU instructions without side effects besides writing temporary registers and ps. Comparisons are left out, as their
+// boolean results would need a conversion to be selected.
+static bool isSelectable(const IrInstruction& instr)
+{
+    if (instr.kind != IrInstructionKind::Alu)
+        return false;
+
+    auto& alu = instr.alu;
+    if (alu.exportData || (instr.stateWrites & (IR_STATE_P0 | IR_STATE_A0)) != 0)
+        return false;
+
+    switch (alu.vectorOpcode)
+    {
+    case AluVectorOpcode::Seq:
+    case AluVectorOpcode::Sgt:
+    case AluVectorOpcode::Sge:
+    case AluVectorOpcode::Sne:
+    case AluVectorOpcode::Cube:
+    case AluVectorOpcode::KillEq:
+    case AluVectorOpcode::KillGt:
+    case AluVectorOpcode::KillGe:
+    case AluVectorOpcode::KillNe:
+        return false;
+    }
+
+    switch (alu.scalarOpcode)
+    {
+    case AluScalarOpcode::Seqs:
+    case AluScalarOpcode::Sgts:
+    case AluScalarOpcode::Sges:
+    case AluScalarOpcode::Snes:
+    case AluScalarOpcode::KillsEq:
+    case AluScalarOpcode::KillsGt:
+    case AluScalarOpcode::KillsGe:
+    case AluScalarOpcode::KillsNe:
+    case AluScalarOpcode::KillsOne:
+        return false;
+    }
+
+    return true;
+}
+
+// Output capacity reserved up front, enough for most shaders including the common header.
+static constexpr size_t OUTPUT_RESERVE_SIZE = 64 * 1024;
+
+void ShaderRecompiler::reset()
+{
+    out.clear();
+    if (out.capacity() < OUTPUT_RESERVE_SIZE)
+        out.reserve(OUTPUT_RESERVE_SIZE);
+
+    indentation = 0;
+    isPixelShader = false;
+    definedVertexElements.reset();
+    definedInterpolators = 0;
+    memset(float4Constants, 0, sizeof(float4Constants));
+    memset(boolConstants, 0, sizeof(boolConstants));
+    memset(samplers, 0, sizeof(samplers));
+    linkedInterpolators = ~0u;
+    specConstantsMask = 0;
+    metadata = {};
+    vertexInputs.clear();
+    structuredControlFlow = false;
+    predicateSelect = false;
+
+#ifdef UNLEASHED_RECOMP
+    hasMtxProjection = false;
+    hasMtxPrevInvViewProjection = false;
+    isMetaInstancer = false;
+    hasIndexCount = false;
+    reverseZRegisters = 0;
+    reverseZPreviousScalar = false;
+    hasReverseZScalar = false;
+    isReverseZSliced = false;
+    isReverseZCopy = false;
+#endif
+
+    // The IR clears its own state when decoding, keeping the capacity of its vectors.
+}
+
+bool ShaderRecompiler::isUintVertexElement(const VertexElement& vertexElement) const
+{
+#ifdef UNLEASHED_RECOMP
+    if ((vertexElement.usage == DeclUsage::TexCoord && vertexElement.usageIndex == 2 && isMetaInstancer) ||
+        (vertexElement.usage == DeclUsage::Position && vertexElement.usageIndex == 1))
+    {
+        return true;
+    }
+#endif
+
+    return strcmp(USAGE_TYPES[uint32_t(vertexElement.usage)], "uint4") == 0;
+}
+
+void ShaderRecompiler::analyzeResourceUsage()
+{
+    int32_t float4Count = isPixelShader ? 224 : 256;
+
+    auto markFloat4Constants = [&](int32_t first, int32_t last)
+        {
+            for (int32_t reg = std::max(first, 0); reg <= std::min(last, float4Count - 1); reg++)
+                metadata.float4Constants[reg / 64] |= 1ull << (reg % 64);
+        };
+
+    // Registers without a named constant are literals defined in the shader. Relative accesses that range analysis
+    // couldn't bound are assumed to stay past the start of their array.
+    auto markOperand = [&](const IrOperand& operand)
+        {
+            if (!operand.isConstant || operand.isLiteral || float4Constants[operand.reg] == nullptr)
+                return;
+
+            auto constantInfo = float4Constants[operand.reg];
+
+        #ifdef UNLEASHED_RECOMP
+            // Read from the matrices built in the prologue instead.
+            if (hasMtxProjection && strcmp(constantInfo->name, "g_MtxProjection") == 0)
+                return;
+        #endif
+
+            if (operand.addressing == IrAddressing::Absolute || constantInfo->registerCount <= 1)
+                markFloat4Constants(operand.reg, operand.reg);
+            else if (operand.isIndexBounded && (operand.addressing != IrAddressing::AL || structuredControlFlow))
+                markFloat4Constants(operand.reg + operand.minIndex, operand.reg + operand.maxIndex);
+            else
+                markFloat4Constants(constantInfo->registerIndex, float4Count - 1);
+        };
+
+    for (auto& instr : ir.instructions)
+    {
+        if (instr.isDead)
+            continue;
+
+        // 1D textures have no descriptor index.
+        if (instr.kind == IrInstructionKind::TextureFetch)
+        {
+            auto& textureFetch = instr.textureFetch;
+            if (textureFetch.isSupported() && samplers[textureFetch.constIndex] != nullptr)
+            {
+                switch (textureFetch.dimension)
+                {
+                case TextureDimension::Texture2D:
+                    metadata.textures[0] |= 1u << textureFetch.constIndex;
+                    break;
+                case TextureDimension::Texture3D:
+                    metadata.textures[1] |= 1u << textureFetch.constIndex;
+                    break;
+                case TextureDimension::TextureCube:
+                    metadata.textures[2] |= 1u << textureFetch.constIndex;
+                    break;
+                }
+            }
+        }
+
+        if (instr.kind != IrInstructionKind::Alu)
+            continue;
+
+        // The vector operation is skipped when nothing it writes is live, besides the predicate, kills and a0. Cube
+        // always reads its source as a temporary register.
+        auto& alu = instr.alu;
+        bool isVectorEvaluated = alu.vectorWriteMask != 0 ||
+            (alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::KillNe);
+
+        if (alu.vectorOpcode != AluVectorOpcode::Cube)
+        {
+            for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+            {
+                if (isVectorEvaluated || (i == 0 && alu.vectorOpcode >= AluVectorOpcode::MaxA))
+                    markOperand(alu.vectorSources[i]);
+            }
+        }
+
+        for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+            markOperand(alu.scalarSources[i]);
+    }
+
+#ifdef UNLEASHED_RECOMP
+    // Read by the prologue, to build the projection matrices and to initialize r0.
+    for (auto& constant : container.getConstants(RegisterSet::Float4))
+    {
+        if (hasMtxProjection && strcmp(constant.name, "g_MtxProjection") == 0)
+            markFloat4Constants(constant.registerIndex, constant.registerIndex + 3);
+        else if (hasIndexCount && (ir.usedRegisters & 1) != 0 && strcmp(constant.name, "g_IndexCount") == 0)
+            markFloat4Constants(constant.registerIndex, constant.registerIndex);
+    }
+#endif
+
+    // Conditional executes ignore their condition, so only jumps read booleans.
+    for (auto& node : ir.nodes)
+    {
+        if (node.opcode != ControlFlowOpcode::CondJmp || node.isUnconditional || node.isPredicated)
+            continue;
+
+        uint32_t bit = node.boolAddress + (isPixelShader ? 16 : 0);
+        if (node.boolAddress < std::size(boolConstants) && boolConstants[node.boolAddress] != nullptr && bit < 32)
+            metadata.booleans |= 1u << bit;
+    }
+}
+
 void ShaderRecompiler::printDstSwizzle(uint32_t dstSwizzle, bool operand)
 {
     for (size_t i = 0; i < 4; i++)
@@ -140,7 +318,7 @@ void ShaderRecompiler::printDstSwizzle(uint32_t dstSwizzle, bool operand)
     }
 }
 
-void ShaderRecompiler::printDstSwizzle01(uint32_t dstRegister, uint32_t dstSwizzle)
+void ShaderRecompiler::printDstSwizzle01(const char* registerPrefix, uint32_t dstRegister, uint32_t dstSwizzle)
 {
     for (size_t i = 0; i < 4; i++)
     {
@@ -148,38 +326,28 @@ void ShaderRecompiler::printDstSwizzle01(uint32_t dstRegister, uint32_t dstSwizz
         if (swizzle == FetchDestinationSwizzle::Zero)
         {
             indent();
-            println("r{}.{} = 0.0;", dstRegister, SWIZZLES[i]);
+            println("{}{}.{} = 0.0;", registerPrefix, dstRegister, SWIZZLES[i]);
         }
         else if (swizzle == FetchDestinationSwizzle::One)
         {
             indent();
-            println("r{}.{} = 1.0;", dstRegister, SWIZZLES[i]);
+            println("{}{}.{} = 1.0;", registerPrefix, dstRegister, SWIZZLES[i]);
         }
     }
 }
 
-void ShaderRecompiler::recompile(const VertexFetchInstruction& instr, uint32_t address)
+void ShaderRecompiler::recompile(const IrInstruction& instr, const IrVertexFetch& vertexFetch)
 {
-    if (instr.isPredicated)
-    {
-        indent();
-        println("if ({}p0)", instr.predicateCondition ? "" : "!");
-
-        indent();
-        out += "{\n";
-        ++indentation;
-    }
-
     indent();
-    print("r{}.", instr.dstRegister);
-    printDstSwizzle(instr.dstSwizzle, false);
+    print("r{}.", vertexFetch.dstRegister);
+    printDstSwizzle(vertexFetch.dstSwizzle, false);
 
     out += " = ";
 
-    auto findResult = vertexElements.find(address);
-    assert(findResult != vertexElements.end());
+    assert(instr.address < std::size(vertexElements) && definedVertexElements.test(instr.address));
+    auto& vertexElement = vertexElements[instr.address];
 
-    switch (findResult->second.usage)
+    switch (vertexElement.usage)
     {
     case DeclUsage::Normal:
     case DeclUsage::Tangent:
@@ -193,9 +361,9 @@ void ShaderRecompiler::recompile(const VertexFetchInstruction& instr, uint32_t a
         break;
     }
 
-    print("i{}{}", USAGE_VARIABLES[uint32_t(findResult->second.usage)], uint32_t(findResult->second.usageIndex));
+    print("i{}{}", USAGE_VARIABLES[uint32_t(vertexElement.usage)], uint32_t(vertexElement.usageIndex));
 
-    switch (findResult->second.usage)
+    switch (vertexElement.usage)
     {
     case DeclUsage::Normal:
     case DeclUsage::Tangent:
@@ -204,46 +372,36 @@ void ShaderRecompiler::recompile(const VertexFetchInstruction& instr, uint32_t a
         break;
 
     case DeclUsage::TexCoord:
-        print(", {})", uint32_t(findResult->second.usageIndex));
+        print(", {})", uint32_t(vertexElement.usageIndex));
         break;
     }
 
     out += '.';
-    printDstSwizzle(instr.dstSwizzle, true);
+    printDstSwizzle(vertexFetch.dstSwizzle, true);
 
     out += ";\n";
 
-    printDstSwizzle01(instr.dstRegister, instr.dstSwizzle);
-
-    if (instr.isPredicated)
-    {
-        --indentation;
-        indent();
-        out += "}\n";
-    }
+    printDstSwizzle01("r", vertexFetch.dstRegister, vertexFetch.dstSwizzle);
 }
 
-void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicubic)
+void ShaderRecompiler::recompile(const IrInstruction& instr, const IrTextureFetch& textureFetch, bool bicubic)
 {
-    if (instr.opcode != FetchOpcode::TextureFetch && instr.opcode != FetchOpcode::GetTextureWeights)
+    if (!textureFetch.isSupported())
         return;
 
-    if (instr.isPredicated)
-    {
-        indent();
-        println("if ({}p0)", instr.predCondition ? "" : "!");
-
-        indent();
-        out += "{\n";
-        ++indentation;
-    }
+    // The reverse Z copy fetches from the copy of the coordinates.
+    const char* registerPrefix = "r";
+#ifdef UNLEASHED_RECOMP
+    if (isReverseZCopy)
+        registerPrefix = "rz";
+#endif
 
     auto printSrcRegister = [&](size_t componentCount)
         {
-            print("r{}.", instr.srcRegister);
+            print("{}{}.", registerPrefix, textureFetch.srcRegister);
 
             for (size_t i = 0; i < componentCount; i++)
-                out += SWIZZLES[((instr.srcSwizzle >> (i * 2))) & 0x3];
+                out += SWIZZLES[textureFetch.srcComponent(i)];
         };
 
     std::string constName;
@@ -252,10 +410,9 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
     bool subtractFromOne = false;
 #endif
 
-    auto findResult = samplers.find(instr.constIndex);
-    if (findResult != samplers.end())
+    if (samplers[textureFetch.constIndex] != nullptr)
     {
-        constNamePtr = findResult->second;
+        constNamePtr = samplers[textureFetch.constIndex];
 
     #ifdef UNLEASHED_RECOMP
         subtractFromOne = hasMtxPrevInvViewProjection && strcmp(constNamePtr, "sampZBuffer") == 0;
@@ -263,12 +420,12 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
     }
     else
     {
-        constName = fmt::format("s{}", instr.constIndex);
+        constName = fmt::format("s{}", textureFetch.constIndex);
         constNamePtr = constName.c_str();
     }
 
 #ifdef UNLEASHED_RECOMP
-    if (instr.constIndex == 0 && instr.dimension == TextureDimension::Texture2D)
+    if (textureFetch.constIndex == 0 && textureFetch.dimension == TextureDimension::Texture2D && !isReverseZCopy)
     {
         indent();
         print("pixelCoord = getPixelCoord({}_Texture2DDescriptorIndex, ", constNamePtr);
@@ -278,11 +435,11 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
 #endif
 
     indent();
-    print("r{}.", instr.dstRegister);
-    printDstSwizzle(instr.dstSwizzle, false);
+    print("{}{}.", registerPrefix, textureFetch.dstRegister);
+    printDstSwizzle(textureFetch.dstSwizzle, false);
 
     out += " = ";
-    switch (instr.opcode)
+    switch (textureFetch.opcode)
     {
     case FetchOpcode::TextureFetch:
     {
@@ -304,7 +461,7 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
     std::string_view dimension;
     uint32_t componentCount = 0;
 
-    switch (instr.dimension)
+    switch (textureFetch.dimension)
     {
     case TextureDimension::Texture1D:
         dimension = "1D";
@@ -334,10 +491,10 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
     print("({0}_Texture{1}DescriptorIndex, {0}_SamplerDescriptorIndex, ", constNamePtr, dimension);
     printSrcRegister(componentCount);
 
-    switch (instr.dimension)
+    switch (textureFetch.dimension)
     {
     case TextureDimension::Texture2D:
-        print(", float2({}, {})", instr.offsetX * 0.5f, instr.offsetY * 0.5f);
+        print(", float2({}, {})", textureFetch.offsetX * 0.5f, textureFetch.offsetY * 0.5f);
         break;
     case TextureDimension::TextureCube:
         out += ", cubeMapData";
@@ -346,243 +503,183 @@ void ShaderRecompiler::recompile(const TextureFetchInstruction& instr, bool bicu
 
     out += ").";
 
-    printDstSwizzle(instr.dstSwizzle, true);
+    printDstSwizzle(textureFetch.dstSwizzle, true);
 
     out += ";\n";
 
-    printDstSwizzle01(instr.dstRegister, instr.dstSwizzle);
-
-    if (instr.isPredicated)
-    {
-        --indentation;
-        indent();
-        out += "}\n";
-    }
+    printDstSwizzle01(registerPrefix, textureFetch.dstRegister, textureFetch.dstSwizzle);
 }
 
-void ShaderRecompiler::recompile(const AluInstruction& instr)
+void ShaderRecompiler::recompile(const IrInstruction& instr, const IrAlu& alu)
 {
-    if (instr.isPredicated)
-    {
-        indent();
-        println("if ({}p0)", instr.predicateCondition ? "" : "!");
-
-        indent(); 
-        out += "{\n";
-        ++indentation;
-    }
-
-    enum
-    {
-        VECTOR_0,
-        VECTOR_1,
-        VECTOR_2,
-        SCALAR_0,
-        SCALAR_1,
-        SCALAR_CONSTANT_0,
-        SCALAR_CONSTANT_1
-    };
-
-    auto op = [&](size_t operand)
+    auto op = [&](const IrOperand& operand)
         {
-            size_t reg = 0;
-            size_t swizzle = 0;
-            bool select = true;
-            bool negate = false;
-            bool abs = false;
+            OperandString result;
 
-            switch (operand)
+            if (operand.isLiteral)
             {
-            case SCALAR_CONSTANT_0:
-                reg = instr.src3Register;
-                swizzle = instr.src3Swizzle;
-                select = false;
-                negate = instr.src3Negate;
-                abs = instr.absConstants;
-                break;
-
-            case SCALAR_CONSTANT_1:
-                reg = (uint32_t(instr.scalarOpcode) & 1) | (instr.src3Select << 1) | (instr.src3Swizzle & 0x3C);
-                swizzle = instr.src3Swizzle;
-                select = true;
-                negate = instr.src3Negate;
-                abs = instr.absConstants;
-                break;
-
-            default:
-                switch (operand)
+                if (operand.componentCount == 1)
                 {
-                case VECTOR_0:
-                    reg = instr.src1Register;
-                    swizzle = instr.src1Swizzle;
-                    select = instr.src1Select;
-                    negate = instr.src1Negate;
-                    break;
-                case VECTOR_1:
-                    reg = instr.src2Register;
-                    swizzle = instr.src2Swizzle;
-                    select = instr.src2Select;
-                    negate = instr.src2Negate;
-                    break;
-                case VECTOR_2:
-                case SCALAR_0:
-                case SCALAR_1:
-                    reg = instr.src3Register;
-                    swizzle = instr.src3Swizzle;
-                    select = instr.src3Select;
-                    negate = instr.src3Negate;
-                    break;
+                    formatLiteral(result, operand.literals[0]);
+                    return result;
                 }
 
-                if (select)
-                {
-                    abs = (reg & 0x80) != 0;
-                    reg &= 0x3F;
-                }
-                else
+                result.print("float{}(", operand.componentCount);
+                for (uint32_t i = 0; i < operand.componentCount; i++)
                 {
-                    abs = instr.absConstants;
+                    if (i != 0)
+                        result += ", ";
+
+                    formatLiteral(result, operand.literals[i]);
                 }
 
-                break;
+                result += ')';
+                return result;
             }
 
-            std::string regFormatted;
+            if (operand.negate)
+                result += '-';
+
+            if (operand.abs)
+                result += "abs(";
 
-            if (select)
+            if (!operand.isConstant)
             {
-                regFormatted = fmt::format("r{}", reg);
+            #ifdef UNLEASHED_RECOMP
+                if (isReverseZCopy && isReverseZ(operand))
+                    result.print("rz{}", operand.reg);
+                else
+            #endif
+                    result.print("r{}", operand.reg);
             }
             else
             {
-                auto findResult = float4Constants.find(reg);
-                if (findResult != float4Constants.end())
+                auto constantInfo = float4Constants[operand.reg];
+                if (constantInfo != nullptr)
                 {
-                    const char* constantName = reinterpret_cast<const char*>(constantTableData + findResult->second->name);
-                    if (findResult->second->registerCount > 1)
+                    const char* constantName = constantInfo->name;
+                    if (constantInfo->registerCount > 1)
                     {
                     #ifdef UNLEASHED_RECOMP
                         if (hasMtxProjection && strcmp(constantName, "g_MtxProjection") == 0)
                         {
-                            regFormatted = fmt::format("(iterationIndex == 0 ? mtxProjectionReverseZ[{0}] : mtxProjection[{0}])",
-                                reg - findResult->second->registerIndex);
+                            if (isReverseZSliced)
+                            {
+                                result.print("{}[{}]", isReverseZCopy ? "mtxProjectionReverseZ" : "mtxProjection",
+                                    operand.reg - constantInfo->registerIndex);
+                            }
+                            else
+                            {
+                                result.print("(iterationIndex == 0 ? mtxProjectionReverseZ[{0}] : mtxProjection[{0}])",
+                                    operand.reg - constantInfo->registerIndex);
+                            }
                         }
                         else
                     #endif
                         {
-                            regFormatted = fmt::format("{}({}{})", constantName,
-                                reg - findResult->second->registerIndex, instr.const0Relative ? (instr.constAddressRegisterRelative ? " + a0" : " + aL") : "");
+                            const char* relative = "";
+                            if (operand.addressing == IrAddressing::A0)
+                                relative = " + a0";
+                            else if (operand.addressing == IrAddressing::AL)
+                                relative = " + aL";
+
+                            const char* suffix = "";
+                            if (isIndexInRange(operand, constantInfo))
+                                suffix = "_Unclamped";
+
+                            result.print("{}{}({}{})", constantName, suffix, operand.reg - constantInfo->registerIndex, relative);
                         }
                     }
                     else
                     {
-                        assert(!instr.const0Relative && !instr.const1Relative);
-                        regFormatted = constantName;
+                        assert(operand.addressing == IrAddressing::Absolute);
+                        result += constantName;
                     }
                 }
                 else
                 {
-                    assert(!instr.const0Relative && !instr.const1Relative);
-                    regFormatted = fmt::format("c{}", reg);
+                    assert(operand.addressing == IrAddressing::Absolute);
+                    result.print("c{}", operand.reg);
                 }
             }
 
-            std::string result;
-
-            if (negate)
-                result += '-';
-
-            if (abs)
-                result += "abs(";
-
-            result += regFormatted;
             result += '.';
 
-            switch (operand)
-            {
-            case VECTOR_0:
-            case VECTOR_1:
-            case VECTOR_2:
-            {
-                uint32_t mask;
-
-                switch (instr.vectorOpcode)
-                {
-                case AluVectorOpcode::Dp2Add:
-                    mask = (operand == VECTOR_2) ? 0b1 : 0b11;
-                    break;
-
-                case AluVectorOpcode::Dp3:
-                    mask = 0b111;
-                    break;
+            for (uint32_t i = 0; i < operand.componentCount; i++)
+                result += SWIZZLES[operand.components[i]];
 
-                case AluVectorOpcode::Dp4:
-                case AluVectorOpcode::Max4:
-                    mask = 0b1111;
-                    break;
+            if (operand.abs)
+                result += ")";
 
-                default:
-                    mask = instr.vectorWriteMask != 0 ? instr.vectorWriteMask : 0b1;
-                    break;
-                }
+            return result;
+        };
 
-                for (size_t i = 0; i < 4; i++)
-                {
-                    if ((mask >> i) & 0x1)
-                        result += SWIZZLES[((swizzle >> (i * 2)) + i) & 0x3];
-                }
+    const char* registerPrefix = "r";
+    const char* previousScalar = "ps";
+    bool emitSideEffects = true;
+    bool writeVector = true;
+    bool computeScalar = true;
+    bool writeScalar = true;
 
-                break;
-            }
+#ifdef UNLEASHED_RECOMP
+    // The reverse Z copy only emits the parts computed from g_MtxProjection, and the position export is left to it.
+    if (isReverseZSliced)
+    {
+        bool isPosition = alu.exportData && ExportRegister(alu.vectorDest) == ExportRegister::VSPosition;
+        bool vectorReverseZ = isVectorReverseZ(alu);
+        bool scalarReverseZ = isScalarReverseZ(instr);
 
-            case SCALAR_0:
-            case SCALAR_CONSTANT_0:
-                result += SWIZZLES[((swizzle >> 6) + 3) & 0x3];
-                break;
+        if (isReverseZCopy)
+        {
+            registerPrefix = "rz";
+            previousScalar = "psz";
+            emitSideEffects = false;
+            writeVector = vectorReverseZ && isReverseZDestination(alu, alu.vectorDest);
+            writeScalar = scalarReverseZ && alu.scalarWriteMask != 0 && isReverseZDestination(alu, alu.scalarDest);
+            computeScalar = writeScalar || (scalarReverseZ && reverseZPreviousScalar);
+        }
+        else if (isPosition)
+        {
+            writeVector = !vectorReverseZ;
+            writeScalar = !scalarReverseZ;
+        }
+    }
+#endif
 
-            case SCALAR_1:
-            case SCALAR_CONSTANT_1:
-                result += SWIZZLES[swizzle & 0x3];
-                break;
-            }
+    if (emitSideEffects)
+    {
+        switch (alu.vectorOpcode)
+        {
+        case AluVectorOpcode::KillEq:
+            indent();
+            println("clip(any({} == {}) ? -1 : 1);", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
+            break;
 
-            if (abs)
-                result += ")";
+        case AluVectorOpcode::KillGt:
+            indent();
+            println("clip(any({} > {}) ? -1 : 1);", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
+            break;
 
-            return result;
-        };
+        case AluVectorOpcode::KillGe:
+            indent();
+            println("clip(any({} >= {}) ? -1 : 1);", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
+            break;
 
-    switch (instr.vectorOpcode)
-    {
-    case AluVectorOpcode::KillEq:
-        indent();
-        println("clip(any({} == {}) ? -1 : 1);", op(VECTOR_0), op(VECTOR_1));
-        break;
-    
-    case AluVectorOpcode::KillGt:
-        indent();
-        println("clip(any({} > {}) ? -1 : 1);", op(VECTOR_0), op(VECTOR_1));
-        break;
-    
-    case AluVectorOpcode::KillGe:
-        indent();
-        println("clip(any({} >= {}) ? -1 : 1);", op(VECTOR_0), op(VECTOR_1));
-        break;
-    
-    case AluVectorOpcode::KillNe:
-        indent();
-        println("clip(any({} != {}) ? -1 : 1);", op(VECTOR_0), op(VECTOR_1));
-        break;
+        case AluVectorOpcode::KillNe:
+            indent();
+            println("clip(any({} != {}) ? -1 : 1);", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
+            break;
+        }
     }
 
     bool closeIfBracket = false;
 
     std::string_view exportRegister;
-    if (instr.exportData)
+    if (alu.exportData)
     {
         if (isPixelShader)
         {
-            switch (ExportRegister(instr.vectorDest))
+            switch (ExportRegister(alu.vectorDest))
             {
             case ExportRegister::PSColor0:
                 exportRegister = "oC0";
@@ -603,13 +700,13 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         }
         else
         {
-            switch (ExportRegister(instr.vectorDest))
+            switch (ExportRegister(alu.vectorDest))
             {
             case ExportRegister::VSPosition:
                 exportRegister = "oPos";
 
             #ifdef UNLEASHED_RECOMP
-                if (hasMtxProjection)
+                if (hasMtxProjection && !isReverseZSliced)
                 {
                     indent();
                     out += "if ((g_SpecConstants() & SPEC_CONSTANT_REVERSE_Z) == 0 || iterationIndex == 0)\n";
@@ -625,21 +722,20 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
 
             default:
             {
-                auto findResult = interpolators.find(instr.vectorDest);
-                assert(findResult != interpolators.end());
-                exportRegister = findResult->second;
+                assert(alu.vectorDest < std::size(interpolators) && (definedInterpolators & (1u << alu.vectorDest)) != 0);
+                exportRegister = interpolators[alu.vectorDest];
                 break;
             }
             }
         }
     }
 
-    if (instr.vectorOpcode >= AluVectorOpcode::SetpEqPush && instr.vectorOpcode <= AluVectorOpcode::SetpGePush)
+    if (emitSideEffects && alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::SetpGePush)
     {
         indent();
-        print("p0 = {} == 0.0 && {} ", op(VECTOR_0), op(VECTOR_1));
+        print("p0 = {} == 0.0 && {} ", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
 
-        switch (instr.vectorOpcode)
+        switch (alu.vectorOpcode)
         {
         case AluVectorOpcode::SetpEqPush:
             out += "==";
@@ -657,19 +753,22 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
 
         out += " 0.0;\n";
     }
-    else if (instr.vectorOpcode >= AluVectorOpcode::MaxA)
+    else if (emitSideEffects && alu.vectorOpcode >= AluVectorOpcode::MaxA)
     {
         indent();
-        println("a0 = (int)clamp(floor(({}).w + 0.5), -256.0, 255.0);", op(VECTOR_0));
+        println("a0 = (int)clamp(floor(({}).w + 0.5), -256.0, 255.0);", op(alu.vectorSources[0]));
     }
 
-    uint32_t vectorWriteMask = instr.vectorWriteMask;
-    if (instr.exportData)
-        vectorWriteMask &= ~instr.scalarWriteMask;
+    // Predicated writes merged into selects keep the previous value of their destination when the predicate fails.
+    const char* predicate = instr.predicateCondition ? "p0" : "!p0";
+    std::string previousValue;
 
-    if (vectorWriteMask != 0)
+    uint32_t vectorWriteMask = alu.vectorWriteMask;
+    if (vectorWriteMask != 0 && writeVector)
     {
         indent();
+        size_t destinationBegin = out.size();
+
         if (!exportRegister.empty())
         {
             out += exportRegister;
@@ -677,7 +776,7 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         }
         else
         {
-            print("r{}.", instr.vectorDest);
+            print("{}{}.", registerPrefix, alu.vectorDest);
         }
 
         for (size_t i = 0; i < 4; i++)
@@ -686,156 +785,171 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
                 out += SWIZZLES[i];
         }
 
-        out += " = ";
+        if (predicateSelect)
+        {
+            previousValue.assign(out, destinationBegin);
+            print(" = select({}, ", predicate);
+        }
+        else
+        {
+            out += " = ";
+        }
 
-        if (instr.vectorSaturate)
+        if (alu.vectorSaturate)
             out += "saturate(";
 
-        switch (instr.vectorOpcode)
+        switch (alu.vectorOpcode)
         {
         case AluVectorOpcode::Add:
-            print("{} + {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} + {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Mul:
-            print("{} * {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} * {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Max:
         case AluVectorOpcode::MaxA:
-            print("max({}, {})", op(VECTOR_0), op(VECTOR_1));
+            // Moves are encoded as the maximum of a value with itself.
+            if (alu.vectorOpcode == AluVectorOpcode::Max && alu.vectorSources[0] == alu.vectorSources[1])
+                out += op(alu.vectorSources[0]);
+            else
+                print("max({}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Min:
-            print("min({}, {})", op(VECTOR_0), op(VECTOR_1));
+            print("min({}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Seq:
-            print("{} == {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} == {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Sgt:
-            print("{} > {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} > {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Sge:
-            print("{} >= {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} >= {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Sne:
-            print("{} != {}", op(VECTOR_0), op(VECTOR_1));
+            print("{} != {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Frc:
-            print("frac({})", op(VECTOR_0));
+            print("frac({})", op(alu.vectorSources[0]));
             break;
 
         case AluVectorOpcode::Trunc:
-            print("trunc({})", op(VECTOR_0));
+            print("trunc({})", op(alu.vectorSources[0]));
             break;
 
         case AluVectorOpcode::Floor:
-            print("floor({})", op(VECTOR_0));
+            print("floor({})", op(alu.vectorSources[0]));
             break;
 
         case AluVectorOpcode::Mad:
-            print("{} * {} + {}", op(VECTOR_0), op(VECTOR_1), op(VECTOR_2));
+            print("{} * {} + {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]), op(alu.vectorSources[2]));
             break;
 
         case AluVectorOpcode::CndEq:
-            print("select({} == 0.0, {}, {})", op(VECTOR_0), op(VECTOR_1), op(VECTOR_2));
+            print("select({} == 0.0, {}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]), op(alu.vectorSources[2]));
             break;
 
         case AluVectorOpcode::CndGe:
-            print("select({} >= 0.0, {}, {})", op(VECTOR_0), op(VECTOR_1), op(VECTOR_2));
+            print("select({} >= 0.0, {}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]), op(alu.vectorSources[2]));
             break;
 
         case AluVectorOpcode::CndGt:
-            print("select({} > 0.0, {}, {})", op(VECTOR_0), op(VECTOR_1), op(VECTOR_2));
+            print("select({} > 0.0, {}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]), op(alu.vectorSources[2]));
             break;
 
         case AluVectorOpcode::Dp4:
         case AluVectorOpcode::Dp3:
-            print("dot({}, {})", op(VECTOR_0), op(VECTOR_1));
+            print("dot({}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Dp2Add:
-            print("dot({}, {}) + {}", op(VECTOR_0), op(VECTOR_1), op(VECTOR_2));
+            print("dot({}, {}) + {}", op(alu.vectorSources[0]), op(alu.vectorSources[1]), op(alu.vectorSources[2]));
             break;
 
         case AluVectorOpcode::Cube:
-            print("cube(r{}, cubeMapData)", instr.src1Register);
+            print("cube(r{}, cubeMapData)", alu.vectorSources[0].reg);
             break;
 
         case AluVectorOpcode::Max4:
-            print("max4({})", op(VECTOR_0));
+            print("max4({})", op(alu.vectorSources[0]));
             break;
 
         case AluVectorOpcode::SetpEqPush:
         case AluVectorOpcode::SetpNePush:
         case AluVectorOpcode::SetpGtPush:
         case AluVectorOpcode::SetpGePush:
-            print("p0 ? 0.0 : {} + 1.0", op(VECTOR_0));
+            print("p0 ? 0.0 : {} + 1.0", op(alu.vectorSources[0]));
             break;
 
         case AluVectorOpcode::KillEq:
-            print("any({} == {})", op(VECTOR_0), op(VECTOR_1));
+            print("any({} == {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::KillGt:
-            print("any({} > {})", op(VECTOR_0), op(VECTOR_1));
+            print("any({} > {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::KillGe:
-            print("any({} >= {})", op(VECTOR_0), op(VECTOR_1));
+            print("any({} >= {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::KillNe:
-            print("any({} != {})", op(VECTOR_0), op(VECTOR_1));
+            print("any({} != {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
 
         case AluVectorOpcode::Dst:
-            print("dst({}, {})", op(VECTOR_0), op(VECTOR_1));
+            print("dst({}, {})", op(alu.vectorSources[0]), op(alu.vectorSources[1]));
             break;
         }
 
-        if (instr.vectorSaturate)
+        if (alu.vectorSaturate)
             out += ')';
 
+        if (predicateSelect)
+            print(", {})", previousValue);
+
         out += ";\n";
     }
 
-    if (instr.scalarOpcode != AluScalarOpcode::RetainPrev)
+    if (alu.scalarOpcode != AluScalarOpcode::RetainPrev && computeScalar)
     {
-        if (instr.scalarOpcode >= AluScalarOpcode::SetpEq && instr.scalarOpcode <= AluScalarOpcode::SetpRstr)
+        if (alu.scalarOpcode >= AluScalarOpcode::SetpEq && alu.scalarOpcode <= AluScalarOpcode::SetpRstr && emitSideEffects)
         {
             indent();
             out += "p0 = ";
 
-            switch (instr.scalarOpcode)
+            switch (alu.scalarOpcode)
             {
             case AluScalarOpcode::SetpEq:
-                print("{} == 0.0", op(SCALAR_0));
+                print("{} == 0.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpNe:
-                print("{} != 0.0", op(SCALAR_0));
+                print("{} != 0.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpGt:
-                print("{} > 0.0", op(SCALAR_0));
+                print("{} > 0.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpGe:
-                print("{} >= 0.0", op(SCALAR_0));
+                print("{} >= 0.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpInv:
-                print("{} == 1.0", op(SCALAR_0));
+                print("{} == 1.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpPop:
-                print("{} - 1.0 <= 0.0", op(SCALAR_0));
+                print("{} - 1.0 <= 0.0", op(alu.scalarSources[0]));
                 break;
 
             case AluScalarOpcode::SetpClr:
@@ -843,7 +957,7 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
                 break;
 
             case AluScalarOpcode::SetpRstr:
-                print("{} == 0.0", op(SCALAR_0));
+                print("{} == 0.0", op(alu.scalarSources[0]));
                 break;
             }
 
@@ -851,94 +965,110 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         }
 
         indent();
-        out += "ps = ";
-        if (instr.scalarSaturate)
+        if (predicateSelect)
+            print("{} = select({}, ", previousScalar, predicate);
+        else
+            print("{} = ", previousScalar);
+
+        if (alu.scalarSaturate)
             out += "saturate(";
 
-        switch (instr.scalarOpcode)
+        switch (alu.scalarOpcode)
         {
         case AluScalarOpcode::Adds:
-            print("{} + {}", op(SCALAR_0), op(SCALAR_1));
+            print("{} + {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::AddsPrev:
-            print("{} + ps", op(SCALAR_0));
+            print("{} + {}", op(alu.scalarSources[0]), previousScalar);
             break;
 
         case AluScalarOpcode::Muls:
-            print("{} * {}", op(SCALAR_0), op(SCALAR_1));
+            print("{} * {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::MulsPrev:
         case AluScalarOpcode::MulsPrev2:
-            print("{} * ps", op(SCALAR_0));
+            print("{} * {}", op(alu.scalarSources[0]), previousScalar);
             break;
 
         case AluScalarOpcode::Maxs:
         case AluScalarOpcode::MaxAs:
         case AluScalarOpcode::MaxAsf:
-            print("max({}, {})", op(SCALAR_0), op(SCALAR_1));
+            if (alu.scalarOpcode == AluScalarOpcode::Maxs && alu.scalarSources[0] == alu.scalarSources[1])
+                out += op(alu.scalarSources[0]);
+            else
+                print("max({}, {})", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::Mins:
-            print("min({}, {})", op(SCALAR_0), op(SCALAR_1));
+            print("min({}, {})", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::Seqs:
-            print("{} == 0.0", op(SCALAR_0));
+            print("{} == 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Sgts:
-            print("{} > 0.0", op(SCALAR_0));
+            print("{} > 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Sges:
-            print("{} >= 0.0", op(SCALAR_0));
+            print("{} >= 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Snes:
-            print("{} != 0.0", op(SCALAR_0));
+            print("{} != 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Frcs:
-            print("frac({})", op(SCALAR_0));
+            print("frac({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Truncs:
-            print("trunc({})", op(SCALAR_0));
+            print("trunc({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Floors:
-            print("floor({})", op(SCALAR_0));
+            print("floor({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Exp:
-            print("exp2({})", op(SCALAR_0));
+            print("exp2({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Logc:
         case AluScalarOpcode::Log:
-            print("clamp(log2({}), FLT_MIN, FLT_MAX)", op(SCALAR_0));
+            if (alu.omitScalarClamp)
+                print("log2({})", op(alu.scalarSources[0]));
+            else
+                print("clamp(log2({}), FLT_MIN, FLT_MAX)", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Rcpc:
         case AluScalarOpcode::Rcpf:
         case AluScalarOpcode::Rcp:
-            print("clamp(rcp({}), FLT_MIN, FLT_MAX)", op(SCALAR_0));
+            if (alu.omitScalarClamp)
+                print("rcp({})", op(alu.scalarSources[0]));
+            else
+                print("clamp(rcp({}), FLT_MIN, FLT_MAX)", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Rsqc:
         case AluScalarOpcode::Rsqf:
         case AluScalarOpcode::Rsq:
-            print("clamp(rsqrt({}), FLT_MIN, FLT_MAX)", op(SCALAR_0));
+            if (alu.omitScalarClamp)
+                print("rsqrt({})", op(alu.scalarSources[0]));
+            else
+                print("clamp(rsqrt({}), FLT_MIN, FLT_MAX)", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Subs:
-            print("{} - {}", op(SCALAR_0), op(SCALAR_1));
+            print("{} - {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::SubsPrev:
-            print("{} - ps", op(SCALAR_0));
+            print("{} - {}", op(alu.scalarSources[0]), previousScalar);
             break;
 
         case AluScalarOpcode::SetpEq:
@@ -949,11 +1079,11 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
             break;
 
         case AluScalarOpcode::SetpInv:
-            print("{0} == 0.0 ? 1.0 : {0}", op(SCALAR_0));
+            print("{0} == 0.0 ? 1.0 : {0}", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::SetpPop:
-            print("p0 ? 0.0 : ({} - 1.0)", op(SCALAR_0));
+            print("p0 ? 0.0 : ({} - 1.0)", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::SetpClr:
@@ -961,82 +1091,87 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
             break;
 
         case AluScalarOpcode::SetpRstr:
-            print("p0 ? 0.0 : {}", op(SCALAR_0));
+            print("p0 ? 0.0 : {}", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::KillsEq:
-            print("{} == 0.0", op(SCALAR_0));
+            print("{} == 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::KillsGt:
-            print("{} > 0.0", op(SCALAR_0));
+            print("{} > 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::KillsGe:
-            print("{} >= 0.0", op(SCALAR_0));
+            print("{} >= 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::KillsNe:
-            print("{} != 0.0", op(SCALAR_0));
+            print("{} != 0.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::KillsOne:
-            print("{} == 1.0", op(SCALAR_0));
+            print("{} == 1.0", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Sqrt:
-            print("sqrt({})", op(SCALAR_0));
+            print("sqrt({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Mulsc0:
         case AluScalarOpcode::Mulsc1:
-            print("{} * {}", op(SCALAR_CONSTANT_0), op(SCALAR_CONSTANT_1));
+            print("{} * {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::Addsc0:
         case AluScalarOpcode::Addsc1:
-            print("{} + {}", op(SCALAR_CONSTANT_0), op(SCALAR_CONSTANT_1));
+            print("{} + {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::Subsc0:
         case AluScalarOpcode::Subsc1:
-            print("{} - {}", op(SCALAR_CONSTANT_0), op(SCALAR_CONSTANT_1));
+            print("{} - {}", op(alu.scalarSources[0]), op(alu.scalarSources[1]));
             break;
 
         case AluScalarOpcode::Sin:
-            print("sin({})", op(SCALAR_0));
+            print("sin({})", op(alu.scalarSources[0]));
             break;
 
         case AluScalarOpcode::Cos:
-            print("cos({})", op(SCALAR_0));
+            print("cos({})", op(alu.scalarSources[0]));
             break;
         }
 
-        if (instr.scalarSaturate)
+        if (alu.scalarSaturate)
             out += ')';
 
+        if (predicateSelect)
+            print(", {})", previousScalar);
+
         out += ";\n";
 
-        switch (instr.scalarOpcode)
+        if (emitSideEffects)
         {
-        case AluScalarOpcode::MaxAs:
-            indent();
-            println("a0 = (int)clamp(floor({} + 0.5), -256.0, 255.0);", op(SCALAR_0));
-            break;     
-        case AluScalarOpcode::MaxAsf:
-            indent();
-            println("a0 = (int)clamp(floor({}), -256.0, 255.0);", op(SCALAR_0));
-            break;
+            switch (alu.scalarOpcode)
+            {
+            case AluScalarOpcode::MaxAs:
+                indent();
+                println("a0 = (int)clamp(floor({} + 0.5), -256.0, 255.0);", op(alu.scalarSources[0]));
+                break;
+            case AluScalarOpcode::MaxAsf:
+                indent();
+                println("a0 = (int)clamp(floor({}), -256.0, 255.0);", op(alu.scalarSources[0]));
+                break;
+            }
         }
     }
 
-    uint32_t scalarWriteMask = instr.scalarWriteMask;
-    if (instr.exportData)
-        scalarWriteMask &= ~instr.vectorWriteMask;
-
-    if (scalarWriteMask != 0)
+    uint32_t scalarWriteMask = alu.scalarWriteMask;
+    if (scalarWriteMask != 0 && writeScalar)
     {
         indent();
+        size_t destinationBegin = out.size();
+
         if (!exportRegister.empty())
         {
             out += exportRegister;
@@ -1044,7 +1179,7 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         }
         else
         {
-            print("r{}.", instr.scalarDest);
+            print("{}{}.", registerPrefix, alu.scalarDest);
         }
 
         for (size_t i = 0; i < 4; i++)
@@ -1053,13 +1188,21 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
                 out += SWIZZLES[i];
         }
 
-        out += " = ps;\n";
+        if (predicateSelect)
+        {
+            previousValue.assign(out, destinationBegin);
+            println(" = select({}, {}, {});", predicate, previousScalar, previousValue);
+        }
+        else
+        {
+            println(" = {};", previousScalar);
+        }
     }
 
-    if (instr.exportData)
+    if (alu.exportData && emitSideEffects)
     {
-        uint32_t zeroMask = instr.scalarDestRelative ? (0b1111 & ~(instr.vectorWriteMask | instr.scalarWriteMask)) : 0;
-        uint32_t oneMask = instr.vectorWriteMask & instr.scalarWriteMask;
+        uint32_t zeroMask = alu.exportZeroMask;
+        uint32_t oneMask = alu.exportOneMask;
 
         for (size_t i = 0; i < 4; i++)
         {
@@ -1077,7 +1220,7 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         }
     }
 
-    if (instr.scalarOpcode >= AluScalarOpcode::KillsEq && instr.scalarOpcode <= AluScalarOpcode::KillsOne)
+    if (alu.scalarOpcode >= AluScalarOpcode::KillsEq && alu.scalarOpcode <= AluScalarOpcode::KillsOne && emitSideEffects)
     {
         indent();
         out += "clip(ps != 0.0 ? -1 : 1);\n";
@@ -1089,179 +1232,533 @@ void ShaderRecompiler::recompile(const AluInstruction& instr)
         indent();
         out += "}\n";
     }
-
-    if (instr.isPredicated)
-    {
-        --indentation;
-        indent();
-        out += "}\n";
-    }
 }
 
-void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_view& include)
-{
-    const auto shaderContainer = reinterpret_cast<const ShaderContainer*>(shaderData);
+#ifdef UNLEASHED_RECOMP
 
-    assert((shaderContainer->flags & 0xFFFFFF00) == 0x102A1100);
-    assert(shaderContainer->constantTableOffset != NULL);
+bool ShaderRecompiler::isReverseZ(const IrOperand& operand) const
+{
+    if (operand.isLiteral)
+        return false;
 
-    out += include;
-    out += '\n';
+    if (!operand.isConstant)
+        return (reverseZRegisters & (1ull << operand.reg)) != 0;
 
-    isPixelShader = (shaderContainer->flags & 0x1) == 0;
+    auto constantInfo = float4Constants[operand.reg];
+    return constantInfo != nullptr && strcmp(constantInfo->name, "g_MtxProjection") == 0;
+}
+
+bool ShaderRecompiler::isVectorReverseZ(const IrAlu& alu) const
+{
+    for (uint32_t i = 0; i < alu.vectorSourceCount; i++)
+    {
+        if (isReverseZ(alu.vectorSources[i]))
+            return true;
+    }
 
-    const auto constantTableContainer = reinterpret_cast<const ConstantTableContainer*>(shaderData + shaderContainer->constantTableOffset);
-    constantTableData = reinterpret_cast<const uint8_t*>(&constantTableContainer->constantTable);
+    return false;
+}
 
-    out += "#ifdef __spirv__\n\n";
+bool ShaderRecompiler::isScalarReverseZ(const IrInstruction& instr) const
+{
+    auto& alu = instr.alu;
+    for (uint32_t i = 0; i < alu.scalarSourceCount; i++)
+    {
+        if (isReverseZ(alu.scalarSources[i]))
+            return true;
+    }
 
-#ifdef UNLEASHED_RECOMP
-    bool isMetaInstancer = false;
-    bool hasIndexCount = false;
-#endif
+    return reverseZPreviousScalar && (instr.stateReads & IR_STATE_PS) != 0;
+}
+
+bool ShaderRecompiler::isTextureFetchReverseZ(const IrInstruction& instr) const
+{
+    return instr.kind == IrInstructionKind::TextureFetch && instr.textureFetch.isSupported() &&
+        (reverseZRegisters & (1ull << instr.textureFetch.srcRegister)) != 0;
+}
 
-    for (uint32_t i = 0; i < constantTableContainer->constantTable.constants; i++)
+void ShaderRecompiler::sliceReverseZ()
+{
+    // Every write to a register holding such a value anywhere in the shader keeps its copy up to date, so the
+    // registers are found without following the control flow.
+    bool changed = true;
+    while (changed)
     {
-        const auto constantInfo = reinterpret_cast<const ConstantInfo*>(
-            constantTableData + constantTableContainer->constantTable.constantInfo + i * sizeof(ConstantInfo));
+        changed = false;
 
-        const char* constantName = reinterpret_cast<const char*>(constantTableData + constantInfo->name);
+        for (auto& instr : ir.instructions)
+        {
+            if (instr.isDead)
+                continue;
 
-    #ifdef UNLEASHED_RECOMP
-        if (!isPixelShader)
-        {
-            if (strcmp(constantName, "g_MtxProjection") == 0)
-                hasMtxProjection = true;
-            else if (strcmp(constantName, "g_InstanceTypes") == 0)
-                isMetaInstancer = true;
-            else if (strcmp(constantName, "g_IndexCount") == 0)
-                hasIndexCount = true;
+            if (isTextureFetchReverseZ(instr) && instr.writeCount != 0 && (reverseZRegisters & (1ull << instr.writes[0].reg)) == 0)
+            {
+                reverseZRegisters |= 1ull << instr.writes[0].reg;
+                changed = true;
+            }
+
+            if (instr.kind != IrInstructionKind::Alu)
+                continue;
+
+            auto& alu = instr.alu;
+            uint64_t registers = reverseZRegisters;
+            bool previousScalar = reverseZPreviousScalar;
+
+            if (isVectorReverseZ(alu) && alu.vectorWriteMask != 0 && !alu.exportData)
+                registers |= 1ull << alu.vectorDest;
+
+            if (isScalarReverseZ(instr))
+            {
+                if (alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+                    previousScalar = true;
+
+                if (alu.scalarWriteMask != 0 && !alu.exportData)
+                    registers |= 1ull << alu.scalarDest;
+            }
+
+            changed |= registers != reverseZRegisters || previousScalar != reverseZPreviousScalar;
+            reverseZRegisters = registers;
+            reverseZPreviousScalar = previousScalar;
         }
-        else
+    }
+
+    // Predicates, addressing and kills are shared between both copies.
+    isReverseZSliced = true;
+
+    for (auto& instr : ir.instructions)
+    {
+        if (!instr.isDead && instr.kind == IrInstructionKind::Alu)
         {
-            if (strcmp(constantName, "g_MtxPrevInvViewProjection") == 0)
-                hasMtxPrevInvViewProjection = true;
+            auto& alu = instr.alu;
+
+            if (isVectorReverseZ(alu) && ((alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::KillNe) ||
+                alu.vectorOpcode == AluVectorOpcode::MaxA || alu.vectorOpcode == AluVectorOpcode::Cube))
+            {
+                isReverseZSliced = false;
+            }
+
+            if (isScalarReverseZ(instr) && ((alu.scalarOpcode >= AluScalarOpcode::SetpEq && alu.scalarOpcode <= AluScalarOpcode::SetpRstr) ||
+                alu.scalarOpcode == AluScalarOpcode::MaxAs || alu.scalarOpcode == AluScalarOpcode::MaxAsf ||
+                (alu.scalarOpcode >= AluScalarOpcode::KillsEq && alu.scalarOpcode <= AluScalarOpcode::KillsOne)))
+            {
+                isReverseZSliced = false;
+            }
         }
-    #endif
+    }
+
+    if (!isReverseZSliced)
+    {
+        reverseZRegisters = 0;
+        reverseZPreviousScalar = false;
+        return;
+    }
 
-        switch (constantInfo->registerSet)
+    // Only the copies the position export reads are kept. Going backwards from it, every instruction whose copy is
+    // read makes the copies of its own sources read as well.
+    uint64_t neededRegisters = 0;
+    bool neededPreviousScalar = false;
+
+    auto markSources = [&](const IrOperand* sources, uint32_t sourceCount)
         {
-        case RegisterSet::Float4:
+            for (uint32_t i = 0; i < sourceCount; i++)
+            {
+                if (!sources[i].isConstant && isReverseZ(sources[i]))
+                    neededRegisters |= 1ull << sources[i].reg;
+            }
+        };
+
+    changed = true;
+    while (changed)
+    {
+        uint64_t registers = neededRegisters;
+        bool previousScalar = neededPreviousScalar;
+
+        for (auto& instr : ir.instructions)
         {
-            const char* shaderName = isPixelShader ? "Pixel" : "Vertex";
+            if (instr.isDead)
+                continue;
 
-            if (constantInfo->registerCount > 1)
-            {
-                uint32_t tailCount = (isPixelShader ? 224 : 256) - constantInfo->registerIndex;
+            if (isTextureFetchReverseZ(instr) && instr.writeCount != 0 && (neededRegisters & (1ull << instr.writes[0].reg)) != 0)
+                neededRegisters |= 1ull << instr.textureFetch.srcRegister;
 
-                println("#define {}(INDEX) select((INDEX) < {}, vk::RawBufferLoad<float4>(g_PushConstants.{}ShaderConstants + ({} + min(INDEX, {})) * 16, 0x10), 0.0)",
-                    constantName, tailCount, shaderName, constantInfo->registerIndex.get(), tailCount - 1);
-            }
-            else
+            if (instr.kind != IrInstructionKind::Alu)
+                continue;
+
+            auto& alu = instr.alu;
+            auto isNeeded = [&](uint32_t dest)
+                {
+                    if (alu.exportData)
+                        return ExportRegister(alu.vectorDest) == ExportRegister::VSPosition;
+
+                    return (neededRegisters & (1ull << dest)) != 0;
+                };
+
+            if (isVectorReverseZ(alu) && alu.vectorWriteMask != 0 && isNeeded(alu.vectorDest))
+                markSources(alu.vectorSources, alu.vectorSourceCount);
+
+            if (isScalarReverseZ(instr) && ((alu.scalarWriteMask != 0 && isNeeded(alu.scalarDest)) ||
+                (neededPreviousScalar && alu.scalarOpcode != AluScalarOpcode::RetainPrev)))
             {
-                println("#define {} vk::RawBufferLoad<float4>(g_PushConstants.{}ShaderConstants + {}, 0x10)",
-                    constantName, shaderName, constantInfo->registerIndex * 16);
+                markSources(alu.scalarSources, alu.scalarSourceCount);
+
+                if (reverseZPreviousScalar && (instr.stateReads & IR_STATE_PS) != 0)
+                    neededPreviousScalar = true;
             }
-            
-            for (uint16_t j = 0; j < constantInfo->registerCount; j++)
-                float4Constants.emplace(constantInfo->registerIndex + j, constantInfo);
+        }
 
-            break;
+        changed = registers != neededRegisters || previousScalar != neededPreviousScalar;
+    }
+
+    reverseZRegisters = neededRegisters;
+    reverseZPreviousScalar = neededPreviousScalar;
+
+    // The scalar copy is computed into psz even when only the destination register reads it.
+    for (auto& instr : ir.instructions)
+    {
+        if (!instr.isDead && instr.kind == IrInstructionKind::Alu && instr.alu.scalarOpcode != AluScalarOpcode::RetainPrev &&
+            isScalarReverseZ(instr) && instr.alu.scalarWriteMask != 0 && isReverseZDestination(instr.alu, instr.alu.scalarDest))
+        {
+            hasReverseZScalar = true;
         }
+    }
+}
+
+bool ShaderRecompiler::isReverseZDestination(const IrAlu& alu, uint32_t dest) const
+{
+    if (alu.exportData)
+        return ExportRegister(alu.vectorDest) == ExportRegister::VSPosition;
+
+    return (reverseZRegisters & (1ull << dest)) != 0;
+}
 
-        case RegisterSet::Sampler:
+bool ShaderRecompiler::isReverseZCopied(const IrInstruction& instr) const
+{
+    if (instr.kind != IrInstructionKind::Alu)
+        return isTextureFetchReverseZ(instr) && instr.writeCount != 0 && (reverseZRegisters & (1ull << instr.writes[0].reg)) != 0;
+
+    auto& alu = instr.alu;
+    if (isVectorReverseZ(alu) && alu.vectorWriteMask != 0 && isReverseZDestination(alu, alu.vectorDest))
+        return true;
+
+    return isScalarReverseZ(instr) && ((alu.scalarWriteMask != 0 && isReverseZDestination(alu, alu.scalarDest)) ||
+        (reverseZPreviousScalar && alu.scalarOpcode != AluScalarOpcode::RetainPrev));
+}
+
+void ShaderRecompiler::copyReverseZ(const IrInstruction& instr)
+{
+    const char* predicate = instr.predicateCondition ? "p0" : "!p0";
+
+    auto copyRegister = [&](uint32_t reg, uint32_t mask)
         {
-            for (size_t j = 0; j < std::size(TEXTURE_DIMENSIONS); j++)
+            if (mask == 0 || (reverseZRegisters & (1ull << reg)) == 0)
+                return;
+
+            char swizzle[5]{};
+            size_t swizzleSize = 0;
+            for (size_t i = 0; i < 4; i++)
             {
-                println("#define {}_Texture{}DescriptorIndex vk::RawBufferLoad<uint>(g_PushConstants.SharedConstants + {})",
-                    constantName, TEXTURE_DIMENSIONS[j], j * 64 + constantInfo->registerIndex * 4);
+                if ((mask >> i) & 0x1)
+                    swizzle[swizzleSize++] = SWIZZLES[i];
             }
 
-            println("#define {}_SamplerDescriptorIndex vk::RawBufferLoad<uint>(g_PushConstants.SharedConstants + {})",
-                constantName, std::size(TEXTURE_DIMENSIONS) * 64 + constantInfo->registerIndex * 4);
+            indent();
+            if (predicateSelect)
+                println("rz{0}.{1} = select({2}, r{0}.{1}, rz{0}.{1});", reg, swizzle, predicate);
+            else
+                println("rz{0}.{1} = r{0}.{1};", reg, swizzle);
+        };
 
-            samplers.emplace(constantInfo->registerIndex, constantName);
-            break;
+    if (instr.kind != IrInstructionKind::Alu)
+    {
+        if (!isTextureFetchReverseZ(instr))
+        {
+            for (uint32_t i = 0; i < instr.writeCount; i++)
+                copyRegister(instr.writes[i].reg, instr.writes[i].mask);
         }
 
+        return;
+    }
+
+    auto& alu = instr.alu;
+
+    if (!alu.exportData && !isVectorReverseZ(alu))
+        copyRegister(alu.vectorDest, alu.vectorWriteMask);
+
+    if (!isScalarReverseZ(instr))
+    {
+        if (reverseZPreviousScalar && alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+        {
+            indent();
+            if (predicateSelect)
+                println("psz = select({}, ps, psz);", predicate);
+            else
+                out += "psz = ps;\n";
         }
+
+        if (!alu.exportData)
+            copyRegister(alu.scalarDest, alu.scalarWriteMask);
     }
+}
 
-    out += "\n#else\n\n";
+#endif
 
-    println("cbuffer {}ShaderConstants : register(b{}, space4)", isPixelShader ? "Pixel" : "Vertex", isPixelShader ? 1 : 0);
-    out += "{\n";
+bool ShaderRecompiler::hasDeclaredVertexFetches() const
+{
+    std::bitset<4096> declared;
+    for (auto& vertexElement : container.vertexElements)
+        declared.set(vertexElement.address);
+
+    // Dead fetches are checked too, so this doesn't depend on the analysis or on which exports get linked away.
+    for (auto& instr : ir.instructions)
+    {
+        if (instr.kind == IrInstructionKind::VertexFetch && (instr.address >= declared.size() || !declared.test(instr.address)))
+            return false;
+    }
+
+    return true;
+}
+
+bool ShaderRecompiler::validate(const uint8_t* shaderData, size_t dataSize)
+{
+    if (!container.parse(shaderData, dataSize))
+        return false;
+
+    if (container.isPixelShader)
+        return true;
+
+    ir.decode(container.code, container.codeSize);
+    return hasDeclaredVertexFetches();
+}
+
+bool ShaderRecompiler::recompile(const uint8_t* shaderData, size_t dataSize, const std::string_view& include)
+{
+    if (!container.parse(shaderData, dataSize))
+        return false;
+
+    isPixelShader = container.isPixelShader;
+
+    // Named constants are registered first, as they keep literals sharing their registers from being propagated.
+    for (auto& constant : container.getConstants(RegisterSet::Float4))
+    {
+        for (uint16_t i = 0; i < constant.registerCount; i++)
+        {
+            uint32_t reg = constant.registerIndex + i;
+            if (reg < std::size(float4Constants) && float4Constants[reg] == nullptr)
+                float4Constants[reg] = &constant;
+        }
+    }
 
-    for (uint32_t i = 0; i < constantTableContainer->constantTable.constants; i++)
+    ir.decode(container.code, container.codeSize);
+
+    if (!isPixelShader && !hasDeclaredVertexFetches())
+        return false;
+
+    out += include;
+    out += '\n';
+
+    // Literals get propagated into the instructions, unless a named constant shares the register.
+    for (auto& definition : container.float4Definitions)
+    {
+        for (uint16_t i = 0; i < (definition.count + 3) / 4; i++)
+        {
+            uint32_t reg = definition.registerIndex + i - (isPixelShader ? 256 : 0);
+            if (reg < std::size(ir.literals) && float4Constants[reg] == nullptr)
+            {
+                for (size_t j = 0; j < 4; j++)
+                    ir.literals[reg][j] = definition.values[i * 4 + j];
+
+                ir.definedLiterals.set(reg);
+            }
+        }
+    }
+
+    for (auto& definition : container.int4Definitions)
+    {
+        for (uint16_t i = 0; i < definition.count; i++)
+        {
+            uint32_t reg = (definition.registerIndex - 8992) / 4 + i;
+            if (reg < std::size(ir.loopConstants))
+            {
+                ir.loopConstants[reg] = definition.values[i];
+                ir.definedLoopConstants.set(reg);
+            }
+        }
+    }
+
+    if (!isPixelShader)
     {
-        const auto constantInfo = reinterpret_cast<const ConstantInfo*>(
-            constantTableData + constantTableContainer->constantTable.constantInfo + i * sizeof(ConstantInfo));
+        uint64_t removedExports = 0;
+        for (size_t i = 0; i < container.interpolators.size() && i < 64; i++)
+        {
+            auto& interpolator = container.interpolators[i];
+            for (size_t j = 0; j < std::size(INTERPOLATORS); j++)
+            {
+                if (INTERPOLATORS[j].first == interpolator.usage && INTERPOLATORS[j].second == interpolator.usageIndex &&
+                    (linkedInterpolators & (1u << j)) == 0)
+                {
+                    removedExports |= 1ull << i;
+                }
+            }
+        }
+
+        if (removedExports != 0)
+            ir.removeExports(removedExports);
+    }
+
+    ir.analyze();
 
-        if (constantInfo->registerSet == RegisterSet::Float4)
+    // Arrays get a variant without the range check for relative accesses known to stay inside them.
+    auto hasUnclampedAccess = [&](const ParsedConstant* constantInfo)
         {
-            const char* constantName = reinterpret_cast<const char*>(constantTableData + constantInfo->name);
+            auto isUnclamped = [&](const IrOperand& operand)
+                {
+                    return operand.isConstant && !operand.isLiteral && isIndexInRange(operand, constantInfo);
+                };
 
-            print("\tfloat4 {}", constantName);
+            for (auto& instr : ir.instructions)
+            {
+                if (instr.isDead || instr.kind != IrInstructionKind::Alu)
+                    continue;
+
+                for (uint32_t j = 0; j < instr.alu.vectorSourceCount; j++)
+                {
+                    if (isUnclamped(instr.alu.vectorSources[j]))
+                        return true;
+                }
 
-            if (constantInfo->registerCount > 1)
-                print("[{}]", constantInfo->registerCount.get());
+                for (uint32_t j = 0; j < instr.alu.scalarSourceCount; j++)
+                {
+                    if (isUnclamped(instr.alu.scalarSources[j]))
+                        return true;
+                }
+            }
 
-            println(" : packoffset(c{});", constantInfo->registerIndex.get());
+            return false;
+        };
 
-            if (constantInfo->registerCount > 1)
+#ifdef UNLEASHED_RECOMP
+    for (auto& registerSetConstants : container.constants)
+    {
+        for (auto& constant : registerSetConstants)
+        {
+            if (!isPixelShader)
+            {
+                if (strcmp(constant.name, "g_MtxProjection") == 0)
+                    hasMtxProjection = true;
+                else if (strcmp(constant.name, "g_InstanceTypes") == 0)
+                    isMetaInstancer = true;
+                else if (strcmp(constant.name, "g_IndexCount") == 0)
+                    hasIndexCount = true;
+            }
+            else
             {
-                uint32_t tailCount = (isPixelShader ? 224 : 256) - constantInfo->registerIndex;
-                println("#define {0}(INDEX) select((INDEX) < {1}, {0}[min(INDEX, {2})], 0.0)", constantName, tailCount, tailCount - 1);
+                if (strcmp(constant.name, "g_MtxPrevInvViewProjection") == 0)
+                    hasMtxPrevInvViewProjection = true;
             }
         }
     }
 
-    out += "};\n\n";
+    if (hasMtxProjection)
+        sliceReverseZ();
 
-    out += "cbuffer SharedConstants : register(b2, space4)\n";
-    out += "{\n";
+    bool hasProjectionLoop = hasMtxProjection && !isReverseZSliced;
+#endif
+
+    out += "#ifdef __spirv__\n\n";
 
-    for (uint32_t i = 0; i < constantTableContainer->constantTable.constants; i++)
+    for (auto& constant : container.getConstants(RegisterSet::Float4))
     {
-        const auto constantInfo = reinterpret_cast<const ConstantInfo*>(
-            constantTableData + constantTableContainer->constantTable.constantInfo + i * sizeof(ConstantInfo));
+        const char* shaderName = isPixelShader ? "Pixel" : "Vertex";
 
-        if (constantInfo->registerSet == RegisterSet::Sampler)
+        if (constant.registerCount > 1)
         {
-            const char* constantName = reinterpret_cast<const char*>(constantTableData + constantInfo->name);
+            uint32_t tailCount = (isPixelShader ? 224 : 256) - constant.registerIndex;
+
+            println("#define {}(INDEX) select((INDEX) < {}, vk::RawBufferLoad<float4>(g_PushConstants.{}ShaderConstants + ({} + min(INDEX, {})) * 16, 0x10), 0.0)",
+                constant.name, tailCount, shaderName, constant.registerIndex, tailCount - 1);
 
-            for (size_t j = 0; j < std::size(TEXTURE_DIMENSIONS); j++)
+            if (hasUnclampedAccess(&constant))
             {
-                println("\tuint {}_Texture{}DescriptorIndex : packoffset(c{}.{});",
-                    constantName, TEXTURE_DIMENSIONS[j], j * 4 + constantInfo->registerIndex / 4, SWIZZLES[constantInfo->registerIndex % 4]);
+                println("#define {}_Unclamped(INDEX) vk::RawBufferLoad<float4>(g_PushConstants.{}ShaderConstants + ({} + (INDEX)) * 16, 0x10)",
+                    constant.name, shaderName, constant.registerIndex);
             }
+        }
+        else
+        {
+            println("#define {} vk::RawBufferLoad<float4>(g_PushConstants.{}ShaderConstants + {}, 0x10)",
+                constant.name, shaderName, constant.registerIndex * 16);
+        }
+    }
 
-            println("\tuint {}_SamplerDescriptorIndex : packoffset(c{}.{});",
-                constantName, 4 * std::size(TEXTURE_DIMENSIONS) + constantInfo->registerIndex / 4, SWIZZLES[constantInfo->registerIndex % 4]);
+    for (auto& constant : container.getConstants(RegisterSet::Sampler))
+    {
+        for (size_t j = 0; j < std::size(TEXTURE_DIMENSIONS); j++)
+        {
+            println("#define {}_Texture{}DescriptorIndex vk::RawBufferLoad<uint>(g_PushConstants.SharedConstants + {})",
+                constant.name, TEXTURE_DIMENSIONS[j], j * 64 + constant.registerIndex * 4);
         }
+
+        println("#define {}_SamplerDescriptorIndex vk::RawBufferLoad<uint>(g_PushConstants.SharedConstants + {})",
+            constant.name, std::size(TEXTURE_DIMENSIONS) * 64 + constant.registerIndex * 4);
+
+        if (constant.registerIndex < std::size(samplers) && samplers[constant.registerIndex] == nullptr)
+            samplers[constant.registerIndex] = constant.name;
     }
 
-    out += "\tDEFINE_SHARED_CONSTANTS();\n";
-    out += "};\n\n";
+    out += "\n#else\n\n";
 
-    out += "#endif\n";
+    println("cbuffer {}ShaderConstants : register(b{}, space4)", isPixelShader ? "Pixel" : "Vertex", isPixelShader ? 1 : 0);
+    out += "{\n";
 
-    for (uint32_t i = 0; i < constantTableContainer->constantTable.constants; i++)
+    for (auto& constant : container.getConstants(RegisterSet::Float4))
     {
-        const auto constantInfo = reinterpret_cast<const ConstantInfo*>(
-            constantTableData + constantTableContainer->constantTable.constantInfo + i * sizeof(ConstantInfo));
+        print("\tfloat4 {}", constant.name);
+
+        if (constant.registerCount > 1)
+            print("[{}]", constant.registerCount);
 
-        if (constantInfo->registerSet == RegisterSet::Bool)
+        println(" : packoffset(c{});", constant.registerIndex);
+
+        if (constant.registerCount > 1)
         {
-            const char* constantName = reinterpret_cast<const char*>(constantTableData + constantInfo->name);
-            println("\t#define {} (1 << {})", constantName, constantInfo->registerIndex + (isPixelShader ? 16 : 0));
-            boolConstants.emplace(constantInfo->registerIndex, constantName);
+            uint32_t tailCount = (isPixelShader ? 224 : 256) - constant.registerIndex;
+            println("#define {0}(INDEX) select((INDEX) < {1}, {0}[min(INDEX, {2})], 0.0)", constant.name, tailCount, tailCount - 1);
+
+            if (hasUnclampedAccess(&constant))
+                println("#define {0}_Unclamped(INDEX) {0}[INDEX]", constant.name);
         }
     }
 
-    out += '\n';
+    out += "};\n\n";
+
+    out += "cbuffer SharedConstants : register(b2, space4)\n";
+    out += "{\n";
+
+    for (auto& constant : container.getConstants(RegisterSet::Sampler))
+    {
+        for (size_t j = 0; j < std::size(TEXTURE_DIMENSIONS); j++)
+        {
+            println("\tuint {}_Texture{}DescriptorIndex : packoffset(c{}.{});",
+                constant.name, TEXTURE_DIMENSIONS[j], j * 4 + constant.registerIndex / 4, SWIZZLES[constant.registerIndex % 4]);
+        }
+
+        println("\tuint {}_SamplerDescriptorIndex : packoffset(c{}.{});",
+            constant.name, 4 * std::size(TEXTURE_DIMENSIONS) + constant.registerIndex / 4, SWIZZLES[constant.registerIndex % 4]);
+    }
+
+    out += "\tDEFINE_SHARED_CONSTANTS();\n";
+    out += "};\n\n";
+
+    out += "#endif\n";
 
-    const auto shader = reinterpret_cast<const Shader*>(shaderData + shaderContainer->shaderOffset);
+    for (auto& constant : container.getConstants(RegisterSet::Bool))
+    {
+        println("\t#define {} (1 << {})", constant.name, constant.registerIndex + (isPixelShader ? 16 : 0));
+        if (constant.registerIndex < std::size(boolConstants) && boolConstants[constant.registerIndex] == nullptr)
+            boolConstants[constant.registerIndex] = constant.name;
+    }
+
+    out += '\n';
 
     out += "#ifndef __spirv__\n";
 
@@ -1272,14 +1769,58 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
 
     out += "#endif\n";
 
+    for (auto& interpolator : container.interpolators)
+    {
+        for (size_t i = 0; i < std::size(INTERPOLATORS); i++)
+        {
+            if (INTERPOLATORS[i].first == interpolator.usage && INTERPOLATORS[i].second == interpolator.usageIndex &&
+                (isPixelShader ? (ir.usedRegisters & (1ull << interpolator.reg)) != 0 : (linkedInterpolators & (1u << i)) != 0))
+            {
+                metadata.interpolators |= 1u << i;
+            }
+        }
+    }
+
+    // SPIR-V links stages by location, so only the interpolators in use get declared. DXIL links them by signature row
+    // instead, which requires declaring every interpolator up to the last one in use. Vertex shaders that aren't linked
+    // against known pixel shaders declare every row for DXIL, so that any pixel shader's rows are a subset of theirs.
+    size_t interpolatorCount = 0;
+    if (!isPixelShader && linkedInterpolators == ~0u)
+    {
+        interpolatorCount = std::size(INTERPOLATORS);
+    }
+    else
+    {
+        while ((metadata.interpolators >> interpolatorCount) != 0)
+            ++interpolatorCount;
+    }
+
+    auto printInterpolator = [&](char prefix, size_t index, bool comma)
+        {
+            auto& [usage, usageIndex] = INTERPOLATORS[index];
+            println("\t[[vk::location({0})]] {1} float4 {2}{3}{4} : {5}{4}{6}", index, prefix == 'i' ? "in" : "out", prefix,
+                USAGE_VARIABLES[uint32_t(usage)], usageIndex, USAGE_SEMANTICS[uint32_t(usage)], comma ? "," : "");
+        };
+
     out += "void main(\n";
 
     if (isPixelShader)
     {
         out += "\tin float4 iPos : SV_Position,\n";
 
-        for (auto& [usage, usageIndex] : INTERPOLATORS)
-            println("\tin float4 i{0}{1} : {2}{1},", USAGE_VARIABLES[uint32_t(usage)], usageIndex, USAGE_SEMANTICS[uint32_t(usage)]);
+        // The last interpolator is always in use, so the guard is closed by the end.
+        bool isGuarded = false;
+        for (size_t i = 0; i < interpolatorCount; i++)
+        {
+            bool isUsed = (metadata.interpolators & (1u << i)) != 0;
+            if (isUsed == isGuarded)
+            {
+                out += isUsed ? "#endif\n" : "#ifndef __spirv__\n";
+                isGuarded = !isUsed;
+            }
+
+            printInterpolator('i', i, true);
+        }
 
         out += "#ifdef __spirv__\n";
         out += "\tin bool iFace : SV_IsFrontFace\n";
@@ -1287,40 +1828,27 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
         out += "\tin uint iFace : SV_IsFrontFace\n";
         out += "#endif\n";
 
-        auto pixelShader = reinterpret_cast<const PixelShader*>(shader);
-        if (pixelShader->outputs & PIXEL_SHADER_OUTPUT_COLOR0)
+        if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_COLOR0)
             out += ",\n\tout float4 oC0 : SV_Target0";
-        if (pixelShader->outputs & PIXEL_SHADER_OUTPUT_COLOR1)
+        if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_COLOR1)
             out += ",\n\tout float4 oC1 : SV_Target1";
-        if (pixelShader->outputs & PIXEL_SHADER_OUTPUT_COLOR2)
+        if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_COLOR2)
             out += ",\n\tout float4 oC2 : SV_Target2";
-        if (pixelShader->outputs & PIXEL_SHADER_OUTPUT_COLOR3)
+        if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_COLOR3)
             out += ",\n\tout float4 oC3 : SV_Target3";
-        if (pixelShader->outputs & PIXEL_SHADER_OUTPUT_DEPTH)
+        if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_DEPTH)
             out += ",\n\tout float oDepth : SV_Depth";
     }
     else
     {
-        auto vertexShader = reinterpret_cast<const VertexShader*>(shader);
-        for (uint32_t i = 0; i < vertexShader->vertexElementCount; i++)
+        for (auto& vertexElement : container.vertexElements)
         {
-            union
-            {
-                VertexElement vertexElement;
-                uint32_t value;
-            };
-
-            value = vertexShader->vertexElementsAndInterpolators[vertexShader->field18 + i];
+            auto& vertexInput = vertexInputs.emplace_back();
+            vertexInput.usage = uint8_t(vertexElement.usage);
+            vertexInput.usageIndex = uint8_t(vertexElement.usageIndex);
+            vertexInput.isUint = isUintVertexElement(vertexElement);
 
-            const char* usageType = USAGE_TYPES[uint32_t(vertexElement.usage)];
-
-        #ifdef UNLEASHED_RECOMP
-            if ((vertexElement.usage == DeclUsage::TexCoord && vertexElement.usageIndex == 2 && isMetaInstancer) ||
-                (vertexElement.usage == DeclUsage::Position && vertexElement.usageIndex == 1))
-            {
-                usageType = "uint4";
-            }
-        #endif
+            const char* usageType = vertexInput.isUint ? "uint4" : "float4";
 
             out += '\t';
 
@@ -1329,6 +1857,7 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
                 if (usageLocation.usage == vertexElement.usage && usageLocation.usageIndex == vertexElement.usageIndex)
                 {
                     print("[[vk::location({})]] ", usageLocation.location);
+                    vertexInput.location = uint8_t(usageLocation.location);
                     break;
                 }
             }
@@ -1336,7 +1865,11 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
             println("in {0} i{1}{2} : {3}{2},", usageType, USAGE_VARIABLES[uint32_t(vertexElement.usage)],
                 uint32_t(vertexElement.usageIndex), USAGE_SEMANTICS[uint32_t(vertexElement.usage)]);
 
-            vertexElements.emplace(uint32_t(vertexElement.address), vertexElement);
+            if (!definedVertexElements.test(vertexElement.address))
+            {
+                vertexElements[vertexElement.address] = vertexElement;
+                definedVertexElements.set(vertexElement.address);
+            }
         }
 
     #ifdef UNLEASHED_RECOMP
@@ -1347,17 +1880,38 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
         }
     #endif
 
-        out += "\tout float4 oPos : SV_Position";
+        auto printOutputs = [&](uint32_t mask)
+            {
+                println("\tout float4 oPos : SV_Position{}", mask != 0 ? "," : "");
 
-        for (auto& [usage, usageIndex] : INTERPOLATORS)
-            print(",\n\tout float4 o{0}{1} : {2}{1}", USAGE_VARIABLES[uint32_t(usage)], usageIndex, USAGE_SEMANTICS[uint32_t(usage)]);
-    }
+                for (size_t i = 0; i < interpolatorCount; i++)
+                {
+                    if ((mask & (1u << i)) != 0)
+                        printInterpolator('o', i, (mask >> (i + 1)) != 0);
+                }
+            };
+
+        // The unused rows can be the last ones, so each backend gets its own list rather than guarding single rows.
+        uint32_t dxilInterpolators = (1u << interpolatorCount) - 1;
+        if (metadata.interpolators == dxilInterpolators)
+        {
+            printOutputs(dxilInterpolators);
+        }
+        else
+        {
+            out += "#ifdef __spirv__\n";
+            printOutputs(metadata.interpolators);
+            out += "#else\n";
+            printOutputs(dxilInterpolators);
+            out += "#endif\n";
+        }
+    }
 
     out += ")\n";
     out += "{\n";
 
 #ifdef UNLEASHED_RECOMP
-    if (hasMtxProjection)
+    if (hasProjectionLoop)
     {
         specConstantsMask |= SPEC_CONSTANT_REVERSE_Z;
 
@@ -1369,100 +1923,132 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
         out += "\t[unroll] for (int iterationIndex = 0; iterationIndex < 2; iterationIndex++)\n";
         out += "\t{\n";
     }
+    else if (hasMtxProjection)
+    {
+        specConstantsMask |= SPEC_CONSTANT_REVERSE_Z;
+
+        // Only the position export reads the reverse Z copy, which matches the rest when reverse Z is disabled.
+        out += "\tfloat4x4 mtxProjection = float4x4(g_MtxProjection(0), g_MtxProjection(1), g_MtxProjection(2), g_MtxProjection(3));\n";
+        out += "\tfloat4x4 mtxProjectionReverseZ = mtxProjection;\n";
+        out += "\tif (g_SpecConstants() & SPEC_CONSTANT_REVERSE_Z)\n";
+        out += "\t\tmtxProjectionReverseZ = mul(mtxProjection, float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -1, 0, 0, 0, 1, 1));\n";
+    }
 #endif
 
-    if (shaderContainer->definitionTableOffset != NULL)
+    if (container.hasDefinitionTable)
     {
-        auto definitionTable = reinterpret_cast<const DefinitionTable*>(shaderData + shaderContainer->definitionTableOffset);
-        auto definitions = definitionTable->definitions;
-        while (*definitions != 0)
+        for (auto& definition : container.float4Definitions)
         {
-            auto definition = reinterpret_cast<const Float4Definition*>(definitions);
-            auto value = reinterpret_cast<const be<uint32_t>*>(shaderData + shaderContainer->virtualSize + definition->physicalOffset);
-            for (uint16_t i = 0; i < (definition->count + 3) / 4; i++)
+            for (uint16_t i = 0; i < (definition.count + 3) / 4; i++)
             {
-                println("\tfloat4 c{} = asfloat(uint4(0x{:X}, 0x{:X}, 0x{:X}, 0x{:X}));",
-                    definition->registerIndex + i - (isPixelShader ? 256 : 0), value[0].get(), value[1].get(), value[2].get(), value[3].get());
-
-                value += 4;
+                uint32_t reg = definition.registerIndex + i - (isPixelShader ? 256 : 0);
+                if (reg >= ir.usedConstants.size() || ir.usedConstants.test(reg))
+                {
+                    auto value = definition.values + i * 4;
+                    println("\tfloat4 c{} = asfloat(uint4(0x{:X}, 0x{:X}, 0x{:X}, 0x{:X}));",
+                        reg, value[0].get(), value[1].get(), value[2].get(), value[3].get());
+                }
             }
-            definitions += 2;
         }
-        ++definitions;
-        while (*definitions != 0)
+
+        for (auto& definition : container.int4Definitions)
         {
-            auto definition = reinterpret_cast<const Int4Definition*>(definitions);
-            for (uint16_t i = 0; i < definition->count; i++)
+            for (uint16_t i = 0; i < definition.count; i++)
             {
                 union
                 {
                     uint32_t value;
                     struct
                     {
-                        int8_t x;
-                        int8_t y;
+                        uint8_t x;
+                        uint8_t y;
                         int8_t z;
                         int8_t w;
                     };
                 };
 
-                value = definition->values[i].get();
+                value = definition.values[i].get();
 
                 println("\tint4 i{} = int4({}, {}, {}, {});",
-                    (definition->registerIndex - 8992) / 4 + i, x, y, z, w);
+                    (definition.registerIndex - 8992) / 4 + i, x, y, z, w);
             }
-            definitions += 2;
-            definitions += definition->count;
         }
 
         out += "\n";
     }
 
-    bool printedRegisters[32]{};
-
-    uint32_t interpolatorCount = (shader->interpolatorInfo >> 5) & 0x1F;
+    bool printedRegisters[64]{};
+    bool writtenInterpolators[std::size(INTERPOLATORS)]{};
 
-    for (uint32_t i = 0; i < interpolatorCount; i++)
+    for (uint32_t i = 0; i < container.interpolators.size(); i++)
     {
-        union
-        {
-            Interpolator interpolator;
-            uint32_t value;
-        };
-    
+        auto& interpolator = container.interpolators[i];
+
         if (isPixelShader)
         {
-            value = reinterpret_cast<const PixelShader*>(shader)->interpolators[i];
-            println("\tfloat4 r{} = i{}{};", uint32_t(interpolator.reg), USAGE_VARIABLES[uint32_t(interpolator.usage)], uint32_t(interpolator.usageIndex));
+            if (ir.usedRegisters & (1ull << interpolator.reg))
+                println("\tfloat4 r{} = i{}{};", uint32_t(interpolator.reg), USAGE_VARIABLES[uint32_t(interpolator.usage)], uint32_t(interpolator.usageIndex));
+
             printedRegisters[interpolator.reg] = true;
         }
         else
         {
-            auto vertexShader = reinterpret_cast<const VertexShader*>(shader);
-            value = vertexShader->vertexElementsAndInterpolators[vertexShader->field18 + vertexShader->vertexElementCount + i];
-            interpolators.emplace(i, fmt::format("o{}{}", USAGE_VARIABLES[uint32_t(interpolator.usage)], uint32_t(interpolator.usageIndex)));
+            if (i < std::size(interpolators))
+            {
+                auto result = fmt::format_to_n(interpolators[i], std::size(interpolators[i]) - 1, "o{}{}",
+                    USAGE_VARIABLES[uint32_t(interpolator.usage)], uint32_t(interpolator.usageIndex));
+
+                *result.out = '\0';
+                definedInterpolators |= 1u << i;
+            }
+
+            // Outputs written on every path do not need to be zeroed beforehand.
+            if (ir.writtenExports[i] == 0b1111)
+            {
+                for (size_t j = 0; j < std::size(INTERPOLATORS); j++)
+                {
+                    if (INTERPOLATORS[j].first == interpolator.usage && INTERPOLATORS[j].second == interpolator.usageIndex)
+                        writtenInterpolators[j] = true;
+                }
+            }
         }
     }
 
     if (!isPixelShader)
     {
     #ifdef UNLEASHED_RECOMP
-        if (!hasMtxProjection)
+        if (!hasProjectionLoop)
             out += "\toPos = 0.0;\n";
     #endif
 
-        for (auto& [usage, usageIndex] : INTERPOLATORS)
-            println("\to{}{} = 0.0;", USAGE_VARIABLES[uint32_t(usage)], usageIndex);
+        for (size_t i = 0; i < interpolatorCount; i++)
+        {
+            if (!writtenInterpolators[i] && (metadata.interpolators & (1u << i)) != 0)
+                println("\to{}{} = 0.0;", USAGE_VARIABLES[uint32_t(INTERPOLATORS[i].first)], INTERPOLATORS[i].second);
+        }
+
+        if ((metadata.interpolators + 1) != (1u << interpolatorCount))
+        {
+            out += "#ifndef __spirv__\n";
+
+            for (size_t i = 0; i < interpolatorCount; i++)
+            {
+                if ((metadata.interpolators & (1u << i)) == 0)
+                    println("\to{}{} = 0.0;", USAGE_VARIABLES[uint32_t(INTERPOLATORS[i].first)], INTERPOLATORS[i].second);
+            }
+
+            out += "#endif\n";
+        }
 
         out += "\n";
     }
 
-    for (size_t i = 0; i < 32; i++)
+    for (size_t i = 0; i < 64; i++)
     {
-        if (!printedRegisters[i])
+        if (!printedRegisters[i] && (ir.usedRegisters & (1ull << i)))
         {
             print("\tfloat4 r{} = ", i);
-            if (isPixelShader && i == ((shader->fieldC >> 8) & 0xFF))
+            if (isPixelShader && i == container.svPosRegister)
             {
                 out += "float4((iPos.xy - 0.5) * float2(iFace ? 1.0 : -1.0, 1.0), 0.0, 0.0);\n";
             }
@@ -1479,10 +2065,25 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
         }
     }
 
-    out += "\tint a0 = 0;\n";
-    out += "\tint aL = 0;\n";
-    out += "\tbool p0 = false;\n";
-    out += "\tfloat ps = 0.0;\n";
+    if (ir.usedState & IR_STATE_A0)
+        out += "\tint a0 = 0;\n";
+    if (ir.usedState & IR_STATE_AL)
+        out += "\tint aL = 0;\n";
+    if (ir.usedState & IR_STATE_P0)
+        out += "\tbool p0 = false;\n";
+    if (ir.usedState & IR_STATE_PS)
+        out += "\tfloat ps = 0.0;\n";
+
+#ifdef UNLEASHED_RECOMP
+    for (size_t i = 0; i < 64; i++)
+    {
+        if (reverseZRegisters & (1ull << i))
+            println("\tfloat4 rz{0} = r{0};", i);
+    }
+
+    if (reverseZPreviousScalar || hasReverseZScalar)
+        out += "\tfloat psz = ps;\n";
+#endif
     if (isPixelShader)
     {
 #ifdef UNLEASHED_RECOMP
@@ -1491,308 +2092,168 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
         out += "\tCubeMapData cubeMapData = (CubeMapData)0;\n";
     }
 
-    const be<uint32_t>* code = reinterpret_cast<const be<uint32_t>*>(shaderData + shaderContainer->virtualSize + shader->physicalOffset);
-
-    union
-    {
-        ControlFlowInstruction controlFlow[2];
-        struct
+    auto printCondition = [&](const IrControlFlow& node, bool taken)
         {
-            uint32_t code0;
-            uint32_t code1;
-            uint32_t code2;
-            uint32_t code3;
-        };
-    };
-
-    auto controlFlowCode = code;
-    uint32_t instrAddress = 0;
-    uint32_t instrSize = shader->size;
-    bool simpleControlFlow = true;
-
-    while (instrAddress < instrSize)
-    {
-        code0 = controlFlowCode[0];
-        code1 = controlFlowCode[1] & 0xFFFF;
-        code2 = (controlFlowCode[1] >> 16) | (controlFlowCode[2] << 16);
-        code3 = controlFlowCode[2] >> 16;
-
-        for (auto& cfInstr : controlFlow)
-        {
-            uint32_t address = 0;
-
-            switch (cfInstr.opcode)
-            {
-            case ControlFlowOpcode::Exec:
-            case ControlFlowOpcode::ExecEnd:
-                address = cfInstr.exec.address;
-                break;
-
-            case ControlFlowOpcode::CondExec:
-            case ControlFlowOpcode::CondExecEnd:
-            case ControlFlowOpcode::CondExecPredClean:
-            case ControlFlowOpcode::CondExecPredCleanEnd:
-                address = cfInstr.condExec.address;
-                break;
-
-            case ControlFlowOpcode::CondExecPred:
-            case ControlFlowOpcode::CondExecPredEnd:
-                address = cfInstr.condExecPred.address;
-                break;
-
-            case ControlFlowOpcode::CondJmp:
+            if (node.isUnconditional)
             {
-                if (cfInstr.condJmp.isUnconditional || cfInstr.condJmp.direction)
-                    simpleControlFlow = false;
-                else
-                    ++ifEndLabels[cfInstr.condJmp.address];
-
-                break;
+                out += taken ? "true" : "false";
             }
-            }
-
-            if (address != 0)
-                instrSize = std::min<uint32_t>(instrSize, address * 12);
-        }
-
-        controlFlowCode += 3;
-        instrAddress += 12;
-    }
-
-    if (simpleControlFlow)
-    {
-        out += '\n';
-        indentation = 1;
-    }
-    else
-    {
-        out += "\n\tuint pc = 0;\n";
-        out += "\twhile (true)\n";
-        out += "\t{\n";
-        out += "\t\tswitch (pc)\n";
-        out += "\t\t{\n";
-    }
-
-    controlFlowCode = code;
-    instrAddress = 0;
-    uint32_t pc = 0;
-
-    while (instrAddress < instrSize)
-    {
-        code0 = controlFlowCode[0];
-        code1 = controlFlowCode[1] & 0xFFFF;
-        code2 = (controlFlowCode[1] >> 16) | (controlFlowCode[2] << 16);
-        code3 = controlFlowCode[2] >> 16;
-
-        for (auto& cfInstr : controlFlow)
-        {
-            if (!simpleControlFlow)
+            else if (node.isPredicated)
             {
-                indentation = 3;
-                println("\t\tcase {}:", pc);
+                print("{}p0", node.condition == taken ? "" : "!");
             }
             else
             {
-                auto findResult = ifEndLabels.find(pc);
-                if (findResult != ifEndLabels.end())
-                {
-                    for (uint32_t i = 0; i < findResult->second; i++)
-                    {
-                        --indentation;
-                        indent();
-                        out += "}\n";
-                    }
-                }
+                if (node.boolAddress < std::size(boolConstants) && boolConstants[node.boolAddress] != nullptr)
+                    print("(g_Booleans & {}) {} 0", boolConstants[node.boolAddress], node.condition == taken ? "!=" : "==");
+                else
+                    print("b{} {} 0", node.boolAddress, node.condition == taken ? "!=" : "==");
             }
+        };
 
-            ++pc;
-
-            uint32_t address = 0;
-            uint32_t count = 0;
-            uint32_t sequence = 0;
-            bool shouldReturn = false;
-            bool shouldCloseCurlyBracket = false;
+    auto isEmitted = [&](const IrInstruction& instr)
+        {
+            return !instr.isDead && (instr.kind != IrInstructionKind::TextureFetch || instr.textureFetch.isSupported());
+        };
 
-            switch (cfInstr.opcode)
+    auto recompileInstruction = [&](const IrInstruction& instr)
+        {
+            switch (instr.kind)
             {
-            case ControlFlowOpcode::Exec:
-            case ControlFlowOpcode::ExecEnd:
-                address = cfInstr.exec.address;
-                count = cfInstr.exec.count;
-                sequence = cfInstr.exec.sequence;
-                shouldReturn = (cfInstr.opcode == ControlFlowOpcode::ExecEnd);
+            case IrInstructionKind::VertexFetch:
+                recompile(instr, instr.vertexFetch);
                 break;
 
-            case ControlFlowOpcode::CondExec:
-            case ControlFlowOpcode::CondExecEnd:
-            case ControlFlowOpcode::CondExecPredClean:
-            case ControlFlowOpcode::CondExecPredCleanEnd:
-                address = cfInstr.condExec.address;
-                count = cfInstr.condExec.count;
-                sequence = cfInstr.condExec.sequence;
-                shouldReturn = (cfInstr.opcode == ControlFlowOpcode::CondExecEnd || cfInstr.opcode == ControlFlowOpcode::CondExecEnd);
-                break;
-
-            case ControlFlowOpcode::CondExecPred:
-            case ControlFlowOpcode::CondExecPredEnd:
-                address = cfInstr.condExecPred.address;
-                count = cfInstr.condExecPred.count;
-                sequence = cfInstr.condExecPred.sequence;
-                shouldReturn = (cfInstr.opcode == ControlFlowOpcode::CondExecPredEnd);
-                break;
-
-            case ControlFlowOpcode::LoopStart:
-                if (simpleControlFlow)
+            case IrInstructionKind::TextureFetch:
+            #ifdef UNLEASHED_RECOMP
+                if (instr.textureFetch.constIndex == 10) // g_GISampler
                 {
+                    specConstantsMask |= SPEC_CONSTANT_BICUBIC_GI_FILTER;
+
                     indent();
-                #ifdef UNLEASHED_RECOMP
-                    print("[unroll] ");
-                #endif
-                    println("for (aL = 0; aL < i{}.x; aL++)", uint32_t(cfInstr.loopStart.loopId));
+                    out += "if (g_SpecConstants() & SPEC_CONSTANT_BICUBIC_GI_FILTER)";
                     indent();
-                    out += "{\n";
+                    out += '{';
+
                     ++indentation;
-                }
-                else 
-                {
-                    out += "\t\t\taL = 0;\n";
-                }
-                break;
+                    recompile(instr, instr.textureFetch, true);
+                    --indentation;
 
-            case ControlFlowOpcode::LoopEnd:
-                if (simpleControlFlow)
-                {
+                    indent();
+                    out += "}";
+                    indent();
+                    out += "else";
+                    indent();
+                    out += '{';
+
+                    ++indentation;
+                    recompile(instr, instr.textureFetch, false);
                     --indentation;
+
                     indent();
-                    out += "}\n";
+                    out += '}';
                 }
                 else
+            #endif
                 {
-                    out += "\t\t\t++aL;\n";
-                    println("\t\t\tif (aL < i{}.x)", uint32_t(cfInstr.loopEnd.loopId));
-                    out += "\t\t\t{\n";
-                    println("\t\t\t\tpc = {};", uint32_t(cfInstr.loopEnd.address));
-                    out += "\t\t\t\tcontinue;\n";
-                    out += "\t\t\t}\n";
+                    recompile(instr, instr.textureFetch, false);
                 }
                 break;
 
-            case ControlFlowOpcode::CondJmp:
-            {
-                if (cfInstr.condJmp.isUnconditional)
-                {
-                    assert(!simpleControlFlow);
-                    println("\t\t\tpc = {};", uint32_t(cfInstr.condJmp.address));
-                    out += "\t\t\tcontinue;\n";
-                }
-                else
+            case IrInstructionKind::Alu:
+                recompile(instr, instr.alu);
+                break;
+            }
+        };
+
+    auto recompileNode = [&](const IrControlFlow& node)
+        {
+            // Consecutive instructions sharing a predicate are merged into a single block, or turned into selects when
+            // the run is short enough. A run ends after an instruction writing p0.
+            bool isPredicateOpen = false;
+            bool predicateCondition = false;
+
+            auto closePredicate = [&]()
                 {
-                    indent();
-                    if (cfInstr.condJmp.isPredicated)
+                    if (isPredicateOpen && !predicateSelect)
                     {
-                        println("if ({}p0)", cfInstr.condJmp.condition ^ simpleControlFlow ? "" : "!");
+                        --indentation;
+                        indent();
+                        out += "}\n";
                     }
-                    else
+
+                    isPredicateOpen = false;
+                    predicateSelect = false;
+                };
+
+            for (uint32_t i = 0; i < node.instructionCount; i++)
+            {
+                auto& instr = ir.instructions[node.firstInstruction + i];
+                if (!isEmitted(instr))
+                    continue;
+
+                if (!instr.isPredicated || (isPredicateOpen && predicateCondition != instr.predicateCondition))
+                    closePredicate();
+
+                if (instr.isPredicated && !isPredicateOpen)
+                {
+                    isPredicateOpen = true;
+                    predicateCondition = instr.predicateCondition;
+                    predicateSelect = true;
+
+                    uint32_t runLength = 0;
+                    for (uint32_t j = i; j < node.instructionCount; j++)
                     {
-                        auto findResult = boolConstants.find(cfInstr.condJmp.boolAddress);
-                        if (findResult != boolConstants.end())
-                            println("if ((g_Booleans & {}) {}= 0)", findResult->second, cfInstr.condJmp.condition ^ simpleControlFlow ? "!" : "=");
-                        else
-                            println("if (b{} {}= 0)", uint32_t(cfInstr.condJmp.boolAddress), cfInstr.condJmp.condition ^ simpleControlFlow ? "!" : "=");
+                        auto& runInstr = ir.instructions[node.firstInstruction + j];
+                        if (!isEmitted(runInstr))
+                            continue;
+
+                        if (!runInstr.isPredicated || runInstr.predicateCondition != predicateCondition)
+                            break;
+
+                        ++runLength;
+                        predicateSelect &= isSelectable(runInstr);
+
+                        if ((runInstr.stateWrites & IR_STATE_P0) != 0)
+                            break;
                     }
 
-                    if (simpleControlFlow)
+                    predicateSelect &= runLength <= PREDICATED_SELECT_LIMIT;
+
+                    if (!predicateSelect)
                     {
+                        indent();
+                        println("if ({}p0)", predicateCondition ? "" : "!");
                         indent();
                         out += "{\n";
                         ++indentation;
                     }
-                    else
-                    {
-                        out += "\t\t\t{\n";
-                        println("\t\t\t\tpc = {};", uint32_t(cfInstr.condJmp.address));
-                        out += "\t\t\t\tcontinue;\n";
-                        out += "\t\t\t}\n";
-                    }
                 }
-                break;
-            }
-            }
 
-            auto instructionCode = code + address * 3;
-            
-            for (uint32_t i = 0; i < count; i++)
-            {
-                union
-                {
-                    VertexFetchInstruction vertexFetch;
-                    TextureFetchInstruction textureFetch;
-                    AluInstruction alu;
-                    struct
-                    {
-                        uint32_t code0;
-                        uint32_t code1;
-                        uint32_t code2;
-                    };
-                };
-            
-                code0 = instructionCode[0];
-                code1 = instructionCode[1];
-                code2 = instructionCode[2];
-            
-                if ((sequence & 0x1) != 0)
-                {
-                    if (vertexFetch.opcode == FetchOpcode::VertexFetch)
-                    {
-                        recompile(vertexFetch, address + i);
-                    }
-                    else
-                    {
-                    #ifdef UNLEASHED_RECOMP
-                        if (textureFetch.constIndex == 10) // g_GISampler
-                        {
-                            specConstantsMask |= SPEC_CONSTANT_BICUBIC_GI_FILTER;
-
-                            indent();
-                            out += "if (g_SpecConstants() & SPEC_CONSTANT_BICUBIC_GI_FILTER)";
-                            indent();
-                            out += '{';
-
-                            ++indentation;
-                            recompile(textureFetch, true);
-                            --indentation;
-
-                            indent();
-                            out += "}";
-                            indent();
-                            out += "else";
-                            indent();
-                            out += '{';
-
-                            ++indentation;
-                            recompile(textureFetch, false);
-                            --indentation;
-
-                            indent();
-                            out += '}';
-                        }
-                        else
-                    #endif
-                        {
-                            recompile(textureFetch, false);
-                        }
-                    }
-                }
-                else
+            #ifdef UNLEASHED_RECOMP
+                // The reverse Z copy goes first, as it reads the registers the instruction overwrites.
+                if (isReverseZSliced && isReverseZCopied(instr))
                 {
-                    recompile(alu);
+                    isReverseZCopy = true;
+                    recompileInstruction(instr);
+                    isReverseZCopy = false;
                 }
-            
-                sequence >>= 2;
-                instructionCode += 3;
+            #endif
+
+                recompileInstruction(instr);
+
+            #ifdef UNLEASHED_RECOMP
+                if (isReverseZSliced)
+                    copyReverseZ(instr);
+            #endif
+
+                if ((instr.stateWrites & IR_STATE_P0) != 0)
+                    closePredicate();
             }
 
-            if (shouldReturn)
+            closePredicate();
+
+            if (node.isEnd)
             {
                 if (isPixelShader)
                 {
@@ -1829,18 +2290,18 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
                 else
                 {
                 #ifdef UNLEASHED_RECOMP
-                    if (!hasMtxProjection)
+                    if (!hasProjectionLoop)
                 #endif
                     {
                         out += "\toPos.xy += g_HalfPixelOffset * oPos.w;\n";
                     }
                 }
 
-                if (simpleControlFlow)
+                if (structuredControlFlow)
                 {
                     indent();
                 #ifdef UNLEASHED_RECOMP
-                    if (hasMtxProjection)
+                    if (hasProjectionLoop)
                     {
                         out += "continue;\n";
                     }
@@ -1855,21 +2316,242 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
                     out += "\t\t\tbreak;\n";
                 }
             }
+        };
+
+    structuredControlFlow = ir.isStructured;
+
+#ifdef UNLEASHED_RECOMP
+    // Ends continue the projection loop, which would continue the inner loop instead.
+    if (hasProjectionLoop && ir.endsInsideLoop)
+        structuredControlFlow = false;
+#endif
+
+    if (structuredControlFlow)
+    {
+        out += '\n';
+        indentation = 1;
 
-            if (shouldCloseCurlyBracket)
+        auto openBlock = [&]()
+            {
+                indent();
+                out += "{\n";
+                ++indentation;
+            };
+
+        auto closeBlock = [&]()
             {
                 --indentation;
                 indent();
                 out += "}\n";
+            };
+
+        for (auto& statement : ir.statements)
+        {
+            auto& node = ir.nodes[statement.node];
+
+            switch (statement.kind)
+            {
+            case IrStatementKind::Node:
+                recompileNode(node);
+                break;
+
+            case IrStatementKind::If:
+                indent();
+                out += "if (";
+                printCondition(node, statement.taken);
+                out += ")\n";
+                openBlock();
+                break;
+
+            case IrStatementKind::Else:
+                closeBlock();
+                indent();
+                out += "else\n";
+                openBlock();
+                break;
+
+            case IrStatementKind::Loop:
+            {
+                const char* attribute = statement.unroll ? "[unroll]" : "[loop]";
+
+                // Known loop constants get their bounds folded, so the compiler sees the trip count.
+                if (ir.definedLoopConstants.test(node.loopId))
+                {
+                    uint32_t loopConstant = ir.loopConstants[node.loopId];
+                    int32_t count = loopConstant & 0xFF;
+                    int32_t start = (loopConstant >> 8) & 0xFF;
+                    int32_t step = int8_t(loopConstant >> 16);
+
+                    indent();
+                    if (step == 0)
+                    {
+                        println("aL = {};", start);
+                        indent();
+                        println("{} for (int iteration{} = 0; iteration{} < {}; iteration{}++)",
+                            attribute, statement.node, statement.node, count, statement.node);
+                    }
+                    else if (step == 1)
+                    {
+                        println("{} for (aL = {}; aL < {}; aL++)", attribute, start, start + count);
+                    }
+                    else if (step > 0)
+                    {
+                        println("{} for (aL = {}; aL < {}; aL += {})", attribute, start, start + count * step, step);
+                    }
+                    else
+                    {
+                        println("{} for (aL = {}; aL > {}; aL -= {})", attribute, start, start + count * step, -step);
+                    }
+                }
+                else
+                {
+                    indent();
+                    println("aL = i{}.y;", node.loopId);
+                    indent();
+                    println("{} for (int iteration{} = 0; iteration{} < i{}.x; iteration{}++, aL += i{}.z)",
+                        attribute, statement.node, statement.node, node.loopId, statement.node, node.loopId);
+                }
+
+                openBlock();
+                break;
             }
-        }
 
-        controlFlowCode += 3;
-        instrAddress += 12;
-    }
+            case IrStatementKind::DoWhile:
+                indent();
+                out += "do\n";
+                openBlock();
+                break;
+
+            case IrStatementKind::EndDoWhile:
+                --indentation;
+                indent();
+                out += "} while (";
+                printCondition(node, statement.taken);
+                out += ");\n";
+                break;
+
+            case IrStatementKind::While:
+                indent();
+                out += "while (";
+                printCondition(node, statement.taken);
+                out += ")\n";
+                openBlock();
+                break;
+
+            case IrStatementKind::WhileTrue:
+                indent();
+                out += "while (true)\n";
+                openBlock();
+                break;
+
+            case IrStatementKind::EndIf:
+            case IrStatementKind::EndLoop:
+            case IrStatementKind::EndWhile:
+                closeBlock();
+                break;
+
+            case IrStatementKind::Break:
+                indent();
+                out += "break;\n";
+                break;
 
-    if (!simpleControlFlow)
+            case IrStatementKind::Continue:
+                indent();
+                out += "continue;\n";
+                break;
+
+            case IrStatementKind::DeclareFlag:
+                indent();
+                println("bool skip{} = false;", statement.flag);
+                break;
+
+            case IrStatementKind::SetFlag:
+                indent();
+                print("skip{} = ", statement.flag);
+                printCondition(node, statement.taken);
+                out += ";\n";
+                break;
+
+            case IrStatementKind::IfFlag:
+                indent();
+                println("if (skip{})", statement.flag);
+                openBlock();
+                break;
+
+            case IrStatementKind::IfNotFlag:
+                indent();
+                println("if (!skip{})", statement.flag);
+                openBlock();
+                break;
+            }
+        }
+    }
+    else
     {
+        out += '\n';
+
+        // Iterations are counted separately from aL, which starts at i#.y and advances by i#.z like in structured loops.
+        std::bitset<32> countedLoops;
+        for (auto& node : ir.nodes)
+        {
+            if (node.opcode == ControlFlowOpcode::LoopStart && !countedLoops.test(node.loopId))
+            {
+                println("\tint iteration{} = 0;", node.loopId);
+                countedLoops.set(node.loopId);
+            }
+        }
+
+        out += "\tuint pc = 0;\n";
+        out += "\twhile (true)\n";
+        out += "\t{\n";
+        out += "\t\tswitch (pc)\n";
+        out += "\t\t{\n";
+
+        for (uint32_t pc = 0; pc < ir.nodes.size(); pc++)
+        {
+            auto& node = ir.nodes[pc];
+
+            indentation = 3;
+            println("\t\tcase {}:", pc);
+
+            switch (node.opcode)
+            {
+            case ControlFlowOpcode::LoopStart:
+                println("\t\t\taL = i{}.y;", node.loopId);
+                println("\t\t\titeration{} = 0;", node.loopId);
+                break;
+
+            case ControlFlowOpcode::LoopEnd:
+                println("\t\t\taL += i{}.z;", node.loopId);
+                println("\t\t\tif (++iteration{} < i{}.x)", node.loopId, node.loopId);
+                out += "\t\t\t{\n";
+                println("\t\t\t\tpc = {};", node.address);
+                out += "\t\t\t\tcontinue;\n";
+                out += "\t\t\t}\n";
+                break;
+
+            case ControlFlowOpcode::CondJmp:
+                if (!node.isUnconditional)
+                {
+                    out += "\t\t\tif (";
+                    printCondition(node, true);
+                    out += ")\n";
+                    out += "\t\t\t{\n";
+                    println("\t\t\t\tpc = {};", node.address);
+                    out += "\t\t\t\tcontinue;\n";
+                    out += "\t\t\t}\n";
+                }
+                else
+                {
+                    println("\t\t\tpc = {};", node.address);
+                    out += "\t\t\tcontinue;\n";
+                }
+                break;
+            }
+
+            recompileNode(node);
+        }
+
         out += "\t\t\tbreak;\n";
         out += "\t\t}\n";
         out += "\t\tbreak;\n";
@@ -1877,12 +2559,16 @@ void ShaderRecompiler::recompile(const uint8_t* shaderData, const std::string_vi
     }
 
 #ifdef UNLEASHED_RECOMP
-    if (hasMtxProjection)
+    if (hasProjectionLoop)
+    {
         out += "\t}\n";
-
-    if (!isPixelShader && hasMtxProjection)
         out += "\toPos.xy += g_HalfPixelOffset * oPos.w;\n";
+    }
 #endif
 
     out += "}";
+
+    analyzeResourceUsage();
+
+    return true;
 }
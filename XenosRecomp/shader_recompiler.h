@@ -1,7 +1,63 @@
 #pragma once
 
-#include "shader.h"
 #include "shader_code.h"
+#include "shader_container.h"
+#include "shader_ir.h"
+
+// Bump whenever the generated HLSL or SPIR-V changes, so manifests written by earlier builds stop serving stale shaders.
+static constexpr uint32_t SHADER_RECOMPILER_VERSION = 3;
+
+struct DeclUsageLocation
+{
+    DeclUsage usage;
+    uint32_t usageIndex;
+    uint32_t location;
+};
+
+// NOTE: These are specialized Vulkan locations for Unleashed Recompiled. Change as necessary. Likely not going to work with other games.
+static constexpr DeclUsageLocation USAGE_LOCATIONS[] =
+{
+    { DeclUsage::Position, 0, 0 },
+    { DeclUsage::Normal, 0, 1 },
+    { DeclUsage::Tangent, 0, 2 },
+    { DeclUsage::Binormal, 0, 3 },
+    { DeclUsage::TexCoord, 0, 4 },
+    { DeclUsage::TexCoord, 1, 5 },
+    { DeclUsage::TexCoord, 2, 6 },
+    { DeclUsage::TexCoord, 3, 7 },
+    { DeclUsage::Color, 0, 8 },
+    { DeclUsage::BlendIndices, 0, 9 },
+    { DeclUsage::BlendWeight, 0, 10 },
+    { DeclUsage::Color, 1, 11 },
+    { DeclUsage::TexCoord, 4, 12 },
+    { DeclUsage::TexCoord, 5, 13 },
+    { DeclUsage::TexCoord, 6, 14 },
+    { DeclUsage::TexCoord, 7, 15 },
+    { DeclUsage::Position, 1, 15 },
+};
+
+// Interpolators passed from vertex to pixel shaders. Their order decides the locations they get assigned.
+static constexpr std::pair<DeclUsage, size_t> INTERPOLATORS[] =
+{
+    { DeclUsage::TexCoord, 0 },
+    { DeclUsage::TexCoord, 1 },
+    { DeclUsage::TexCoord, 2 },
+    { DeclUsage::TexCoord, 3 },
+    { DeclUsage::TexCoord, 4 },
+    { DeclUsage::TexCoord, 5 },
+    { DeclUsage::TexCoord, 6 },
+    { DeclUsage::TexCoord, 7 },
+    { DeclUsage::TexCoord, 8 },
+    { DeclUsage::TexCoord, 9 },
+    { DeclUsage::TexCoord, 10 },
+    { DeclUsage::TexCoord, 11 },
+    { DeclUsage::TexCoord, 12 },
+    { DeclUsage::TexCoord, 13 },
+    { DeclUsage::TexCoord, 14 },
+    { DeclUsage::TexCoord, 15 },
+    { DeclUsage::Color, 0 },
+    { DeclUsage::Color, 1 }
+};
 
 struct StringBuffer
 {
@@ -21,36 +77,208 @@ struct StringBuffer
     }
 };
 
+#ifdef XENOS_RECOMP_STRING_OPERANDS
+
+// Builds operands out of std::string pieces formatted by fmt::format, like the emitter did before OperandString
+// stored them inline. Only meant to be compared against with --benchmark.
+struct OperandString
+{
+    std::string buffer;
+
+    template<class... Args>
+    void print(fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        buffer += fmt::format(fmt, std::forward<Args>(args)...);
+    }
+
+    void operator+=(std::string_view text)
+    {
+        buffer += text;
+    }
+
+    void operator+=(char c)
+    {
+        buffer += c;
+    }
+
+    operator std::string_view() const
+    {
+        return buffer;
+    }
+};
+
+static constexpr const char* OPERAND_EMITTER_NAME = "std::string";
+
+#else
+
+// Text of a single operand. Short operands stay in the inline storage, so that formatting instructions doesn't allocate.
+struct OperandString
+{
+    fmt::basic_memory_buffer<char, 128> buffer;
+
+    template<class... Args>
+    void print(fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        fmt::vformat_to(fmt::appender(buffer), fmt.get(), fmt::make_format_args(args...));
+    }
+
+    void operator+=(std::string_view text)
+    {
+        buffer.append(text.data(), text.data() + text.size());
+    }
+
+    void operator+=(char c)
+    {
+        buffer.push_back(c);
+    }
+
+    operator std::string_view() const
+    {
+        return { buffer.data(), buffer.size() };
+    }
+};
+
+static constexpr const char* OPERAND_EMITTER_NAME = "inline buffer";
+
+#endif
+
+template<>
+struct fmt::formatter<OperandString> : fmt::formatter<std::string_view>
+{
+    auto format(const OperandString& operand, fmt::format_context& ctx) const
+    {
+        return fmt::formatter<std::string_view>::format(operand, ctx);
+    }
+};
+
+// What a shader reads, emitted into the cache so that the runtime can skip updating everything else.
+struct ShaderMetadata
+{
+    // Float4 constant registers read from the constant buffer, one bit per register.
+    uint64_t float4Constants[4]{};
+
+    // Bits of g_Booleans the shader reads, matching the values of the boolean constant defines.
+    uint32_t booleans = 0;
+
+    // Sampler slots the shader fetches from, one mask for each of the 2D, 3D and cube texture descriptor indices.
+    // The sampler descriptor index is read for every slot in any of them.
+    uint32_t textures[3]{};
+
+    // Interpolators exported by the vertex shader or read by the pixel shader, one bit per INTERPOLATORS entry.
+    uint32_t interpolators = 0;
+};
+
+static constexpr uint8_t VERTEX_INPUT_NO_LOCATION = 0xFF;
+
+// Vertex shader input in declaration order, for creating input layouts ahead of the first draw.
+struct ShaderVertexInput
+{
+    uint8_t usage = 0;
+    uint8_t usageIndex = 0;
+
+    // Value of vk::location, or VERTEX_INPUT_NO_LOCATION if the compiler assigns one.
+    uint8_t location = VERTEX_INPUT_NO_LOCATION;
+
+    // Declared as uint4 instead of float4.
+    uint8_t isUint = 0;
+};
+
 struct ShaderRecompiler : StringBuffer
 {
     uint32_t indentation = 0;
     bool isPixelShader = false;
-    const uint8_t* constantTableData = nullptr;
-    std::unordered_map<uint32_t, VertexElement> vertexElements;
-    std::unordered_map<uint32_t, std::string> interpolators;
-    std::unordered_map<uint32_t, const ConstantInfo*> float4Constants;
-    std::unordered_map<uint32_t, const char*> boolConstants;
-    std::unordered_map<uint32_t, const char*> samplers;
-    std::unordered_map<uint32_t, uint32_t> ifEndLabels;
+    ParsedShaderContainer container;
+
+    // Indexed by vertex fetch address, interpolator, register, boolean address and sampler slot, sized to what the
+    // microcode can encode. Names are null when the slot has no constant.
+    VertexElement vertexElements[4096]{};
+    std::bitset<4096> definedVertexElements;
+    char interpolators[32][16]{};
+    uint32_t definedInterpolators = 0;
+    const ParsedConstant* float4Constants[256]{};
+    const char* boolConstants[256]{};
+    const char* samplers[32]{};
+
+    // Interpolators read by the pixel shader a vertex shader is linked against. Exports to the others are removed
+    // along with the instructions only feeding them.
+    uint32_t linkedInterpolators = ~0u;
+
     uint32_t specConstantsMask = 0;
+    ShaderMetadata metadata;
+    std::vector<ShaderVertexInput> vertexInputs;
+    bool structuredControlFlow = false;
+    bool predicateSelect = false;
+    IrShader ir;
 
 #ifdef UNLEASHED_RECOMP
     bool hasMtxProjection = false;
     bool hasMtxPrevInvViewProjection = false;
+    bool isMetaInstancer = false;
+    bool hasIndexCount = false;
+
+    // Registers and previous scalar holding values computed from g_MtxProjection that reach the position export.
+    // Sliced shaders compute a copy of them from the reverse Z matrix alongside, which the position export reads.
+    // Shaders where these values reach predicates, kills or addressing run the whole body twice instead.
+    uint64_t reverseZRegisters = 0;
+    bool reverseZPreviousScalar = false;
+
+    // Set if psz holds scalar copies on their way to a register, even if no instruction reads it as the previous scalar.
+    bool hasReverseZScalar = false;
+    bool isReverseZSliced = false;
+
+    // Set while emitting the reverse Z copy of an instruction.
+    bool isReverseZCopy = false;
 #endif
 
+    // Prepares for the next shader while keeping the capacity of the output and the lookup tables.
+    void reset();
+
     void indent()
     {
         for (uint32_t i = 0; i < indentation; i++)
             out += '\t';
     }
 
+    // Vertex elements declared as uint4 instead of float4, which get converted to float when fetched.
+    bool isUintVertexElement(const VertexElement& vertexElement) const;
+
+    // Whether every vertex fetch in the decoded shader reads an element the container declares.
+    bool hasDeclaredVertexFetches() const;
+
     void printDstSwizzle(uint32_t dstSwizzle, bool operand);
-    void printDstSwizzle01(uint32_t dstRegister, uint32_t dstSwizzle);
+    void printDstSwizzle01(const char* registerPrefix, uint32_t dstRegister, uint32_t dstSwizzle);
+
+    // Fills the metadata once the control flow was recovered.
+    void analyzeResourceUsage();
+
+    void recompile(const IrInstruction& instr, const IrVertexFetch& vertexFetch);
+    void recompile(const IrInstruction& instr, const IrTextureFetch& textureFetch, bool bicubic);
+    void recompile(const IrInstruction& instr, const IrAlu& alu);
+
+#ifdef UNLEASHED_RECOMP
+    bool isReverseZ(const IrOperand& operand) const;
+    bool isVectorReverseZ(const IrAlu& alu) const;
+    bool isScalarReverseZ(const IrInstruction& instr) const;
+    bool isTextureFetchReverseZ(const IrInstruction& instr) const;
+    bool isReverseZDestination(const IrAlu& alu, uint32_t dest) const;
+    bool isReverseZCopied(const IrInstruction& instr) const;
+
+    // Finds the values computed from g_MtxProjection, and decides whether the shader can be sliced.
+    void sliceReverseZ();
+
+    // Keeps the reverse Z copy of registers written by parts of the instruction not computed from g_MtxProjection.
+    void copyReverseZ(const IrInstruction& instr);
+#endif
+
+    // Returns false if the data is not a valid shader container, or if it has vertex fetches reading elements the
+    // container doesn't declare. Scanners use this to reject everything recompile() would fail on.
+    bool validate(const uint8_t* shaderData, size_t dataSize);
 
-    void recompile(const VertexFetchInstruction& instr, uint32_t address);
-    void recompile(const TextureFetchInstruction& instr, bool bicubic);
-    void recompile(const AluInstruction& instr);
+    // Returns false without writing anything if validate() would fail.
+    bool recompile(const uint8_t* shaderData, size_t dataSize, const std::string_view& include);
 
-    void recompile(const uint8_t* shaderData, const std::string_view& include);
+    // Translates the shader analyzed by the last recompile() call directly to SPIR-V, matching what DXC compiles the
+    // HLSL into. Returns false for shaders using features only the HLSL path supports, which need to go through DXC
+    // instead. The specialization constant is frozen to the given value if there is one. Implemented in shader_spirv.cpp.
+    bool recompileSpirv(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants = std::nullopt) const;
 };
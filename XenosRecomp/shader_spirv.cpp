@@ -0,0 +1,2406 @@
+#include "shader_spirv.h"
+#include "shader_recompiler.h"
+#include "shader_common.h"
+
+static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+static constexpr uint32_t SPIRV_VERSION = 0x00010000;
+
+static constexpr uint32_t SPIRV_EXECUTION_MODEL_VERTEX = 0;
+static constexpr uint32_t SPIRV_EXECUTION_MODEL_FRAGMENT = 4;
+static constexpr uint32_t SPIRV_EXECUTION_MODE_ORIGIN_UPPER_LEFT = 7;
+static constexpr uint32_t SPIRV_EXECUTION_MODE_DEPTH_REPLACING = 12;
+static constexpr uint32_t SPIRV_ADDRESSING_MODEL_PHYSICAL_STORAGE_BUFFER_64 = 5348;
+static constexpr uint32_t SPIRV_MEMORY_MODEL_GLSL450 = 1;
+static constexpr uint32_t SPIRV_MEMORY_ACCESS_ALIGNED = 0x2;
+static constexpr uint32_t SPIRV_LOOP_CONTROL_UNROLL = 0x1;
+static constexpr uint32_t SPIRV_LOOP_CONTROL_DONT_UNROLL = 0x2;
+
+// Image dimensions of the 2D, 3D and cube descriptor heaps, which are bound to descriptor sets 0 to 2.
+static constexpr uint32_t SPIRV_TEXTURE_DIMENSIONS[] = { 1, 2, 3 };
+static constexpr uint32_t SAMPLER_DESCRIPTOR_SET = 3;
+
+// Offsets into the shared constants, matching shader_common.h.
+static constexpr uint32_t SHARED_BOOLEANS_OFFSET = 256;
+static constexpr uint32_t SHARED_SWAPPED_TEXCOORDS_OFFSET = 260;
+static constexpr uint32_t SHARED_HALF_PIXEL_OFFSET_OFFSET = 264;
+static constexpr uint32_t SHARED_ALPHA_THRESHOLD_OFFSET = 272;
+
+void SpirvBuilder::emit(std::vector<uint32_t>& section, SpirvOp op, const uint32_t* operands, size_t operandCount)
+{
+    section.push_back(uint32_t((operandCount + 1) << 16) | uint32_t(op));
+    section.insert(section.end(), operands, operands + operandCount);
+}
+
+void SpirvBuilder::appendString(std::vector<uint32_t>& operands, std::string_view value)
+{
+    size_t begin = operands.size();
+    operands.resize(begin + value.size() / 4 + 1);
+    memcpy(operands.data() + begin, value.data(), value.size());
+}
+
+uint32_t SpirvBuilder::declareType(SpirvOp op, std::initializer_list<uint32_t> operands)
+{
+    std::vector<uint32_t> key;
+    key.reserve(operands.size() + 1);
+    key.push_back(uint32_t(op));
+    key.insert(key.end(), operands);
+
+    auto [findResult, inserted] = declarationIds.emplace(std::move(key), 0);
+    if (inserted)
+    {
+        findResult->second = allocateId();
+        declarations.push_back(uint32_t((operands.size() + 2) << 16) | uint32_t(op));
+        declarations.push_back(findResult->second);
+        declarations.insert(declarations.end(), operands);
+    }
+
+    return findResult->second;
+}
+
+uint32_t SpirvBuilder::declareConstant(SpirvOp op, uint32_t type, const uint32_t* operands, size_t operandCount)
+{
+    std::vector<uint32_t> key;
+    key.reserve(operandCount + 2);
+    key.push_back(uint32_t(op));
+    key.push_back(type);
+    key.insert(key.end(), operands, operands + operandCount);
+
+    auto [findResult, inserted] = declarationIds.emplace(std::move(key), 0);
+    if (inserted)
+    {
+        findResult->second = allocateId();
+        declarations.push_back(uint32_t((operandCount + 3) << 16) | uint32_t(op));
+        declarations.push_back(type);
+        declarations.push_back(findResult->second);
+        declarations.insert(declarations.end(), operands, operands + operandCount);
+    }
+
+    return findResult->second;
+}
+
+void SpirvBuilder::finish(std::vector<uint32_t>& module) const
+{
+    module.clear();
+    module.reserve(5 + preamble.size() + entryPoints.size() + annotations.size() + declarations.size() + functions.size());
+    module.insert(module.end(), { SPIRV_MAGIC, SPIRV_VERSION, 0, idBound, 0 });
+    module.insert(module.end(), preamble.begin(), preamble.end());
+    module.insert(module.end(), entryPoints.begin(), entryPoints.end());
+    module.insert(module.end(), annotations.begin(), annotations.end());
+    module.insert(module.end(), declarations.begin(), declarations.end());
+    module.insert(module.end(), functions.begin(), functions.end());
+}
+
+// Float or boolean scalar or vector.
+struct SpirvValue
+{
+    uint32_t id = 0;
+    uint32_t count = 0;
+    bool isBool = false;
+};
+
+struct SpirvConstruct
+{
+    IrStatementKind kind{};
+    uint32_t headerLabel = 0;
+    uint32_t mergeLabel = 0;
+    uint32_t continueLabel = 0;
+    uint32_t elseLabel = 0;
+    bool isElseOpen = false;
+
+    // Counted loops
+    uint32_t iterationVariable = 0;
+    int32_t step = 0;
+};
+
+// Mirrors what ShaderRecompiler emits as HLSL statement by statement, so that the result behaves like what DXC
+// compiles it into. Anything the HLSL path would fail to compile or doesn't handle the same way clears isSupported.
+struct SpirvTranslator
+{
+    const ShaderRecompiler& recompiler;
+    const IrShader& ir;
+    bool isPixelShader = false;
+    bool isSupported = true;
+
+    SpirvBuilder builder;
+    uint32_t glslImport = 0;
+    bool usesImageQuery = false;
+    bool usesDescriptorHeaps = false;
+
+    uint32_t typeVoid = 0;
+    uint32_t typeInt = 0;
+    uint32_t typeLong = 0;
+    uint32_t typeUlong = 0;
+    uint32_t typeFloats[5]{};
+    uint32_t typeBools[5]{};
+    uint32_t typeUints[5]{};
+    uint32_t typeImages[3]{};
+    uint32_t typeSampler = 0;
+    uint32_t typeCubeMapData = 0;
+
+    uint32_t pushConstants = 0;
+    uint32_t specConstants = 0;
+    uint32_t textureHeaps[3]{};
+    uint32_t samplerHeap = 0;
+
+    // Stage inputs and outputs. Position is the clip space position in vertex shaders and the fragment coordinate in
+    // pixel shaders, interpolators are outputs in vertex shaders and inputs in pixel shaders.
+    std::vector<uint32_t> interfaceVariables;
+    std::vector<std::pair<const VertexElement*, uint32_t>> vertexInputs;
+    uint32_t vertexIndex = 0;
+    uint32_t instanceIndex = 0;
+    uint32_t position = 0;
+    uint32_t frontFacing = 0;
+    uint32_t interpolatorVariables[std::size(INTERPOLATORS)]{};
+    uint32_t colorOutputs[4]{};
+    uint32_t depthOutput = 0;
+
+    // Function variables get declared up front, as they need to be at the start of the first block.
+    std::vector<uint32_t> variables;
+    std::vector<uint32_t> code;
+    bool isBlockOpen = true;
+
+    uint32_t registers[64]{};
+    uint32_t a0 = 0;
+    uint32_t aL = 0;
+    uint32_t p0 = 0;
+    uint32_t ps = 0;
+    uint32_t pixelCoord = 0;
+    uint32_t cubeMapData = 0;
+    std::vector<uint32_t> flags;
+    std::vector<SpirvConstruct> constructs;
+
+    SpirvTranslator(const ShaderRecompiler& recompiler)
+        : recompiler(recompiler), ir(recompiler.ir), isPixelShader(recompiler.isPixelShader)
+    {
+    }
+
+    uint32_t floatType(uint32_t count)
+    {
+        if (typeFloats[count] == 0)
+        {
+            if (count == 1)
+                typeFloats[count] = builder.declareType(SpirvOp::TypeFloat, { 32 });
+            else
+                typeFloats[count] = builder.declareType(SpirvOp::TypeVector, { floatType(1), count });
+        }
+
+        return typeFloats[count];
+    }
+
+    uint32_t boolType(uint32_t count)
+    {
+        if (typeBools[count] == 0)
+        {
+            if (count == 1)
+                typeBools[count] = builder.declareType(SpirvOp::TypeBool, {});
+            else
+                typeBools[count] = builder.declareType(SpirvOp::TypeVector, { boolType(1), count });
+        }
+
+        return typeBools[count];
+    }
+
+    uint32_t uintType(uint32_t count)
+    {
+        if (typeUints[count] == 0)
+        {
+            if (count == 1)
+                typeUints[count] = builder.declareType(SpirvOp::TypeInt, { 32, 0 });
+            else
+                typeUints[count] = builder.declareType(SpirvOp::TypeVector, { uintType(1), count });
+        }
+
+        return typeUints[count];
+    }
+
+    uint32_t valueType(bool isBool, uint32_t count)
+    {
+        return isBool ? boolType(count) : floatType(count);
+    }
+
+    uint32_t pointerType(uint32_t storageClass, uint32_t type)
+    {
+        return builder.declareType(SpirvOp::TypePointer, { storageClass, type });
+    }
+
+    uint32_t constantUint(uint32_t value)
+    {
+        return builder.declareConstant(SpirvOp::Constant, uintType(1), { value });
+    }
+
+    uint32_t constantInt(int32_t value)
+    {
+        return builder.declareConstant(SpirvOp::Constant, typeInt, { uint32_t(value) });
+    }
+
+    uint32_t constantUlong(uint64_t value)
+    {
+        return builder.declareConstant(SpirvOp::Constant, typeUlong, { uint32_t(value), uint32_t(value >> 32) });
+    }
+
+    uint32_t constantBool(bool value)
+    {
+        return builder.declareConstant(value ? SpirvOp::ConstantTrue : SpirvOp::ConstantFalse, boolType(1), {});
+    }
+
+    uint32_t constantNull(uint32_t type)
+    {
+        return builder.declareConstant(SpirvOp::ConstantNull, type, {});
+    }
+
+    SpirvValue constantVector(const uint32_t* values, uint32_t count)
+    {
+        uint32_t components[4];
+        for (uint32_t i = 0; i < count; i++)
+            components[i] = builder.declareConstant(SpirvOp::Constant, floatType(1), { values[i] });
+
+        if (count == 1)
+            return { components[0], 1 };
+
+        return { builder.declareConstant(SpirvOp::ConstantComposite, floatType(count), components, count), count };
+    }
+
+    SpirvValue constantSplat(float value, uint32_t count)
+    {
+        uint32_t values[4]{};
+        for (uint32_t i = 0; i < count; i++)
+            memcpy(&values[i], &value, sizeof(value));
+
+        return constantVector(values, count);
+    }
+
+    void label(uint32_t id)
+    {
+        assert(!isBlockOpen);
+        SpirvBuilder::emit(code, SpirvOp::Label, { id });
+        isBlockOpen = true;
+    }
+
+    // Code following a terminator is unreachable, but still gets a block of its own.
+    void openBlock()
+    {
+        if (!isBlockOpen)
+            label(builder.allocateId());
+    }
+
+    uint32_t emit(SpirvOp op, uint32_t type, const uint32_t* operands, size_t operandCount)
+    {
+        openBlock();
+
+        uint32_t id = builder.allocateId();
+        code.push_back(uint32_t((operandCount + 3) << 16) | uint32_t(op));
+        code.push_back(type);
+        code.push_back(id);
+        code.insert(code.end(), operands, operands + operandCount);
+
+        return id;
+    }
+
+    uint32_t emit(SpirvOp op, uint32_t type, std::initializer_list<uint32_t> operands)
+    {
+        return emit(op, type, operands.begin(), operands.size());
+    }
+
+    void emitVoid(SpirvOp op, std::initializer_list<uint32_t> operands)
+    {
+        openBlock();
+        SpirvBuilder::emit(code, op, operands);
+    }
+
+    // Blocks that are already terminated, such as after a break, have nothing left to branch.
+    void emitTerminator(SpirvOp op, std::initializer_list<uint32_t> operands)
+    {
+        if (isBlockOpen)
+        {
+            SpirvBuilder::emit(code, op, operands);
+            isBlockOpen = false;
+        }
+    }
+
+    uint32_t glsl(GlslOp op, uint32_t type, std::initializer_list<uint32_t> operands)
+    {
+        uint32_t extOperands[5] = { glslImport, uint32_t(op) };
+        std::copy(operands.begin(), operands.end(), extOperands + 2);
+        return emit(SpirvOp::ExtInst, type, extOperands, operands.size() + 2);
+    }
+
+    uint32_t variable(uint32_t type, uint32_t initializer)
+    {
+        uint32_t id = builder.allocateId();
+        SpirvBuilder::emit(variables, SpirvOp::Variable, { pointerType(SPIRV_STORAGE_CLASS_FUNCTION, type), id, SPIRV_STORAGE_CLASS_FUNCTION, initializer });
+        return id;
+    }
+
+    uint32_t stateVariable(uint32_t& id, uint32_t type)
+    {
+        if (id == 0)
+            id = variable(type, constantNull(type));
+
+        return id;
+    }
+
+    uint32_t globalVariable(uint32_t storageClass, uint32_t type)
+    {
+        uint32_t id = builder.allocateId();
+        SpirvBuilder::emit(builder.declarations, SpirvOp::Variable, { pointerType(storageClass, type), id, storageClass });
+
+        if (storageClass == SPIRV_STORAGE_CLASS_INPUT || storageClass == SPIRV_STORAGE_CLASS_OUTPUT)
+            interfaceVariables.push_back(id);
+
+        return id;
+    }
+
+    void decorate(uint32_t id, uint32_t decoration, uint32_t value)
+    {
+        SpirvBuilder::emit(builder.annotations, SpirvOp::Decorate, { id, decoration, value });
+    }
+
+    uint32_t load(uint32_t type, uint32_t pointer)
+    {
+        return emit(SpirvOp::Load, type, { pointer });
+    }
+
+    void store(uint32_t pointer, uint32_t value)
+    {
+        emitVoid(SpirvOp::Store, { pointer, value });
+    }
+
+    uint32_t registerVariable(uint32_t index)
+    {
+        if (index >= std::size(registers))
+        {
+            isSupported = false;
+            index = 0;
+        }
+
+        return stateVariable(registers[index], floatType(4));
+    }
+
+    // Scalars read any component they get swizzled with.
+    SpirvValue shuffle(SpirvValue value, const uint32_t* components, uint32_t count)
+    {
+        if (value.count == 1)
+            return splat(value, count);
+
+        if (count == 1)
+            return { emit(SpirvOp::CompositeExtract, valueType(value.isBool, 1), { value.id, components[0] }), 1, value.isBool };
+
+        uint32_t operands[6] = { value.id, value.id };
+        std::copy(components, components + count, operands + 2);
+        return { emit(SpirvOp::VectorShuffle, valueType(value.isBool, count), operands, count + 2), count, value.isBool };
+    }
+
+    SpirvValue extract(SpirvValue value, uint32_t component)
+    {
+        return shuffle(value, &component, 1);
+    }
+
+    SpirvValue splat(SpirvValue value, uint32_t count)
+    {
+        if (value.count == count)
+            return value;
+
+        assert(value.count == 1);
+        uint32_t operands[4] = { value.id, value.id, value.id, value.id };
+        return { emit(SpirvOp::CompositeConstruct, valueType(value.isBool, count), operands, count), count, value.isBool };
+    }
+
+    // Implicit conversions of HLSL, which splat scalars and truncate vectors.
+    SpirvValue resize(SpirvValue value, uint32_t count)
+    {
+        if (value.count == count)
+            return value;
+
+        if (value.count == 1)
+            return splat(value, count);
+
+        if (value.count < count)
+        {
+            isSupported = false;
+            return { value.id, count, value.isBool };
+        }
+
+        static constexpr uint32_t COMPONENTS[] = { 0, 1, 2, 3 };
+        return shuffle(value, COMPONENTS, count);
+    }
+
+    void unify(SpirvValue& left, SpirvValue& right)
+    {
+        if (left.count == right.count)
+            return;
+
+        if (left.count == 1)
+        {
+            left = splat(left, right.count);
+        }
+        else if (right.count == 1)
+        {
+            right = splat(right, left.count);
+        }
+        else
+        {
+            uint32_t count = std::min(left.count, right.count);
+            left = resize(left, count);
+            right = resize(right, count);
+        }
+    }
+
+    SpirvValue binary(SpirvOp op, SpirvValue left, SpirvValue right)
+    {
+        unify(left, right);
+        return { emit(op, floatType(left.count), { left.id, right.id }), left.count };
+    }
+
+    SpirvValue compare(SpirvOp op, SpirvValue left, SpirvValue right)
+    {
+        unify(left, right);
+        return { emit(op, boolType(left.count), { left.id, right.id }), left.count, true };
+    }
+
+    SpirvValue compareZero(SpirvOp op, SpirvValue value)
+    {
+        return compare(op, value, constantSplat(0.0f, value.count));
+    }
+
+    SpirvValue negate(SpirvValue value)
+    {
+        return { emit(SpirvOp::FNegate, floatType(value.count), { value.id }), value.count };
+    }
+
+    SpirvValue glsl(GlslOp op, SpirvValue value)
+    {
+        return { glsl(op, floatType(value.count), { value.id }), value.count };
+    }
+
+    SpirvValue glsl(GlslOp op, SpirvValue left, SpirvValue right)
+    {
+        unify(left, right);
+        return { glsl(op, floatType(left.count), { left.id, right.id }), left.count };
+    }
+
+    SpirvValue clamp(SpirvValue value, float min, float max)
+    {
+        return { glsl(GlslOp::FClamp, floatType(value.count), { value.id, constantSplat(min, value.count).id, constantSplat(max, value.count).id }), value.count };
+    }
+
+    SpirvValue select(SpirvValue condition, SpirvValue left, SpirvValue right)
+    {
+        unify(left, right);
+
+        if (condition.count != left.count)
+        {
+            if (condition.count == 1)
+            {
+                condition = splat(condition, left.count);
+            }
+            else if (left.count == 1)
+            {
+                left = splat(left, condition.count);
+                right = splat(right, condition.count);
+            }
+            else
+            {
+                uint32_t count = std::min(condition.count, left.count);
+                condition = resize(condition, count);
+                left = resize(left, count);
+                right = resize(right, count);
+            }
+        }
+
+        return { emit(SpirvOp::Select, floatType(left.count), { condition.id, left.id, right.id }), left.count };
+    }
+
+    SpirvValue toFloat(SpirvValue condition)
+    {
+        return select(condition, constantSplat(1.0f, condition.count), constantSplat(0.0f, condition.count));
+    }
+
+    SpirvValue any(SpirvValue condition)
+    {
+        if (condition.count == 1)
+            return condition;
+
+        return { emit(SpirvOp::Any, boolType(1), { condition.id }), 1, true };
+    }
+
+    SpirvValue logicalNot(SpirvValue condition)
+    {
+        return { emit(SpirvOp::LogicalNot, boolType(condition.count), { condition.id }), condition.count, true };
+    }
+
+    SpirvValue dot(SpirvValue left, SpirvValue right)
+    {
+        unify(left, right);
+
+        if (left.count == 1)
+            return binary(SpirvOp::FMul, left, right);
+
+        return { emit(SpirvOp::Dot, floatType(1), { left.id, right.id }), 1 };
+    }
+
+    // Writes the components of a mask, the value gets converted to their count.
+    void storeComponents(uint32_t pointer, uint32_t mask, SpirvValue value)
+    {
+        uint32_t count = uint32_t(std::bitset<4>(mask).count());
+        value = resize(value, count);
+
+        if (count == 4)
+        {
+            store(pointer, value.id);
+            return;
+        }
+
+        uint32_t previous = load(floatType(4), pointer);
+        uint32_t result;
+
+        if (count == 1)
+        {
+            uint32_t component = 0;
+            while ((mask & (1 << component)) == 0)
+                ++component;
+
+            result = emit(SpirvOp::CompositeInsert, floatType(4), { value.id, previous, component });
+        }
+        else
+        {
+            uint32_t operands[6] = { previous, value.id };
+            uint32_t index = 0;
+
+            for (uint32_t i = 0; i < 4; i++)
+                operands[i + 2] = ((mask >> i) & 0x1) ? 4 + index++ : i;
+
+            result = emit(SpirvOp::VectorShuffle, floatType(4), operands, 6);
+        }
+
+        store(pointer, result);
+    }
+
+    uint32_t loadPushConstant(uint32_t member)
+    {
+        uint32_t pointer = emit(SpirvOp::AccessChain, pointerType(SPIRV_STORAGE_CLASS_PUSH_CONSTANT, typeUlong), { pushConstants, constantUint(member) });
+        return load(typeUlong, pointer);
+    }
+
+    // Loads from a buffer device address, the offset being a 64-bit integer of either signedness.
+    uint32_t loadAddress(uint32_t type, uint32_t member, uint32_t offset, uint32_t alignment)
+    {
+        uint32_t address = emit(SpirvOp::IAdd, typeUlong, { loadPushConstant(member), offset });
+        uint32_t pointer = emit(SpirvOp::ConvertUToPtr, pointerType(SPIRV_STORAGE_CLASS_PHYSICAL_STORAGE_BUFFER, type), { address });
+        return emit(SpirvOp::Load, type, { pointer, SPIRV_MEMORY_ACCESS_ALIGNED, alignment });
+    }
+
+    uint32_t loadShared(uint32_t type, uint32_t offset)
+    {
+        return loadAddress(type, 2, constantUlong(offset), 4);
+    }
+
+    uint32_t loadShaderConstant(uint32_t offset)
+    {
+        return loadAddress(floatType(4), isPixelShader ? 1 : 0, offset, 16);
+    }
+
+    SpirvValue isSpecConstantSet(uint32_t mask)
+    {
+        uint32_t masked = emit(SpirvOp::BitwiseAnd, uintType(1), { specConstants, constantUint(mask) });
+        return { emit(SpirvOp::INotEqual, boolType(1), { masked, constantUint(0) }), 1, true };
+    }
+
+    SpirvValue loadFloat4Constant(const IrOperand& operand)
+    {
+        auto constantInfo = recompiler.float4Constants[operand.reg];
+        if (constantInfo != nullptr)
+        {
+            if (constantInfo->registerCount > 1)
+            {
+                int32_t tailCount = (isPixelShader ? 224 : 256) - constantInfo->registerIndex;
+                int32_t offset = operand.reg - constantInfo->registerIndex;
+
+                // The HLSL tail count would be unsigned.
+                if (tailCount <= 0)
+                {
+                    isSupported = false;
+                    return constantSplat(0.0f, 4);
+                }
+
+                if (operand.addressing == IrAddressing::Absolute)
+                {
+                    if (offset >= tailCount)
+                        return constantSplat(0.0f, 4);
+
+                    return { loadShaderConstant(constantUlong((constantInfo->registerIndex + offset) * 16)), 4 };
+                }
+
+                uint32_t relative = load(typeInt, stateVariable(operand.addressing == IrAddressing::A0 ? a0 : aL, typeInt));
+                uint32_t index = emit(SpirvOp::IAdd, typeInt, { constantInt(offset), relative });
+                uint32_t isInRange = emit(SpirvOp::SLessThan, boolType(1), { index, constantInt(tailCount) });
+                uint32_t clampedIndex = glsl(GlslOp::SMin, typeInt, { index, constantInt(tailCount - 1) });
+                uint32_t registerIndex = emit(SpirvOp::IAdd, typeInt, { constantInt(constantInfo->registerIndex), clampedIndex });
+                uint32_t byteOffset = emit(SpirvOp::IMul, typeInt, { registerIndex, constantInt(16) });
+                uint32_t value = loadShaderConstant(emit(SpirvOp::SConvert, typeLong, { byteOffset }));
+
+                return select({ isInRange, 1, true }, { value, 4 }, constantSplat(0.0f, 4));
+            }
+
+            if (operand.addressing != IrAddressing::Absolute)
+                isSupported = false;
+
+            return { loadShaderConstant(constantUlong(constantInfo->registerIndex * 16)), 4 };
+        }
+
+        if (operand.addressing != IrAddressing::Absolute)
+            isSupported = false;
+
+        // Registers without a name are only declared by the definition table.
+        if (recompiler.container.hasDefinitionTable)
+        {
+            for (auto& definition : recompiler.container.float4Definitions)
+            {
+                for (uint16_t i = 0; i < (definition.count + 3) / 4; i++)
+                {
+                    if (definition.registerIndex + i - (isPixelShader ? 256 : 0) == operand.reg)
+                    {
+                        uint32_t values[4];
+                        for (size_t j = 0; j < 4; j++)
+                            values[j] = definition.values[i * 4 + j];
+
+                        return constantVector(values, 4);
+                    }
+                }
+            }
+        }
+
+        isSupported = false;
+        return constantSplat(0.0f, 4);
+    }
+
+    SpirvValue loadOperand(const IrOperand& operand)
+    {
+        if (operand.isLiteral)
+            return constantVector(operand.literals, operand.componentCount);
+
+        SpirvValue value;
+        if (operand.isConstant)
+            value = loadFloat4Constant(operand);
+        else
+            value = { load(floatType(4), registerVariable(operand.reg)), 4 };
+
+        uint32_t components[4];
+        for (uint32_t i = 0; i < operand.componentCount; i++)
+            components[i] = operand.components[i];
+
+        value = shuffle(value, components, operand.componentCount);
+
+        if (operand.abs)
+            value = glsl(GlslOp::FAbs, value);
+
+        if (operand.negate)
+            value = negate(value);
+
+        return value;
+    }
+
+    SpirvValue condition(const IrControlFlow& node, bool taken)
+    {
+        if (node.isUnconditional)
+            return { constantBool(taken), 1, true };
+
+        if (node.isPredicated)
+        {
+            SpirvValue predicate = { load(boolType(1), stateVariable(p0, boolType(1))), 1, true };
+            return node.condition == taken ? predicate : logicalNot(predicate);
+        }
+
+        uint32_t bit = node.boolAddress + (isPixelShader ? 16 : 0);
+        if (node.boolAddress >= std::size(recompiler.boolConstants) || recompiler.boolConstants[node.boolAddress] == nullptr || bit >= 32)
+        {
+            isSupported = false;
+            return { constantBool(false), 1, true };
+        }
+
+        uint32_t masked = emit(SpirvOp::BitwiseAnd, uintType(1), { loadShared(uintType(1), SHARED_BOOLEANS_OFFSET), constantUint(1u << bit) });
+        SpirvOp op = node.condition == taken ? SpirvOp::INotEqual : SpirvOp::IEqual;
+        return { emit(op, boolType(1), { masked, constantUint(0) }), 1, true };
+    }
+
+    void beginIf(SpirvValue condition)
+    {
+        auto& construct = constructs.emplace_back();
+        construct.kind = IrStatementKind::If;
+        construct.mergeLabel = builder.allocateId();
+        construct.elseLabel = builder.allocateId();
+        uint32_t thenLabel = builder.allocateId();
+
+        emitVoid(SpirvOp::SelectionMerge, { construct.mergeLabel, 0 });
+        emitTerminator(SpirvOp::BranchConditional, { condition.id, thenLabel, construct.elseLabel });
+        label(thenLabel);
+    }
+
+    void beginElse()
+    {
+        auto& construct = constructs.back();
+        emitTerminator(SpirvOp::Branch, { construct.mergeLabel });
+        label(construct.elseLabel);
+        construct.isElseOpen = true;
+    }
+
+    void endIf()
+    {
+        auto construct = constructs.back();
+        constructs.pop_back();
+
+        emitTerminator(SpirvOp::Branch, { construct.mergeLabel });
+
+        if (!construct.isElseOpen)
+        {
+            label(construct.elseLabel);
+            emitTerminator(SpirvOp::Branch, { construct.mergeLabel });
+        }
+
+        label(construct.mergeLabel);
+    }
+
+    // Equivalent of clip() with a condition that is true when the pixel gets discarded.
+    void killIf(SpirvValue condition)
+    {
+        uint32_t killLabel = builder.allocateId();
+        uint32_t mergeLabel = builder.allocateId();
+
+        emitVoid(SpirvOp::SelectionMerge, { mergeLabel, 0 });
+        emitTerminator(SpirvOp::BranchConditional, { condition.id, killLabel, mergeLabel });
+        label(killLabel);
+        emitTerminator(SpirvOp::Kill, {});
+        label(mergeLabel);
+    }
+
+    // Opens the loop header, the loop merge instruction is left to the caller.
+    SpirvConstruct& beginLoop(IrStatementKind kind)
+    {
+        auto& construct = constructs.emplace_back();
+        construct.kind = kind;
+        construct.headerLabel = builder.allocateId();
+        construct.mergeLabel = builder.allocateId();
+        construct.continueLabel = builder.allocateId();
+
+        emitTerminator(SpirvOp::Branch, { construct.headerLabel });
+        label(construct.headerLabel);
+
+        return construct;
+    }
+
+    void enterLoopBody(const SpirvConstruct& construct, uint32_t loopControl, const SpirvValue* condition)
+    {
+        uint32_t bodyLabel = builder.allocateId();
+
+        emitVoid(SpirvOp::LoopMerge, { construct.mergeLabel, construct.continueLabel, loopControl });
+
+        if (condition != nullptr)
+            emitTerminator(SpirvOp::BranchConditional, { condition->id, bodyLabel, construct.mergeLabel });
+        else
+            emitTerminator(SpirvOp::Branch, { bodyLabel });
+
+        label(bodyLabel);
+    }
+
+    const SpirvConstruct* innermostLoop() const
+    {
+        for (auto it = constructs.rbegin(); it != constructs.rend(); ++it)
+        {
+            if (it->kind != IrStatementKind::If)
+                return &*it;
+        }
+
+        return nullptr;
+    }
+
+    uint32_t descriptorHeap(uint32_t& heap, uint32_t elementType, uint32_t descriptorSet)
+    {
+        if (heap == 0)
+        {
+            usesDescriptorHeaps = true;
+            heap = globalVariable(SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT, builder.declareType(SpirvOp::TypeRuntimeArray, { elementType }));
+            decorate(heap, SPIRV_DECORATION_DESCRIPTOR_SET, descriptorSet);
+            decorate(heap, SPIRV_DECORATION_BINDING, 0);
+        }
+
+        return heap;
+    }
+
+    uint32_t imageType(uint32_t dimension)
+    {
+        if (typeImages[dimension] == 0)
+            typeImages[dimension] = builder.declareType(SpirvOp::TypeImage, { floatType(1), SPIRV_TEXTURE_DIMENSIONS[dimension], 2, 0, 0, 1, 0 });
+
+        return typeImages[dimension];
+    }
+
+    // Dimension indexes the 2D, 3D and cube heaps.
+    uint32_t loadTexture(uint32_t dimension, uint32_t constIndex)
+    {
+        uint32_t type = imageType(dimension);
+        uint32_t heap = descriptorHeap(textureHeaps[dimension], type, dimension);
+        uint32_t index = loadShared(uintType(1), dimension * 64 + constIndex * 4);
+        uint32_t pointer = emit(SpirvOp::AccessChain, pointerType(SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT, type), { heap, index });
+        return load(type, pointer);
+    }
+
+    uint32_t loadSampler(uint32_t constIndex)
+    {
+        if (typeSampler == 0)
+            typeSampler = builder.declareType(SpirvOp::TypeSampler, {});
+
+        uint32_t heap = descriptorHeap(samplerHeap, typeSampler, SAMPLER_DESCRIPTOR_SET);
+        uint32_t index = loadShared(uintType(1), std::size(SPIRV_TEXTURE_DIMENSIONS) * 64 + constIndex * 4);
+        uint32_t pointer = emit(SpirvOp::AccessChain, pointerType(SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT, typeSampler), { heap, index });
+        return load(typeSampler, pointer);
+    }
+
+    SpirvValue sample(uint32_t dimension, uint32_t texture, uint32_t sampler, SpirvValue texCoord)
+    {
+        uint32_t sampledImageType = builder.declareType(SpirvOp::TypeSampledImage, { imageType(dimension) });
+        uint32_t sampledImage = emit(SpirvOp::SampledImage, sampledImageType, { texture, sampler });
+        return { emit(SpirvOp::ImageSampleImplicitLod, floatType(4), { sampledImage, texCoord.id }), 4 };
+    }
+
+    SpirvValue getTexture2DDimensions(uint32_t texture)
+    {
+        usesImageQuery = true;
+        uint32_t dimensions = emit(SpirvOp::ImageQuerySizeLod, uintType(2), { texture, constantUint(0) });
+        return { emit(SpirvOp::ConvertUToF, floatType(2), { dimensions }), 2 };
+    }
+
+    uint32_t cubeMapDataVariable()
+    {
+        if (typeCubeMapData == 0)
+        {
+            uint32_t directionsType = builder.declareType(SpirvOp::TypeArray, { floatType(3), constantUint(2) });
+            typeCubeMapData = builder.declareType(SpirvOp::TypeStruct, { directionsType, uintType(1) });
+        }
+
+        return stateVariable(cubeMapData, typeCubeMapData);
+    }
+
+    uint32_t cubeMapDirection(uint32_t index)
+    {
+        return emit(SpirvOp::AccessChain, pointerType(SPIRV_STORAGE_CLASS_FUNCTION, floatType(3)), { cubeMapDataVariable(), constantUint(0), index });
+    }
+
+    uint32_t cubeMapIndex()
+    {
+        return emit(SpirvOp::AccessChain, pointerType(SPIRV_STORAGE_CLASS_FUNCTION, uintType(1)), { cubeMapDataVariable(), constantUint(1) });
+    }
+
+    SpirvValue tfetchR11G11B10(uint32_t value)
+    {
+        uint32_t x = emit(SpirvOp::CompositeExtract, uintType(1), { value, 0 });
+
+        auto component = [&](uint32_t signMask, uint32_t shift, uint32_t mask, float scale)
+            {
+                uint32_t sign = emit(SpirvOp::BitwiseAnd, uintType(1), { x, constantUint(signMask) });
+                SpirvValue isNegative = { emit(SpirvOp::INotEqual, boolType(1), { sign, constantUint(0) }), 1, true };
+                SpirvValue offset = select(isNegative, constantSplat(-1.0f, 1), constantSplat(0.0f, 1));
+
+                uint32_t bits = x;
+                if (shift != 0)
+                    bits = emit(SpirvOp::ShiftRightLogical, uintType(1), { bits, constantUint(shift) });
+
+                bits = emit(SpirvOp::BitwiseAnd, uintType(1), { bits, constantUint(mask) });
+
+                SpirvValue magnitude = { emit(SpirvOp::ConvertUToF, floatType(1), { bits }), 1 };
+                return binary(SpirvOp::FAdd, offset, binary(SpirvOp::FDiv, magnitude, constantSplat(scale, 1)));
+            };
+
+        SpirvValue r = component(0x00000400, 0, 0x3FF, 1024.0f);
+        SpirvValue g = component(0x00200000, 11, 0x3FF, 1024.0f);
+        SpirvValue b = component(0x80000000, 22, 0x1FF, 512.0f);
+
+        SpirvValue decoded = { emit(SpirvOp::CompositeConstruct, floatType(4), { r.id, g.id, b.id, constantSplat(0.0f, 1).id }), 4 };
+        SpirvValue raw = { emit(SpirvOp::Bitcast, floatType(4), { value }), 4 };
+
+        return select(isSpecConstantSet(SPEC_CONSTANT_R11G11B10_NORMAL), decoded, raw);
+    }
+
+    SpirvValue tfetchTexcoord(SpirvValue value, uint32_t semanticIndex)
+    {
+        static constexpr uint32_t SWAPPED_COMPONENTS[] = { 1, 0, 3, 2 };
+
+        uint32_t swappedTexcoords = loadShared(uintType(1), SHARED_SWAPPED_TEXCOORDS_OFFSET);
+        uint32_t masked = emit(SpirvOp::BitwiseAnd, uintType(1), { swappedTexcoords, constantUint(1u << semanticIndex) });
+        SpirvValue isSwapped = { emit(SpirvOp::INotEqual, boolType(1), { masked, constantUint(0) }), 1, true };
+
+        return select(isSwapped, shuffle(value, SWAPPED_COMPONENTS, 4), value);
+    }
+
+    // Writes a fetch result through the destination swizzle, which can also set components to zero or one.
+    void storeFetchResult(uint32_t dstRegister, uint32_t dstSwizzle, SpirvValue value, bool subtractFromOne)
+    {
+        uint32_t mask = 0;
+        uint32_t components[4];
+        uint32_t count = 0;
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            auto swizzle = FetchDestinationSwizzle((dstSwizzle >> (i * 3)) & 0x7);
+            if (swizzle >= FetchDestinationSwizzle::X && swizzle <= FetchDestinationSwizzle::W)
+            {
+                mask |= 1 << i;
+                components[count++] = uint32_t(swizzle);
+
+                // Texture weights only have two components.
+                if (uint32_t(swizzle) >= value.count)
+                    isSupported = false;
+            }
+        }
+
+        if (count == 0 || !isSupported)
+        {
+            isSupported = false;
+            return;
+        }
+
+        value = shuffle(value, components, count);
+
+        if (subtractFromOne)
+            value = binary(SpirvOp::FSub, constantSplat(1.0f, count), value);
+
+        uint32_t pointer = registerVariable(dstRegister);
+        storeComponents(pointer, mask, value);
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            auto swizzle = FetchDestinationSwizzle((dstSwizzle >> (i * 3)) & 0x7);
+            if (swizzle == FetchDestinationSwizzle::Zero)
+                storeComponents(pointer, 1 << i, constantSplat(0.0f, 1));
+            else if (swizzle == FetchDestinationSwizzle::One)
+                storeComponents(pointer, 1 << i, constantSplat(1.0f, 1));
+        }
+    }
+
+    void translate(const IrInstruction& instr, const IrVertexFetch& vertexFetch)
+    {
+        if (instr.address >= std::size(recompiler.vertexElements) || !recompiler.definedVertexElements.test(instr.address))
+        {
+            isSupported = false;
+            return;
+        }
+
+        auto& vertexElement = recompiler.vertexElements[instr.address];
+
+        uint32_t input = 0;
+        bool isUint = false;
+
+        for (auto& [inputElement, inputVariable] : vertexInputs)
+        {
+            if (inputElement->usage == vertexElement.usage && inputElement->usageIndex == vertexElement.usageIndex)
+            {
+                input = inputVariable;
+                isUint = recompiler.isUintVertexElement(*inputElement);
+                break;
+            }
+        }
+
+        if (input == 0)
+        {
+            isSupported = false;
+            return;
+        }
+
+        uint32_t value = load(isUint ? uintType(4) : floatType(4), input);
+        SpirvValue result = { value, 4 };
+
+        if (isUint)
+            result.id = emit(SpirvOp::ConvertUToF, floatType(4), { value });
+
+        switch (vertexElement.usage)
+        {
+        case DeclUsage::Normal:
+        case DeclUsage::Tangent:
+        case DeclUsage::Binormal:
+            if (!isUint)
+            {
+                isSupported = false;
+                return;
+            }
+
+            result = tfetchR11G11B10(value);
+            break;
+
+        case DeclUsage::TexCoord:
+            result = tfetchTexcoord(result, vertexElement.usageIndex);
+            break;
+        }
+
+        storeFetchResult(vertexFetch.dstRegister, vertexFetch.dstSwizzle, result, false);
+    }
+
+    SpirvValue tfetch2DBicubic(uint32_t texture, uint32_t sampler, SpirvValue texCoord, SpirvValue offset)
+    {
+        SpirvValue dimensions = getTexture2DDimensions(texture);
+
+        auto constant = [&](float value) { return constantSplat(value, 1); };
+        auto add = [&](SpirvValue left, SpirvValue right) { return binary(SpirvOp::FAdd, left, right); };
+        auto sub = [&](SpirvValue left, SpirvValue right) { return binary(SpirvOp::FSub, left, right); };
+        auto mul = [&](SpirvValue left, SpirvValue right) { return binary(SpirvOp::FMul, left, right); };
+        auto div = [&](SpirvValue left, SpirvValue right) { return binary(SpirvOp::FDiv, left, right); };
+
+        auto w0 = [&](SpirvValue a) { return mul(constant(1.0f / 6.0f), add(mul(a, sub(mul(a, add(negate(a), constant(3.0f))), constant(3.0f))), constant(1.0f))); };
+        auto w1 = [&](SpirvValue a) { return mul(constant(1.0f / 6.0f), add(mul(mul(a, a), sub(mul(constant(3.0f), a), constant(6.0f))), constant(4.0f))); };
+        auto w2 = [&](SpirvValue a) { return mul(constant(1.0f / 6.0f), add(mul(a, add(mul(a, add(mul(constant(-3.0f), a), constant(3.0f))), constant(3.0f))), constant(1.0f))); };
+        auto w3 = [&](SpirvValue a) { return mul(constant(1.0f / 6.0f), mul(mul(a, a), a)); };
+        auto g0 = [&](SpirvValue a) { return add(w0(a), w1(a)); };
+        auto g1 = [&](SpirvValue a) { return add(w2(a), w3(a)); };
+        auto h0 = [&](SpirvValue a) { return add(add(constant(-1.0f), div(w1(a), add(w0(a), w1(a)))), constant(0.5f)); };
+        auto h1 = [&](SpirvValue a) { return add(add(constant(1.0f), div(w3(a), add(w2(a), w3(a)))), constant(0.5f)); };
+
+        SpirvValue x = add(mul(extract(texCoord, 0), extract(dimensions, 0)), extract(offset, 0));
+        SpirvValue y = add(mul(extract(texCoord, 1), extract(dimensions, 1)), extract(offset, 1));
+
+        x = sub(x, constant(0.5f));
+        y = sub(y, constant(0.5f));
+        SpirvValue px = glsl(GlslOp::Floor, x);
+        SpirvValue py = glsl(GlslOp::Floor, y);
+        SpirvValue fx = sub(x, px);
+        SpirvValue fy = sub(y, py);
+
+        SpirvValue g0x = g0(fx);
+        SpirvValue g1x = g1(fx);
+        SpirvValue h0x = h0(fx);
+        SpirvValue h1x = h1(fx);
+        SpirvValue h0y = h0(fy);
+        SpirvValue h1y = h1(fy);
+
+        auto fetch = [&](SpirvValue u, SpirvValue v)
+            {
+                SpirvValue coord = { emit(SpirvOp::CompositeConstruct, floatType(2), { u.id, v.id }), 2 };
+                return sample(0, texture, sampler, div(coord, dimensions));
+            };
+
+        SpirvValue top = add(mul(g0x, fetch(add(px, h0x), add(py, h0y))), mul(g1x, fetch(add(px, h1x), add(py, h0y))));
+        SpirvValue bottom = add(mul(g0x, fetch(add(px, h0x), add(py, h1y))), mul(g1x, fetch(add(px, h1x), add(py, h1y))));
+
+        return add(mul(g0(fy), top), mul(g1(fy), bottom));
+    }
+
+    void translate(const IrInstruction& instr, const IrTextureFetch& textureFetch, bool bicubic)
+    {
+        if (!textureFetch.isSupported())
+            return;
+
+        // Texture fetches in vertex shaders would need an explicit level of detail.
+        const char* constName = recompiler.samplers[textureFetch.constIndex];
+        if (!isPixelShader || constName == nullptr || textureFetch.dimension == TextureDimension::Texture1D)
+        {
+            isSupported = false;
+            return;
+        }
+
+        bool subtractFromOne = false;
+#ifdef UNLEASHED_RECOMP
+        subtractFromOne = recompiler.hasMtxPrevInvViewProjection && strcmp(constName, "sampZBuffer") == 0;
+#endif
+
+        auto srcRegister = [&](uint32_t componentCount)
+            {
+                uint32_t components[3];
+                for (uint32_t i = 0; i < componentCount; i++)
+                    components[i] = textureFetch.srcComponent(i);
+
+                SpirvValue value = { load(floatType(4), registerVariable(textureFetch.srcRegister)), 4 };
+                return shuffle(value, components, componentCount);
+            };
+
+        uint32_t dimension = uint32_t(textureFetch.dimension) - uint32_t(TextureDimension::Texture2D);
+        uint32_t texture = loadTexture(dimension, textureFetch.constIndex);
+
+#ifdef UNLEASHED_RECOMP
+        if (textureFetch.constIndex == 0 && textureFetch.dimension == TextureDimension::Texture2D)
+        {
+            SpirvValue texCoord = binary(SpirvOp::FMul, getTexture2DDimensions(texture), srcRegister(2));
+            store(stateVariable(pixelCoord, floatType(2)), texCoord.id);
+        }
+#endif
+
+        SpirvValue result;
+
+        if (textureFetch.dimension == TextureDimension::Texture2D)
+        {
+            float offsetValues[] = { textureFetch.offsetX * 0.5f, textureFetch.offsetY * 0.5f };
+            uint32_t offsetBits[2];
+            memcpy(offsetBits, offsetValues, sizeof(offsetBits));
+            SpirvValue offset = constantVector(offsetBits, 2);
+            SpirvValue texCoord = srcRegister(2);
+
+            if (textureFetch.opcode == FetchOpcode::GetTextureWeights)
+            {
+                if (bicubic)
+                {
+                    isSupported = false;
+                    return;
+                }
+
+                SpirvValue dimensions = getTexture2DDimensions(texture);
+                SpirvValue weights = binary(SpirvOp::FMul, texCoord, dimensions);
+                weights = binary(SpirvOp::FSub, binary(SpirvOp::FAdd, weights, offset), constantSplat(0.5f, 2));
+                weights = glsl(GlslOp::Fract, weights);
+
+                SpirvValue isNan = { emit(SpirvOp::IsNan, boolType(2), { texCoord.id }), 2, true };
+                result = select(isNan, constantSplat(0.0f, 2), weights);
+            }
+            else if (bicubic)
+            {
+                result = tfetch2DBicubic(texture, loadSampler(textureFetch.constIndex), texCoord, offset);
+            }
+            else
+            {
+                uint32_t sampler = loadSampler(textureFetch.constIndex);
+                SpirvValue dimensions = getTexture2DDimensions(texture);
+                texCoord = binary(SpirvOp::FAdd, texCoord, binary(SpirvOp::FDiv, offset, dimensions));
+                result = sample(dimension, texture, sampler, texCoord);
+            }
+        }
+        else
+        {
+            if (textureFetch.opcode == FetchOpcode::GetTextureWeights || bicubic)
+            {
+                isSupported = false;
+                return;
+            }
+
+            uint32_t sampler = loadSampler(textureFetch.constIndex);
+            SpirvValue texCoord = srcRegister(3);
+
+            if (textureFetch.dimension == TextureDimension::TextureCube)
+            {
+                uint32_t index = emit(SpirvOp::ConvertFToU, uintType(1), { extract(texCoord, 2).id });
+                texCoord = { load(floatType(3), cubeMapDirection(index)), 3 };
+            }
+
+            result = sample(dimension, texture, sampler, texCoord);
+        }
+
+        storeFetchResult(textureFetch.dstRegister, textureFetch.dstSwizzle, result, subtractFromOne);
+    }
+
+    void translate(const IrInstruction& instr, const IrAlu& alu)
+    {
+        auto op = [&](uint32_t index) { return loadOperand(alu.vectorSources[index]); };
+        auto scalarOp = [&](uint32_t index) { return loadOperand(alu.scalarSources[index]); };
+
+        auto loadState = [&](uint32_t& variable, uint32_t type, bool isBool) -> SpirvValue
+            {
+                return { load(type, stateVariable(variable, type)), 1, isBool };
+            };
+
+        auto storeA0 = [&](SpirvValue value, bool round)
+            {
+                if (round)
+                    value = binary(SpirvOp::FAdd, value, constantSplat(0.5f, 1));
+
+                value = clamp(glsl(GlslOp::Floor, value), -256.0f, 255.0f);
+                store(stateVariable(a0, typeInt), emit(SpirvOp::ConvertFToS, typeInt, { value.id }));
+            };
+
+        switch (alu.vectorOpcode)
+        {
+        case AluVectorOpcode::KillEq:
+            killIf(any(compare(SpirvOp::FOrdEqual, op(0), op(1))));
+            break;
+        case AluVectorOpcode::KillGt:
+            killIf(any(compare(SpirvOp::FOrdGreaterThan, op(0), op(1))));
+            break;
+        case AluVectorOpcode::KillGe:
+            killIf(any(compare(SpirvOp::FOrdGreaterThanEqual, op(0), op(1))));
+            break;
+        case AluVectorOpcode::KillNe:
+            killIf(any(compare(SpirvOp::FUnordNotEqual, op(0), op(1))));
+            break;
+        }
+
+        uint32_t exportVariable = 0;
+        bool isScalarExport = false;
+
+        if (alu.exportData)
+        {
+            if (isPixelShader)
+            {
+                switch (ExportRegister(alu.vectorDest))
+                {
+                case ExportRegister::PSColor0:
+                case ExportRegister::PSColor1:
+                case ExportRegister::PSColor2:
+                case ExportRegister::PSColor3:
+                    exportVariable = colorOutputs[alu.vectorDest];
+                    isSupported &= exportVariable != 0;
+                    break;
+                case ExportRegister::PSDepth:
+                    exportVariable = depthOutput;
+                    isScalarExport = true;
+                    isSupported &= exportVariable != 0;
+                    break;
+                default:
+                    // Writes go to the temporary register instead, but the zero and one components have nowhere to go.
+                    isSupported &= (alu.exportZeroMask | alu.exportOneMask) == 0;
+                    break;
+                }
+            }
+            else if (ExportRegister(alu.vectorDest) == ExportRegister::VSPosition)
+            {
+                exportVariable = position;
+            }
+            else if (alu.vectorDest < std::size(recompiler.interpolators) && (recompiler.definedInterpolators & (1u << alu.vectorDest)) != 0)
+            {
+                auto& interpolator = recompiler.container.interpolators[alu.vectorDest];
+                for (size_t i = 0; i < std::size(INTERPOLATORS); i++)
+                {
+                    if (INTERPOLATORS[i].first == interpolator.usage && INTERPOLATORS[i].second == interpolator.usageIndex)
+                        exportVariable = interpolatorVariables[i];
+                }
+
+                isSupported &= exportVariable != 0;
+            }
+            else
+            {
+                isSupported = false;
+            }
+
+            if (!isSupported)
+                return;
+        }
+
+        auto storeDestination = [&](uint32_t dest, uint32_t mask, SpirvValue value)
+            {
+                if (exportVariable == 0)
+                {
+                    storeComponents(registerVariable(dest), mask, value);
+                }
+                else if (isScalarExport)
+                {
+                    isSupported &= mask == 0b1;
+                    store(exportVariable, resize(value, 1).id);
+                }
+                else
+                {
+                    storeComponents(exportVariable, mask, value);
+                }
+            };
+
+        if (alu.vectorOpcode >= AluVectorOpcode::SetpEqPush && alu.vectorOpcode <= AluVectorOpcode::SetpGePush)
+        {
+            // Vectors would need the logical and to be applied per component, which HLSL 2021 rejects.
+            SpirvValue left = op(0);
+            SpirvValue right = op(1);
+            if (left.count != 1 || right.count != 1)
+            {
+                isSupported = false;
+                return;
+            }
+
+            SpirvOp compareOp;
+            switch (alu.vectorOpcode)
+            {
+            case AluVectorOpcode::SetpEqPush:
+                compareOp = SpirvOp::FOrdEqual;
+                break;
+            case AluVectorOpcode::SetpNePush:
+                compareOp = SpirvOp::FUnordNotEqual;
+                break;
+            case AluVectorOpcode::SetpGtPush:
+                compareOp = SpirvOp::FOrdGreaterThan;
+                break;
+            default:
+                compareOp = SpirvOp::FOrdGreaterThanEqual;
+                break;
+            }
+
+            SpirvValue isZero = compareZero(SpirvOp::FOrdEqual, left);
+            SpirvValue comparison = compareZero(compareOp, right);
+            store(stateVariable(p0, boolType(1)), emit(SpirvOp::LogicalAnd, boolType(1), { isZero.id, comparison.id }));
+        }
+        else if (alu.vectorOpcode == AluVectorOpcode::MaxA)
+        {
+            SpirvValue value = op(0);
+            if (value.count != 4)
+            {
+                isSupported = false;
+                return;
+            }
+
+            storeA0(extract(value, 3), true);
+        }
+        else if (alu.vectorOpcode > AluVectorOpcode::MaxA)
+        {
+            isSupported = false;
+            return;
+        }
+
+        if (alu.vectorWriteMask != 0)
+        {
+            SpirvValue value;
+
+            auto compareOp = [&](SpirvOp op)
+                {
+                    return toFloat(compare(op, this->loadOperand(alu.vectorSources[0]), this->loadOperand(alu.vectorSources[1])));
+                };
+
+            auto float4Argument = [&](SpirvValue value)
+                {
+                    isSupported &= value.count == 1 || value.count == 4;
+                    return resize(value, 4);
+                };
+
+            switch (alu.vectorOpcode)
+            {
+            case AluVectorOpcode::Add:
+                value = binary(SpirvOp::FAdd, op(0), op(1));
+                break;
+
+            case AluVectorOpcode::Mul:
+                value = binary(SpirvOp::FMul, op(0), op(1));
+                break;
+
+            case AluVectorOpcode::Max:
+            case AluVectorOpcode::MaxA:
+                if (alu.vectorOpcode == AluVectorOpcode::Max && alu.vectorSources[0] == alu.vectorSources[1])
+                    value = op(0);
+                else
+                    value = glsl(GlslOp::FMax, op(0), op(1));
+                break;
+
+            case AluVectorOpcode::Min:
+                value = glsl(GlslOp::FMin, op(0), op(1));
+                break;
+
+            case AluVectorOpcode::Seq:
+                value = compareOp(SpirvOp::FOrdEqual);
+                break;
+
+            case AluVectorOpcode::Sgt:
+                value = compareOp(SpirvOp::FOrdGreaterThan);
+                break;
+
+            case AluVectorOpcode::Sge:
+                value = compareOp(SpirvOp::FOrdGreaterThanEqual);
+                break;
+
+            case AluVectorOpcode::Sne:
+                value = compareOp(SpirvOp::FUnordNotEqual);
+                break;
+
+            case AluVectorOpcode::Frc:
+                value = glsl(GlslOp::Fract, op(0));
+                break;
+
+            case AluVectorOpcode::Trunc:
+                value = glsl(GlslOp::Trunc, op(0));
+                break;
+
+            case AluVectorOpcode::Floor:
+                value = glsl(GlslOp::Floor, op(0));
+                break;
+
+            case AluVectorOpcode::Mad:
+                value = binary(SpirvOp::FAdd, binary(SpirvOp::FMul, op(0), op(1)), op(2));
+                break;
+
+            case AluVectorOpcode::CndEq:
+                value = select(compareZero(SpirvOp::FOrdEqual, op(0)), op(1), op(2));
+                break;
+
+            case AluVectorOpcode::CndGe:
+                value = select(compareZero(SpirvOp::FOrdGreaterThanEqual, op(0)), op(1), op(2));
+                break;
+
+            case AluVectorOpcode::CndGt:
+                value = select(compareZero(SpirvOp::FOrdGreaterThan, op(0)), op(1), op(2));
+                break;
+
+            case AluVectorOpcode::Dp4:
+            case AluVectorOpcode::Dp3:
+                value = dot(op(0), op(1));
+                break;
+
+            case AluVectorOpcode::Dp2Add:
+                value = binary(SpirvOp::FAdd, dot(op(0), op(1)), op(2));
+                break;
+
+            case AluVectorOpcode::Cube:
+            {
+                // The HLSL reads the temporary register even if the source is a constant.
+                if (!isPixelShader || alu.vectorSources[0].isConstant)
+                {
+                    isSupported = false;
+                    return;
+                }
+
+                static constexpr uint32_t DIRECTION_COMPONENTS[] = { 0, 1, 2 };
+
+                SpirvValue source = { load(floatType(4), registerVariable(alu.vectorSources[0].reg)), 4 };
+                uint32_t indexPointer = cubeMapIndex();
+                uint32_t index = load(uintType(1), indexPointer);
+                store(cubeMapDirection(index), shuffle(source, DIRECTION_COMPONENTS, 3).id);
+                store(indexPointer, emit(SpirvOp::IAdd, uintType(1), { index, constantUint(1) }));
+
+                uint32_t zero = constantSplat(0.0f, 1).id;
+                uint32_t indexValue = emit(SpirvOp::ConvertUToF, floatType(1), { index });
+                value = { emit(SpirvOp::CompositeConstruct, floatType(4), { zero, zero, zero, indexValue }), 4 };
+                break;
+            }
+
+            case AluVectorOpcode::Max4:
+            {
+                SpirvValue source = float4Argument(op(0));
+                SpirvValue xy = glsl(GlslOp::FMax, extract(source, 0), extract(source, 1));
+                SpirvValue zw = glsl(GlslOp::FMax, extract(source, 2), extract(source, 3));
+                value = glsl(GlslOp::FMax, xy, zw);
+                break;
+            }
+
+            case AluVectorOpcode::SetpEqPush:
+            case AluVectorOpcode::SetpNePush:
+            case AluVectorOpcode::SetpGtPush:
+            case AluVectorOpcode::SetpGePush:
+                value = select(loadState(p0, boolType(1), true), constantSplat(0.0f, 1), binary(SpirvOp::FAdd, op(0), constantSplat(1.0f, 1)));
+                break;
+
+            case AluVectorOpcode::KillEq:
+                value = toFloat(any(compare(SpirvOp::FOrdEqual, op(0), op(1))));
+                break;
+
+            case AluVectorOpcode::KillGt:
+                value = toFloat(any(compare(SpirvOp::FOrdGreaterThan, op(0), op(1))));
+                break;
+
+            case AluVectorOpcode::KillGe:
+                value = toFloat(any(compare(SpirvOp::FOrdGreaterThanEqual, op(0), op(1))));
+                break;
+
+            case AluVectorOpcode::KillNe:
+                value = toFloat(any(compare(SpirvOp::FUnordNotEqual, op(0), op(1))));
+                break;
+
+            case AluVectorOpcode::Dst:
+            {
+                SpirvValue left = float4Argument(op(0));
+                SpirvValue right = float4Argument(op(1));
+                SpirvValue y = binary(SpirvOp::FMul, extract(left, 1), extract(right, 1));
+                value = { emit(SpirvOp::CompositeConstruct, floatType(4), { constantSplat(1.0f, 1).id, y.id, extract(left, 2).id, extract(right, 3).id }), 4 };
+                break;
+            }
+            }
+
+            if (alu.vectorSaturate)
+                value = clamp(value, 0.0f, 1.0f);
+
+            storeDestination(alu.vectorDest, alu.vectorWriteMask, value);
+        }
+
+        if (alu.scalarOpcode != AluScalarOpcode::RetainPrev)
+        {
+            if (alu.scalarOpcode >= AluScalarOpcode::SetpEq && alu.scalarOpcode <= AluScalarOpcode::SetpRstr)
+            {
+                SpirvValue predicate;
+
+                switch (alu.scalarOpcode)
+                {
+                case AluScalarOpcode::SetpEq:
+                case AluScalarOpcode::SetpRstr:
+                    predicate = compareZero(SpirvOp::FOrdEqual, scalarOp(0));
+                    break;
+                case AluScalarOpcode::SetpNe:
+                    predicate = compareZero(SpirvOp::FUnordNotEqual, scalarOp(0));
+                    break;
+                case AluScalarOpcode::SetpGt:
+                    predicate = compareZero(SpirvOp::FOrdGreaterThan, scalarOp(0));
+                    break;
+                case AluScalarOpcode::SetpGe:
+                    predicate = compareZero(SpirvOp::FOrdGreaterThanEqual, scalarOp(0));
+                    break;
+                case AluScalarOpcode::SetpInv:
+                    predicate = compare(SpirvOp::FOrdEqual, scalarOp(0), constantSplat(1.0f, 1));
+                    break;
+                case AluScalarOpcode::SetpPop:
+                    predicate = compareZero(SpirvOp::FOrdLessThanEqual, binary(SpirvOp::FSub, scalarOp(0), constantSplat(1.0f, 1)));
+                    break;
+                case AluScalarOpcode::SetpClr:
+                    predicate = { constantBool(false), 1, true };
+                    break;
+                }
+
+                store(stateVariable(p0, boolType(1)), predicate.id);
+            }
+
+            auto previous = [&]() { return loadState(ps, floatType(1), false); };
+
+            // Clamps the result of transcendentals to [-FLT_MAX, FLT_MAX] like the HLSL FLT_MIN and FLT_MAX macros do.
+            auto clampFinite = [&](SpirvValue value)
+                {
+                    return alu.omitScalarClamp ? value : clamp(value, -FLT_MAX, FLT_MAX);
+                };
+
+            SpirvValue value;
+
+            switch (alu.scalarOpcode)
+            {
+            case AluScalarOpcode::Adds:
+            case AluScalarOpcode::Addsc0:
+            case AluScalarOpcode::Addsc1:
+                value = binary(SpirvOp::FAdd, scalarOp(0), scalarOp(1));
+                break;
+
+            case AluScalarOpcode::AddsPrev:
+                value = binary(SpirvOp::FAdd, scalarOp(0), previous());
+                break;
+
+            case AluScalarOpcode::Muls:
+            case AluScalarOpcode::Mulsc0:
+            case AluScalarOpcode::Mulsc1:
+                value = binary(SpirvOp::FMul, scalarOp(0), scalarOp(1));
+                break;
+
+            case AluScalarOpcode::MulsPrev:
+            case AluScalarOpcode::MulsPrev2:
+                value = binary(SpirvOp::FMul, scalarOp(0), previous());
+                break;
+
+            case AluScalarOpcode::Maxs:
+            case AluScalarOpcode::MaxAs:
+            case AluScalarOpcode::MaxAsf:
+                if (alu.scalarOpcode == AluScalarOpcode::Maxs && alu.scalarSources[0] == alu.scalarSources[1])
+                    value = scalarOp(0);
+                else
+                    value = glsl(GlslOp::FMax, scalarOp(0), scalarOp(1));
+                break;
+
+            case AluScalarOpcode::Mins:
+                value = glsl(GlslOp::FMin, scalarOp(0), scalarOp(1));
+                break;
+
+            case AluScalarOpcode::Seqs:
+            case AluScalarOpcode::KillsEq:
+                value = toFloat(compareZero(SpirvOp::FOrdEqual, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Sgts:
+            case AluScalarOpcode::KillsGt:
+                value = toFloat(compareZero(SpirvOp::FOrdGreaterThan, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Sges:
+            case AluScalarOpcode::KillsGe:
+                value = toFloat(compareZero(SpirvOp::FOrdGreaterThanEqual, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Snes:
+            case AluScalarOpcode::KillsNe:
+                value = toFloat(compareZero(SpirvOp::FUnordNotEqual, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::KillsOne:
+                value = toFloat(compare(SpirvOp::FOrdEqual, scalarOp(0), constantSplat(1.0f, 1)));
+                break;
+
+            case AluScalarOpcode::Frcs:
+                value = glsl(GlslOp::Fract, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Truncs:
+                value = glsl(GlslOp::Trunc, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Floors:
+                value = glsl(GlslOp::Floor, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Exp:
+                value = glsl(GlslOp::Exp2, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Logc:
+            case AluScalarOpcode::Log:
+                value = clampFinite(glsl(GlslOp::Log2, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Rcpc:
+            case AluScalarOpcode::Rcpf:
+            case AluScalarOpcode::Rcp:
+                value = clampFinite(binary(SpirvOp::FDiv, constantSplat(1.0f, 1), scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Rsqc:
+            case AluScalarOpcode::Rsqf:
+            case AluScalarOpcode::Rsq:
+                value = clampFinite(glsl(GlslOp::InverseSqrt, scalarOp(0)));
+                break;
+
+            case AluScalarOpcode::Subs:
+            case AluScalarOpcode::Subsc0:
+            case AluScalarOpcode::Subsc1:
+                value = binary(SpirvOp::FSub, scalarOp(0), scalarOp(1));
+                break;
+
+            case AluScalarOpcode::SubsPrev:
+                value = binary(SpirvOp::FSub, scalarOp(0), previous());
+                break;
+
+            case AluScalarOpcode::SetpEq:
+            case AluScalarOpcode::SetpNe:
+            case AluScalarOpcode::SetpGt:
+            case AluScalarOpcode::SetpGe:
+                value = select(loadState(p0, boolType(1), true), constantSplat(0.0f, 1), constantSplat(1.0f, 1));
+                break;
+
+            case AluScalarOpcode::SetpInv:
+            {
+                SpirvValue source = scalarOp(0);
+                value = select(compareZero(SpirvOp::FOrdEqual, source), constantSplat(1.0f, 1), scalarOp(0));
+                break;
+            }
+
+            case AluScalarOpcode::SetpPop:
+                value = select(loadState(p0, boolType(1), true), constantSplat(0.0f, 1), binary(SpirvOp::FSub, scalarOp(0), constantSplat(1.0f, 1)));
+                break;
+
+            case AluScalarOpcode::SetpClr:
+                value = constantSplat(FLT_MAX, 1);
+                break;
+
+            case AluScalarOpcode::SetpRstr:
+                value = select(loadState(p0, boolType(1), true), constantSplat(0.0f, 1), scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Sqrt:
+                value = glsl(GlslOp::Sqrt, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Sin:
+                value = glsl(GlslOp::Sin, scalarOp(0));
+                break;
+
+            case AluScalarOpcode::Cos:
+                value = glsl(GlslOp::Cos, scalarOp(0));
+                break;
+
+            default:
+                isSupported = false;
+                return;
+            }
+
+            if (alu.scalarSaturate)
+                value = clamp(value, 0.0f, 1.0f);
+
+            store(stateVariable(ps, floatType(1)), resize(value, 1).id);
+
+            switch (alu.scalarOpcode)
+            {
+            case AluScalarOpcode::MaxAs:
+                storeA0(scalarOp(0), true);
+                break;
+            case AluScalarOpcode::MaxAsf:
+                storeA0(scalarOp(0), false);
+                break;
+            }
+        }
+
+        if (alu.scalarWriteMask != 0)
+            storeDestination(alu.scalarDest, alu.scalarWriteMask, loadState(ps, floatType(1), false));
+
+        if (alu.exportData && exportVariable != 0)
+        {
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                uint32_t mask = 1 << i;
+                if (alu.exportZeroMask & mask)
+                    storeDestination(alu.vectorDest, mask, constantSplat(0.0f, 1));
+                else if (alu.exportOneMask & mask)
+                    storeDestination(alu.vectorDest, mask, constantSplat(1.0f, 1));
+            }
+        }
+
+        if (alu.scalarOpcode >= AluScalarOpcode::KillsEq && alu.scalarOpcode <= AluScalarOpcode::KillsOne)
+            killIf(compareZero(SpirvOp::FUnordNotEqual, loadState(ps, floatType(1), false)));
+    }
+
+    void translateEnd()
+    {
+        if (isPixelShader)
+        {
+            if (colorOutputs[0] == 0)
+            {
+                isSupported = false;
+                return;
+            }
+
+            auto alpha = [&]() { return extract({ load(floatType(4), colorOutputs[0]), 4 }, 3); };
+            auto alphaThreshold = [&]() { return SpirvValue{ loadShared(floatType(1), SHARED_ALPHA_THRESHOLD_OFFSET), 1 }; };
+
+            beginIf(isSpecConstantSet(SPEC_CONSTANT_ALPHA_TEST));
+            killIf(compareZero(SpirvOp::FOrdLessThan, binary(SpirvOp::FSub, alpha(), alphaThreshold())));
+
+        #ifdef UNLEASHED_RECOMP
+            beginElse();
+            beginIf(isSpecConstantSet(SPEC_CONSTANT_ALPHA_TO_COVERAGE));
+
+            // computeMipLevel()
+            uint32_t coord = load(floatType(2), stateVariable(pixelCoord, floatType(2)));
+            SpirvValue dx = { emit(SpirvOp::DPdx, floatType(2), { coord }), 2 };
+            SpirvValue dy = { emit(SpirvOp::DPdy, floatType(2), { coord }), 2 };
+            SpirvValue deltaMaxSqr = glsl(GlslOp::FMax, dot(dx, dx), dot(dy, dy));
+            SpirvValue mipLevel = glsl(GlslOp::FMax, constantSplat(0.0f, 1), binary(SpirvOp::FMul, constantSplat(0.5f, 1), glsl(GlslOp::Log2, deltaMaxSqr)));
+
+            SpirvValue scale = binary(SpirvOp::FAdd, constantSplat(1.0f, 1), binary(SpirvOp::FMul, mipLevel, constantSplat(0.25f, 1)));
+            storeComponents(colorOutputs[0], 0b1000, binary(SpirvOp::FMul, alpha(), scale));
+
+            SpirvValue value = alpha();
+            SpirvValue width = { emit(SpirvOp::Fwidth, floatType(1), { value.id }), 1 };
+            width = glsl(GlslOp::FMax, width, constantSplat(1e-6f, 1));
+            value = binary(SpirvOp::FAdd, constantSplat(0.5f, 1), binary(SpirvOp::FDiv, binary(SpirvOp::FSub, value, alphaThreshold()), width));
+            storeComponents(colorOutputs[0], 0b1000, value);
+
+            endIf();
+        #endif
+
+            endIf();
+        }
+        else
+        {
+            static constexpr uint32_t XY_COMPONENTS[] = { 0, 1 };
+
+            SpirvValue value = { load(floatType(4), position), 4 };
+            SpirvValue halfPixelOffset = { loadShared(floatType(2), SHARED_HALF_PIXEL_OFFSET_OFFSET), 2 };
+            SpirvValue xy = binary(SpirvOp::FAdd, shuffle(value, XY_COMPONENTS, 2), binary(SpirvOp::FMul, halfPixelOffset, extract(value, 3)));
+            storeComponents(position, 0b0011, xy);
+        }
+
+        emitTerminator(SpirvOp::Return, {});
+    }
+
+    void translateNode(const IrControlFlow& node)
+    {
+        // Predicated runs are grouped the same way as in HLSL, but always become a branch. The HLSL path only turns
+        // runs that don't write p0 into selects, so evaluating the predicate once is equivalent.
+        bool isPredicateOpen = false;
+        bool predicateCondition = false;
+        uint32_t predicateMergeLabel = 0;
+
+        auto closePredicate = [&]()
+            {
+                if (isPredicateOpen)
+                {
+                    emitTerminator(SpirvOp::Branch, { predicateMergeLabel });
+                    label(predicateMergeLabel);
+                }
+
+                isPredicateOpen = false;
+            };
+
+        for (uint32_t i = 0; i < node.instructionCount; i++)
+        {
+            auto& instr = ir.instructions[node.firstInstruction + i];
+            if (instr.isDead || (instr.kind == IrInstructionKind::TextureFetch && !instr.textureFetch.isSupported()))
+                continue;
+
+            if (!instr.isPredicated || (isPredicateOpen && predicateCondition != instr.predicateCondition))
+                closePredicate();
+
+            if (instr.isPredicated && !isPredicateOpen)
+            {
+                isPredicateOpen = true;
+                predicateCondition = instr.predicateCondition;
+                predicateMergeLabel = builder.allocateId();
+
+                SpirvValue predicate = { load(boolType(1), stateVariable(p0, boolType(1))), 1, true };
+                if (!predicateCondition)
+                    predicate = logicalNot(predicate);
+
+                uint32_t thenLabel = builder.allocateId();
+                emitVoid(SpirvOp::SelectionMerge, { predicateMergeLabel, 0 });
+                emitTerminator(SpirvOp::BranchConditional, { predicate.id, thenLabel, predicateMergeLabel });
+                label(thenLabel);
+            }
+
+            switch (instr.kind)
+            {
+            case IrInstructionKind::VertexFetch:
+                translate(instr, instr.vertexFetch);
+                break;
+
+            case IrInstructionKind::TextureFetch:
+            #ifdef UNLEASHED_RECOMP
+                if (instr.textureFetch.constIndex == 10) // g_GISampler
+                {
+                    beginIf(isSpecConstantSet(SPEC_CONSTANT_BICUBIC_GI_FILTER));
+                    translate(instr, instr.textureFetch, true);
+                    beginElse();
+                    translate(instr, instr.textureFetch, false);
+                    endIf();
+                }
+                else
+            #endif
+                {
+                    translate(instr, instr.textureFetch, false);
+                }
+                break;
+
+            case IrInstructionKind::Alu:
+                translate(instr, instr.alu);
+                break;
+            }
+
+            if ((instr.stateWrites & IR_STATE_P0) != 0)
+                closePredicate();
+        }
+
+        closePredicate();
+
+        if (node.isEnd)
+            translateEnd();
+    }
+
+    void translateStatement(const IrStatement& statement)
+    {
+        auto& node = ir.nodes[statement.node];
+
+        switch (statement.kind)
+        {
+        case IrStatementKind::Node:
+            translateNode(node);
+            break;
+
+        case IrStatementKind::If:
+            beginIf(condition(node, statement.taken));
+            break;
+
+        case IrStatementKind::Else:
+            beginElse();
+            break;
+
+        case IrStatementKind::EndIf:
+            endIf();
+            break;
+
+        case IrStatementKind::Loop:
+        {
+            // Loops with unknown loop constants read an undefined integer constant in HLSL.
+            if (!ir.definedLoopConstants.test(node.loopId))
+            {
+                isSupported = false;
+                break;
+            }
+
+            uint32_t loopConstant = ir.loopConstants[node.loopId];
+            int32_t count = loopConstant & 0xFF;
+            int32_t start = (loopConstant >> 8) & 0xFF;
+            int32_t step = int8_t(loopConstant >> 16);
+
+            uint32_t loopAL = stateVariable(aL, typeInt);
+            store(loopAL, constantInt(start));
+
+            uint32_t iterationVariable = 0;
+            if (step == 0)
+            {
+                iterationVariable = variable(typeInt, constantNull(typeInt));
+                store(iterationVariable, constantInt(0));
+            }
+
+            auto& construct = beginLoop(IrStatementKind::Loop);
+            construct.iterationVariable = iterationVariable;
+            construct.step = step;
+
+            SpirvValue condition;
+            if (step == 0)
+            {
+                uint32_t iteration = load(typeInt, iterationVariable);
+                condition = { emit(SpirvOp::SLessThan, boolType(1), { iteration, constantInt(count) }), 1, true };
+            }
+            else
+            {
+                SpirvOp op = step > 0 ? SpirvOp::SLessThan : SpirvOp::SGreaterThan;
+                condition = { emit(op, boolType(1), { load(typeInt, loopAL), constantInt(start + count * step) }), 1, true };
+            }
+
+            enterLoopBody(construct, statement.unroll ? SPIRV_LOOP_CONTROL_UNROLL : SPIRV_LOOP_CONTROL_DONT_UNROLL, &condition);
+            break;
+        }
+
+        case IrStatementKind::DoWhile:
+        case IrStatementKind::WhileTrue:
+            enterLoopBody(beginLoop(statement.kind), 0, nullptr);
+            break;
+
+        case IrStatementKind::While:
+        {
+            auto& construct = beginLoop(statement.kind);
+            SpirvValue loopCondition = condition(node, statement.taken);
+            enterLoopBody(construct, 0, &loopCondition);
+            break;
+        }
+
+        case IrStatementKind::EndLoop:
+        case IrStatementKind::EndWhile:
+        case IrStatementKind::EndDoWhile:
+        {
+            auto construct = constructs.back();
+            constructs.pop_back();
+
+            emitTerminator(SpirvOp::Branch, { construct.continueLabel });
+            label(construct.continueLabel);
+
+            if (statement.kind == IrStatementKind::EndDoWhile)
+            {
+                SpirvValue loopCondition = condition(node, statement.taken);
+                emitTerminator(SpirvOp::BranchConditional, { loopCondition.id, construct.headerLabel, construct.mergeLabel });
+            }
+            else
+            {
+                if (construct.kind == IrStatementKind::Loop)
+                {
+                    uint32_t counter = construct.step == 0 ? construct.iterationVariable : aL;
+                    uint32_t increment = constantInt(construct.step == 0 ? 1 : construct.step);
+                    store(counter, emit(SpirvOp::IAdd, typeInt, { load(typeInt, counter), increment }));
+                }
+
+                emitTerminator(SpirvOp::Branch, { construct.headerLabel });
+            }
+
+            label(construct.mergeLabel);
+            break;
+        }
+
+        case IrStatementKind::Break:
+        case IrStatementKind::Continue:
+        {
+            auto loop = innermostLoop();
+            if (loop == nullptr)
+            {
+                isSupported = false;
+                break;
+            }
+
+            emitTerminator(SpirvOp::Branch, { statement.kind == IrStatementKind::Break ? loop->mergeLabel : loop->continueLabel });
+            break;
+        }
+
+        case IrStatementKind::DeclareFlag:
+            if (flags.size() <= statement.flag)
+                flags.resize(statement.flag + 1);
+
+            store(stateVariable(flags[statement.flag], boolType(1)), constantBool(false));
+            break;
+
+        case IrStatementKind::SetFlag:
+        case IrStatementKind::IfFlag:
+        case IrStatementKind::IfNotFlag:
+        {
+            if (statement.flag >= flags.size() || flags[statement.flag] == 0)
+            {
+                isSupported = false;
+                break;
+            }
+
+            if (statement.kind == IrStatementKind::SetFlag)
+            {
+                store(flags[statement.flag], condition(node, statement.taken).id);
+            }
+            else
+            {
+                SpirvValue flag = { load(boolType(1), flags[statement.flag]), 1, true };
+                beginIf(statement.kind == IrStatementKind::IfFlag ? flag : logicalNot(flag));
+            }
+
+            break;
+        }
+        }
+    }
+
+    void declareInterface()
+    {
+        auto& container = recompiler.container;
+
+        auto interpolator = [&](uint32_t storageClass, size_t index)
+            {
+                uint32_t id = globalVariable(storageClass, floatType(4));
+                decorate(id, SPIRV_DECORATION_LOCATION, index);
+                return id;
+            };
+
+        auto builtIn = [&](uint32_t storageClass, uint32_t type, uint32_t builtIn)
+            {
+                uint32_t id = globalVariable(storageClass, type);
+                decorate(id, SPIRV_DECORATION_BUILT_IN, builtIn);
+                return id;
+            };
+
+        if (isPixelShader)
+        {
+            position = builtIn(SPIRV_STORAGE_CLASS_INPUT, floatType(4), SPIRV_BUILT_IN_FRAG_COORD);
+
+            for (size_t i = 0; i < std::size(INTERPOLATORS); i++)
+            {
+                if (recompiler.metadata.interpolators & (1u << i))
+                    interpolatorVariables[i] = interpolator(SPIRV_STORAGE_CLASS_INPUT, i);
+            }
+
+            frontFacing = builtIn(SPIRV_STORAGE_CLASS_INPUT, boolType(1), SPIRV_BUILT_IN_FRONT_FACING);
+
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                if (container.pixelShaderOutputs & (PIXEL_SHADER_OUTPUT_COLOR0 << i))
+                {
+                    colorOutputs[i] = globalVariable(SPIRV_STORAGE_CLASS_OUTPUT, floatType(4));
+                    decorate(colorOutputs[i], SPIRV_DECORATION_LOCATION, i);
+                }
+            }
+
+            if (container.pixelShaderOutputs & PIXEL_SHADER_OUTPUT_DEPTH)
+                depthOutput = builtIn(SPIRV_STORAGE_CLASS_OUTPUT, floatType(1), SPIRV_BUILT_IN_FRAG_DEPTH);
+        }
+        else
+        {
+            for (auto& vertexElement : container.vertexElements)
+            {
+                const DeclUsageLocation* usageLocation = nullptr;
+                for (auto& candidate : USAGE_LOCATIONS)
+                {
+                    if (candidate.usage == vertexElement.usage && candidate.usageIndex == vertexElement.usageIndex)
+                    {
+                        usageLocation = &candidate;
+                        break;
+                    }
+                }
+
+                // DXC can't mix explicit locations with implicit ones, and HLSL rejects duplicate parameters.
+                bool isDuplicate = false;
+                for (auto& [inputElement, inputVariable] : vertexInputs)
+                    isDuplicate |= inputElement->usage == vertexElement.usage && inputElement->usageIndex == vertexElement.usageIndex;
+
+                if (usageLocation == nullptr || isDuplicate)
+                {
+                    isSupported = false;
+                    return;
+                }
+
+                uint32_t id = globalVariable(SPIRV_STORAGE_CLASS_INPUT, recompiler.isUintVertexElement(vertexElement) ? uintType(4) : floatType(4));
+                decorate(id, SPIRV_DECORATION_LOCATION, usageLocation->location);
+                vertexInputs.emplace_back(&vertexElement, id);
+            }
+
+        #ifdef UNLEASHED_RECOMP
+            if (recompiler.hasIndexCount)
+            {
+                vertexIndex = builtIn(SPIRV_STORAGE_CLASS_INPUT, uintType(1), SPIRV_BUILT_IN_VERTEX_INDEX);
+                instanceIndex = builtIn(SPIRV_STORAGE_CLASS_INPUT, uintType(1), SPIRV_BUILT_IN_INSTANCE_INDEX);
+            }
+        #endif
+
+            position = builtIn(SPIRV_STORAGE_CLASS_OUTPUT, floatType(4), SPIRV_BUILT_IN_POSITION);
+
+            for (size_t i = 0; i < std::size(INTERPOLATORS); i++)
+            {
+                if (recompiler.metadata.interpolators & (1u << i))
+                    interpolatorVariables[i] = interpolator(SPIRV_STORAGE_CLASS_OUTPUT, i);
+            }
+        }
+    }
+
+    void translatePrologue()
+    {
+        auto& container = recompiler.container;
+        bool initializedRegisters[64]{};
+        bool writtenInterpolators[std::size(INTERPOLATORS)]{};
+
+        for (uint32_t i = 0; i < container.interpolators.size(); i++)
+        {
+            auto& interpolator = container.interpolators[i];
+
+            size_t index = 0;
+            while (index < std::size(INTERPOLATORS) && (INTERPOLATORS[index].first != interpolator.usage || INTERPOLATORS[index].second != interpolator.usageIndex))
+                ++index;
+
+            if (isPixelShader)
+            {
+                if (ir.usedRegisters & (1ull << interpolator.reg))
+                {
+                    // HLSL would declare the register twice.
+                    if (index == std::size(INTERPOLATORS) || initializedRegisters[interpolator.reg])
+                    {
+                        isSupported = false;
+                        return;
+                    }
+
+                    store(registerVariable(interpolator.reg), load(floatType(4), interpolatorVariables[index]));
+                }
+
+                initializedRegisters[interpolator.reg] = true;
+            }
+            else if (ir.writtenExports[i] == 0b1111 && index != std::size(INTERPOLATORS))
+            {
+                writtenInterpolators[index] = true;
+            }
+        }
+
+        if (!isPixelShader)
+        {
+        #ifdef UNLEASHED_RECOMP
+            store(position, constantNull(floatType(4)));
+        #endif
+
+            for (size_t i = 0; i < std::size(INTERPOLATORS); i++)
+            {
+                if (interpolatorVariables[i] != 0 && !writtenInterpolators[i])
+                    store(interpolatorVariables[i], constantNull(floatType(4)));
+            }
+        }
+
+        // Other registers start out as zero through the initializer of their variable.
+        if (isPixelShader && container.svPosRegister < 64 && !initializedRegisters[container.svPosRegister] &&
+            (ir.usedRegisters & (1ull << container.svPosRegister)))
+        {
+            static constexpr uint32_t XY_COMPONENTS[] = { 0, 1 };
+
+            SpirvValue fragCoord = shuffle({ load(floatType(4), position), 4 }, XY_COMPONENTS, 2);
+            fragCoord = binary(SpirvOp::FSub, fragCoord, constantSplat(0.5f, 2));
+
+            SpirvValue isFrontFacing = { load(boolType(1), frontFacing), 1, true };
+            SpirvValue sign = select(isFrontFacing, constantSplat(1.0f, 1), constantSplat(-1.0f, 1));
+            SpirvValue scale = { emit(SpirvOp::CompositeConstruct, floatType(2), { sign.id, constantSplat(1.0f, 1).id }), 2 };
+            SpirvValue xy = binary(SpirvOp::FMul, fragCoord, scale);
+
+            uint32_t zero = constantSplat(0.0f, 1).id;
+            uint32_t value = emit(SpirvOp::CompositeConstruct, floatType(4), { extract(xy, 0).id, extract(xy, 1).id, zero, zero });
+            store(registerVariable(container.svPosRegister), value);
+        }
+
+    #ifdef UNLEASHED_RECOMP
+        if (!isPixelShader && recompiler.hasIndexCount && (ir.usedRegisters & 0x1) != 0)
+        {
+            const ParsedConstant* indexCount = nullptr;
+            for (auto& constant : container.getConstants(RegisterSet::Float4))
+            {
+                if (strcmp(constant.name, "g_IndexCount") == 0)
+                    indexCount = &constant;
+            }
+
+            if (indexCount == nullptr || indexCount->registerCount != 1)
+            {
+                isSupported = false;
+                return;
+            }
+
+            SpirvValue count = extract({ loadShaderConstant(constantUlong(indexCount->registerIndex * 16)), 4 }, 0);
+            SpirvValue vertex = { emit(SpirvOp::ConvertUToF, floatType(1), { load(uintType(1), vertexIndex) }), 1 };
+            SpirvValue instance = { emit(SpirvOp::ConvertUToF, floatType(1), { load(uintType(1), instanceIndex) }), 1 };
+            SpirvValue x = binary(SpirvOp::FAdd, vertex, binary(SpirvOp::FMul, count, instance));
+
+            uint32_t zero = constantSplat(0.0f, 1).id;
+            store(registerVariable(0), emit(SpirvOp::CompositeConstruct, floatType(4), { x.id, zero, zero, zero }));
+        }
+    #endif
+    }
+
+    bool translate(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstantsValue)
+    {
+        // The pc dispatcher and the projection loop are left to DXC.
+        if (!recompiler.structuredControlFlow)
+            return false;
+
+    #ifdef UNLEASHED_RECOMP
+        if (recompiler.hasMtxProjection)
+            return false;
+    #endif
+
+        glslImport = builder.allocateId();
+        typeVoid = builder.declareType(SpirvOp::TypeVoid, {});
+        typeInt = builder.declareType(SpirvOp::TypeInt, { 32, 1 });
+        typeLong = builder.declareType(SpirvOp::TypeInt, { 64, 1 });
+        typeUlong = builder.declareType(SpirvOp::TypeInt, { 64, 0 });
+
+        uint32_t pushConstantsType = builder.declareType(SpirvOp::TypeStruct, { typeUlong, typeUlong, typeUlong });
+        SpirvBuilder::emit(builder.annotations, SpirvOp::Decorate, { pushConstantsType, SPIRV_DECORATION_BLOCK });
+        for (uint32_t i = 0; i < 3; i++)
+            SpirvBuilder::emit(builder.annotations, SpirvOp::MemberDecorate, { pushConstantsType, i, SPIRV_DECORATION_OFFSET, i * 8 });
+
+        pushConstants = globalVariable(SPIRV_STORAGE_CLASS_PUSH_CONSTANT, pushConstantsType);
+
+        if (specConstantsValue.has_value())
+        {
+            specConstants = constantUint(*specConstantsValue);
+        }
+        else
+        {
+            specConstants = builder.allocateId();
+            SpirvBuilder::emit(builder.declarations, SpirvOp::SpecConstant, { uintType(1), specConstants, 0 });
+            decorate(specConstants, SPIRV_DECORATION_SPEC_ID, 0);
+        }
+
+        declareInterface();
+        if (!isSupported)
+            return false;
+
+        translatePrologue();
+
+        for (auto& statement : ir.statements)
+        {
+            if (!isSupported)
+                return false;
+
+            translateStatement(statement);
+        }
+
+        if (!isSupported || !constructs.empty())
+            return false;
+
+        emitTerminator(SpirvOp::Return, {});
+
+        uint32_t functionType = builder.declareType(SpirvOp::TypeFunction, { typeVoid });
+        uint32_t bodyFunction = builder.allocateId();
+        uint32_t mainFunction = builder.allocateId();
+
+        auto& functions = builder.functions;
+        SpirvBuilder::emit(functions, SpirvOp::Function, { typeVoid, bodyFunction, 0, functionType });
+        SpirvBuilder::emit(functions, SpirvOp::Label, { builder.allocateId() });
+        functions.insert(functions.end(), variables.begin(), variables.end());
+        functions.insert(functions.end(), code.begin(), code.end());
+        SpirvBuilder::emit(functions, SpirvOp::FunctionEnd, {});
+
+        // The entry point calls the body, so that returning from it still inverts the position like -fvk-invert-y.
+        SpirvBuilder::emit(functions, SpirvOp::Function, { typeVoid, mainFunction, 0, functionType });
+        SpirvBuilder::emit(functions, SpirvOp::Label, { builder.allocateId() });
+        SpirvBuilder::emit(functions, SpirvOp::FunctionCall, { typeVoid, builder.allocateId(), bodyFunction });
+
+        if (!isPixelShader)
+        {
+            uint32_t value = builder.allocateId();
+            uint32_t y = builder.allocateId();
+            uint32_t negatedY = builder.allocateId();
+            uint32_t result = builder.allocateId();
+
+            SpirvBuilder::emit(functions, SpirvOp::Load, { floatType(4), value, position });
+            SpirvBuilder::emit(functions, SpirvOp::CompositeExtract, { floatType(1), y, value, 1 });
+            SpirvBuilder::emit(functions, SpirvOp::FNegate, { floatType(1), negatedY, y });
+            SpirvBuilder::emit(functions, SpirvOp::CompositeInsert, { floatType(4), result, negatedY, value, 1 });
+            SpirvBuilder::emit(functions, SpirvOp::Store, { position, result });
+        }
+
+        SpirvBuilder::emit(functions, SpirvOp::Return, {});
+        SpirvBuilder::emit(functions, SpirvOp::FunctionEnd, {});
+
+        std::vector<uint32_t> operands = { isPixelShader ? SPIRV_EXECUTION_MODEL_FRAGMENT : SPIRV_EXECUTION_MODEL_VERTEX, mainFunction };
+        SpirvBuilder::appendString(operands, "main");
+        operands.insert(operands.end(), interfaceVariables.begin(), interfaceVariables.end());
+        SpirvBuilder::emit(builder.entryPoints, SpirvOp::EntryPoint, operands.data(), operands.size());
+
+        if (isPixelShader)
+        {
+            SpirvBuilder::emit(builder.entryPoints, SpirvOp::ExecutionMode, { mainFunction, SPIRV_EXECUTION_MODE_ORIGIN_UPPER_LEFT });
+            if (depthOutput != 0)
+                SpirvBuilder::emit(builder.entryPoints, SpirvOp::ExecutionMode, { mainFunction, SPIRV_EXECUTION_MODE_DEPTH_REPLACING });
+        }
+
+        auto& preamble = builder.preamble;
+        SpirvBuilder::emit(preamble, SpirvOp::Capability, { SPIRV_CAPABILITY_SHADER });
+        SpirvBuilder::emit(preamble, SpirvOp::Capability, { SPIRV_CAPABILITY_INT64 });
+        SpirvBuilder::emit(preamble, SpirvOp::Capability, { SPIRV_CAPABILITY_PHYSICAL_STORAGE_BUFFER_ADDRESSES });
+
+        if (usesDescriptorHeaps)
+            SpirvBuilder::emit(preamble, SpirvOp::Capability, { SPIRV_CAPABILITY_RUNTIME_DESCRIPTOR_ARRAY });
+
+        if (usesImageQuery)
+            SpirvBuilder::emit(preamble, SpirvOp::Capability, { SPIRV_CAPABILITY_IMAGE_QUERY });
+
+        auto extension = [&](std::string_view name)
+            {
+                operands.clear();
+                SpirvBuilder::appendString(operands, name);
+                SpirvBuilder::emit(preamble, SpirvOp::Extension, operands.data(), operands.size());
+            };
+
+        extension("SPV_KHR_physical_storage_buffer");
+        if (usesDescriptorHeaps)
+            extension("SPV_EXT_descriptor_indexing");
+
+        operands = { glslImport };
+        SpirvBuilder::appendString(operands, "GLSL.std.450");
+        SpirvBuilder::emit(preamble, SpirvOp::ExtInstImport, operands.data(), operands.size());
+
+        SpirvBuilder::emit(preamble, SpirvOp::MemoryModel, { SPIRV_ADDRESSING_MODEL_PHYSICAL_STORAGE_BUFFER_64, SPIRV_MEMORY_MODEL_GLSL450 });
+
+        builder.finish(spirv);
+        return true;
+    }
+};
+
+bool getSpirvInterface(const uint32_t* words, size_t wordCount, SpirvInterface& spirvInterface)
+{
+    static constexpr uint32_t SPIRV_HEADER_SIZE = 5;
+    static constexpr uint32_t SPIRV_INTERFACE_BUILT_IN = 0x80000000;
+
+    if (wordCount < SPIRV_HEADER_SIZE || words[0] != SPIRV_MAGIC)
+        return false;
+
+    std::vector<uint32_t> interfaceIds;
+    std::map<uint32_t, uint32_t> storageClasses;
+    std::map<uint32_t, uint32_t> locations;
+
+    for (size_t i = SPIRV_HEADER_SIZE; i < wordCount;)
+    {
+        uint32_t instructionSize = words[i] >> 16;
+        if (instructionSize == 0 || instructionSize > wordCount - i)
+            return false;
+
+        const uint32_t* operands = words + i + 1;
+        uint32_t operandCount = instructionSize - 1;
+
+        switch (SpirvOp(words[i] & 0xFFFF))
+        {
+        case SpirvOp::EntryPoint:
+            if (spirvInterface.executionModel == ~0u && operandCount >= 3)
+            {
+                spirvInterface.executionModel = operands[0];
+
+                // The name is a nul terminated string padded to a whole word, followed by the interface.
+                uint32_t j = 2;
+                while (j < operandCount && (operands[j] >> 24) != 0)
+                    ++j;
+
+                interfaceIds.assign(operands + std::min(j + 1, operandCount), operands + operandCount);
+            }
+            break;
+
+        case SpirvOp::Decorate:
+            if (operandCount >= 3 && operands[1] == SPIRV_DECORATION_LOCATION)
+                locations[operands[0]] = operands[2];
+            else if (operandCount >= 3 && operands[1] == SPIRV_DECORATION_BUILT_IN)
+                locations[operands[0]] = SPIRV_INTERFACE_BUILT_IN | operands[2];
+            break;
+
+        case SpirvOp::Variable:
+            if (operandCount >= 3)
+                storageClasses[operands[1]] = operands[2];
+            break;
+        }
+
+        i += instructionSize;
+    }
+
+    if (spirvInterface.executionModel == ~0u)
+        return false;
+
+    // SPIR-V 1.4 and later list every global variable, so only the inputs and outputs are kept.
+    for (uint32_t id : interfaceIds)
+    {
+        auto storageClass = storageClasses.find(id);
+        if (storageClass != storageClasses.end() &&
+            (storageClass->second == SPIRV_STORAGE_CLASS_INPUT || storageClass->second == SPIRV_STORAGE_CLASS_OUTPUT))
+        {
+            auto location = locations.find(id);
+            spirvInterface.variables.emplace(storageClass->second, location != locations.end() ? location->second : ~0u);
+        }
+    }
+
+    return true;
+}
+
+bool ShaderRecompiler::recompileSpirv(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants) const
+{
+    SpirvTranslator translator(*this);
+    return translator.translate(spirv, specConstants);
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+enum class SpirvOp : uint32_t
+{
+    Extension = 10,
+    ExtInstImport = 11,
+    ExtInst = 12,
+    MemoryModel = 14,
+    EntryPoint = 15,
+    ExecutionMode = 16,
+    Capability = 17,
+    TypeVoid = 19,
+    TypeBool = 20,
+    TypeInt = 21,
+    TypeFloat = 22,
+    TypeVector = 23,
+    TypeImage = 25,
+    TypeSampler = 26,
+    TypeSampledImage = 27,
+    TypeArray = 28,
+    TypeRuntimeArray = 29,
+    TypeStruct = 30,
+    TypePointer = 32,
+    TypeFunction = 33,
+    ConstantTrue = 41,
+    ConstantFalse = 42,
+    Constant = 43,
+    ConstantComposite = 44,
+    ConstantNull = 46,
+    SpecConstant = 50,
+    Function = 54,
+    FunctionEnd = 56,
+    FunctionCall = 57,
+    Variable = 59,
+    Load = 61,
+    Store = 62,
+    AccessChain = 65,
+    Decorate = 71,
+    MemberDecorate = 72,
+    VectorShuffle = 79,
+    CompositeConstruct = 80,
+    CompositeExtract = 81,
+    CompositeInsert = 82,
+    SampledImage = 86,
+    ImageSampleImplicitLod = 87,
+    ImageQuerySizeLod = 103,
+    ConvertFToU = 109,
+    ConvertFToS = 110,
+    ConvertUToF = 112,
+    SConvert = 114,
+    ConvertUToPtr = 120,
+    Bitcast = 124,
+    FNegate = 127,
+    IAdd = 128,
+    FAdd = 129,
+    FSub = 131,
+    IMul = 132,
+    FMul = 133,
+    FDiv = 136,
+    Dot = 148,
+    Any = 154,
+    IsNan = 156,
+    LogicalAnd = 167,
+    LogicalNot = 168,
+    Select = 169,
+    IEqual = 170,
+    INotEqual = 171,
+    SGreaterThan = 173,
+    SLessThan = 177,
+    FOrdEqual = 180,
+    FUnordNotEqual = 183,
+    FOrdLessThan = 184,
+    FOrdGreaterThan = 186,
+    FOrdLessThanEqual = 188,
+    FOrdGreaterThanEqual = 190,
+    ShiftRightLogical = 194,
+    BitwiseAnd = 199,
+    DPdx = 207,
+    DPdy = 208,
+    Fwidth = 209,
+    LoopMerge = 246,
+    SelectionMerge = 247,
+    Label = 248,
+    Branch = 249,
+    BranchConditional = 250,
+    Kill = 252,
+    Return = 253
+};
+
+// Instructions of the GLSL.std.450 extended instruction set.
+enum class GlslOp : uint32_t
+{
+    Trunc = 3,
+    FAbs = 4,
+    Floor = 8,
+    Fract = 10,
+    Sin = 13,
+    Cos = 14,
+    Exp2 = 29,
+    Log2 = 30,
+    Sqrt = 31,
+    InverseSqrt = 32,
+    FMin = 37,
+    SMin = 39,
+    FMax = 40,
+    FClamp = 43
+};
+
+enum SpirvCapability : uint32_t
+{
+    SPIRV_CAPABILITY_SHADER = 1,
+    SPIRV_CAPABILITY_INT64 = 11,
+    SPIRV_CAPABILITY_IMAGE_QUERY = 50,
+    SPIRV_CAPABILITY_RUNTIME_DESCRIPTOR_ARRAY = 5302,
+    SPIRV_CAPABILITY_PHYSICAL_STORAGE_BUFFER_ADDRESSES = 5347
+};
+
+enum SpirvStorageClass : uint32_t
+{
+    SPIRV_STORAGE_CLASS_UNIFORM_CONSTANT = 0,
+    SPIRV_STORAGE_CLASS_INPUT = 1,
+    SPIRV_STORAGE_CLASS_OUTPUT = 3,
+    SPIRV_STORAGE_CLASS_FUNCTION = 7,
+    SPIRV_STORAGE_CLASS_PUSH_CONSTANT = 9,
+    SPIRV_STORAGE_CLASS_PHYSICAL_STORAGE_BUFFER = 5349
+};
+
+enum SpirvDecoration : uint32_t
+{
+    SPIRV_DECORATION_SPEC_ID = 1,
+    SPIRV_DECORATION_BLOCK = 2,
+    SPIRV_DECORATION_BUILT_IN = 11,
+    SPIRV_DECORATION_LOCATION = 30,
+    SPIRV_DECORATION_BINDING = 33,
+    SPIRV_DECORATION_DESCRIPTOR_SET = 34,
+    SPIRV_DECORATION_OFFSET = 35
+};
+
+enum SpirvBuiltIn : uint32_t
+{
+    SPIRV_BUILT_IN_POSITION = 0,
+    SPIRV_BUILT_IN_FRAG_COORD = 15,
+    SPIRV_BUILT_IN_FRONT_FACING = 17,
+    SPIRV_BUILT_IN_FRAG_DEPTH = 22,
+    SPIRV_BUILT_IN_VERTEX_INDEX = 42,
+    SPIRV_BUILT_IN_INSTANCE_INDEX = 43
+};
+
+// Assembles a SPIR-V module. Instructions are appended to the section they belong to, which get concatenated in the
+// order the specification requires. Types and constants are deduplicated.
+struct SpirvBuilder
+{
+    uint32_t idBound = 1;
+
+    // Capabilities, extensions, extended instruction set imports and the memory model.
+    std::vector<uint32_t> preamble;
+    // Entry points and their execution modes.
+    std::vector<uint32_t> entryPoints;
+    std::vector<uint32_t> annotations;
+    // Types, constants and global variables.
+    std::vector<uint32_t> declarations;
+    std::vector<uint32_t> functions;
+
+    // Keyed by the opcode and operands of the declaration, excluding the result id.
+    std::map<std::vector<uint32_t>, uint32_t> declarationIds;
+
+    uint32_t allocateId()
+    {
+        return idBound++;
+    }
+
+    static void emit(std::vector<uint32_t>& section, SpirvOp op, const uint32_t* operands, size_t operandCount);
+
+    static void emit(std::vector<uint32_t>& section, SpirvOp op, std::initializer_list<uint32_t> operands)
+    {
+        emit(section, op, operands.begin(), operands.size());
+    }
+
+    // Appends a nul terminated string padded to a whole word.
+    static void appendString(std::vector<uint32_t>& operands, std::string_view value);
+
+    uint32_t declareType(SpirvOp op, std::initializer_list<uint32_t> operands);
+    uint32_t declareConstant(SpirvOp op, uint32_t type, const uint32_t* operands, size_t operandCount);
+
+    uint32_t declareConstant(SpirvOp op, uint32_t type, std::initializer_list<uint32_t> operands)
+    {
+        return declareConstant(op, type, operands.begin(), operands.size());
+    }
+
+    // Writes the header followed by every section.
+    void finish(std::vector<uint32_t>& module) const;
+};
+
+// The stage interface of a module, which has to match between the direct translation and DXC for pipelines to link.
+struct SpirvInterface
+{
+    uint32_t executionModel = ~0u;
+
+    // Storage class and location of every input and output. Built-ins are stored with the high bit set instead.
+    std::set<std::pair<uint32_t, uint32_t>> variables;
+
+    bool operator==(const SpirvInterface& other) const
+    {
+        return executionModel == other.executionModel && variables == other.variables;
+    }
+
+    bool operator!=(const SpirvInterface& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+// Reads the interface of the first entry point. Returns false if the module is malformed.
+bool getSpirvInterface(const uint32_t* words, size_t wordCount, SpirvInterface& spirvInterface);
@@ -0,0 +1,52 @@
+#include "shader_translator.h"
+
+bool ShaderTranslator::translate(const uint8_t* shaderData, size_t dataSize, const std::string_view& include, uint32_t linkedInterpolators)
+{
+    recompiler.reset();
+    recompiler.linkedInterpolators = linkedInterpolators;
+    return recompiler.recompile(shaderData, dataSize, include);
+}
+
+bool ShaderTranslator::compileDxil(std::vector<uint8_t>& dxil, std::optional<uint32_t> specConstants)
+{
+    if (dxcCompiler == nullptr)
+        dxcCompiler = std::make_unique<DxcCompiler>();
+
+    bool compileLibrary = !specConstants.has_value() && recompiler.specConstantsMask != 0;
+    IDxcBlob* blob = dxcCompiler->compile(recompiler.out, recompiler.isPixelShader, compileLibrary, false, profile, specConstants);
+    if (blob == nullptr)
+        return false;
+
+    auto data = reinterpret_cast<const uint8_t*>(blob->GetBufferPointer());
+    dxil.assign(data, data + blob->GetBufferSize());
+
+    blob->Release();
+
+    return true;
+}
+
+bool ShaderTranslator::compileSpirv(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants)
+{
+    isSpirvDirect = directSpirv && recompiler.recompileSpirv(spirv, specConstants);
+    if (isSpirvDirect)
+        return true;
+
+    return compileSpirvWithDxc(spirv, specConstants);
+}
+
+bool ShaderTranslator::compileSpirvWithDxc(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants)
+{
+    if (dxcCompiler == nullptr)
+        dxcCompiler = std::make_unique<DxcCompiler>();
+
+    IDxcBlob* blob = dxcCompiler->compile(recompiler.out, recompiler.isPixelShader, false, true, profile, specConstants);
+    if (blob == nullptr)
+        return false;
+
+    spirv.resize(blob->GetBufferSize() / sizeof(uint32_t));
+    memcpy(spirv.data(), blob->GetBufferPointer(), spirv.size() * sizeof(uint32_t));
+
+    blob->Release();
+
+    return true;
+}
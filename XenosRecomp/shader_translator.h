@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pch.h"
+#include "dxc_compiler.h"
+#include "shader_recompiler.h"
+
+// In-memory entry point of the library, for translating shaders on demand without going through the filesystem.
+// An instance must only be used by one thread at a time, separate instances can translate in parallel. The
+// recompiler and the output vectors keep their capacity between calls, so a reused instance stops allocating
+// once it has seen shaders of a similar size.
+struct ShaderTranslator
+{
+    DxcProfile profile = DxcProfile::Release;
+
+    // Translates SPIR-V straight from the IR when the shader supports it instead of compiling the HLSL with DXC.
+    bool directSpirv = false;
+
+    ShaderRecompiler recompiler;
+
+    // Whether the last compileSpirv() call translated the shader directly.
+    bool isSpirvDirect = false;
+
+    // Created on first use, as translating directly to SPIR-V doesn't need it.
+    std::unique_ptr<DxcCompiler> dxcCompiler;
+
+    // Recompiles a shader container to HLSL, which is left in recompiler.out. The include is the contents of
+    // shader_common.h. Passing the interpolators of a pixel shader links a vertex shader against it, leaving out the
+    // exports it doesn't read. Returns false if the data is not a valid shader container.
+    bool translate(const uint8_t* shaderData, size_t dataSize, const std::string_view& include, uint32_t linkedInterpolators = ~0u);
+
+    // Compile the shader of the last translate() call. Passing specialization constants freezes them to the given value,
+    // otherwise DXIL of shaders using them is compiled as a library. Return false if DXC fails.
+    bool compileDxil(std::vector<uint8_t>& dxil, std::optional<uint32_t> specConstants = std::nullopt);
+    bool compileSpirv(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants = std::nullopt);
+
+    // Compiles the SPIR-V with DXC even if the shader supports the direct translation.
+    bool compileSpirvWithDxc(std::vector<uint32_t>& spirv, std::optional<uint32_t> specConstants = std::nullopt);
+};